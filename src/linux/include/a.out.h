@@ -556,7 +556,7 @@ static inline int exec_load(const char *filename, unsigned int task_id,
 
 	msg.header.msg_id = MSG_EXEC_LOAD;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.filename = filename;
@@ -569,7 +569,7 @@ static inline int exec_load(const char *filename, unsigned int task_id,
 	if (result < 0)
 		return -1;
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0)
 		return -1;
 
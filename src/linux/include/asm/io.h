@@ -126,7 +126,7 @@ do { \
 		/* Prepare message */ \
 		msg.header.msg_id = MSG_IO_INB; \
 		msg.header.sender_port = kernel_state->kernel_port; \
-		msg.header.reply_port = kernel_state->kernel_port; \
+		msg.header.reply_port = ipc_reply_port(); \
 		msg.header.size = sizeof(msg); \
 		\
 		msg.port = (unsigned short)(port); \
@@ -135,7 +135,7 @@ do { \
 		\
 		/* Send request and wait for reply */ \
 		if (mk_msg_send(DEVICE_SERVER_PORT, &msg, sizeof(msg)) == 0) { \
-			if (mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size) == 0) { \
+			if (mk_msg_receive(ipc_reply_port(), &reply, &reply_size) == 0) { \
 				if (reply.result == 0) \
 					_v = reply.value.byte; \
 			} \
@@ -188,7 +188,7 @@ do { \
 	if (current_capability & CAP_IO) { \
 		msg.header.msg_id = MSG_IO_INB; \
 		msg.header.sender_port = kernel_state->kernel_port; \
-		msg.header.reply_port = kernel_state->kernel_port; \
+		msg.header.reply_port = ipc_reply_port(); \
 		msg.header.size = sizeof(msg); \
 		\
 		msg.port = (unsigned short)(port); \
@@ -196,7 +196,7 @@ do { \
 		msg.task_id = kernel_state->current_task; \
 		\
 		if (mk_msg_send(DEVICE_SERVER_PORT, &msg, sizeof(msg)) == 0) { \
-			if (mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size) == 0) { \
+			if (mk_msg_receive(ipc_reply_port(), &reply, &reply_size) == 0) { \
 				if (reply.result == 0) \
 					_v = reply.value.byte; \
 			} \
@@ -231,13 +231,13 @@ do { \
 	if (current_capability & CAP_IO) { \
 		msg.header.msg_id = MSG_IO_INW; \
 		msg.header.sender_port = kernel_state->kernel_port; \
-		msg.header.reply_port = kernel_state->kernel_port; \
+		msg.header.reply_port = ipc_reply_port(); \
 		msg.header.size = sizeof(msg); \
 		msg.port = (unsigned short)(port); \
 		msg.caps = current_capability; \
 		msg.task_id = kernel_state->current_task; \
 		if (mk_msg_send(DEVICE_SERVER_PORT, &msg, sizeof(msg)) == 0) { \
-			if (mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size) == 0) { \
+			if (mk_msg_receive(ipc_reply_port(), &reply, &reply_size) == 0) { \
 				if (reply.result == 0) \
 					_v = reply.value.word; \
 			} \
@@ -261,7 +261,7 @@ static inline int request_io_capability(void)
 	
 	msg.header.msg_id = MSG_IO_REQUEST_CAP;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.caps = current_capability;
@@ -270,7 +270,7 @@ static inline int request_io_capability(void)
 	msg.value = 0; /* Not used */
 	
 	if (mk_msg_send(DEVICE_SERVER_PORT, &msg, sizeof(msg)) == 0) {
-		if (mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size) == 0) {
+		if (mk_msg_receive(ipc_reply_port(), &reply, &reply_size) == 0) {
 			if (reply.result == 0) {
 				/* Update current capability with I/O permission */
 				current_capability |= CAP_IO;
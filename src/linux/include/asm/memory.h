@@ -113,7 +113,7 @@ struct msg_mem_reply {
 		/* Prepare message */ \
 		msg.header.msg_id = MSG_MEM_COPY; \
 		msg.header.sender_port = kernel_state->kernel_port; \
-		msg.header.reply_port = kernel_state->kernel_port; \
+		msg.header.reply_port = ipc_reply_port(); \
 		msg.header.size = sizeof(msg); \
 		\
 		msg.dest = (unsigned long)(dest); \
@@ -126,7 +126,7 @@ struct msg_mem_reply {
 		\
 		/* Send to memory server and wait for confirmation */ \
 		if (mk_msg_send(kernel_state->memory_server, &msg, sizeof(msg)) == 0) { \
-			if (mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size) == 0) { \
+			if (mk_msg_receive(ipc_reply_port(), &reply, &reply_size) == 0) { \
 				if (reply.result == 0) { \
 					/* Operation successful */ \
 				} else { \
@@ -166,7 +166,7 @@ struct msg_mem_reply {
 	if (current_capability & CAP_MEMORY) { \
 		msg.header.msg_id = MSG_MEM_MOVE; /* Different opcode */ \
 		msg.header.sender_port = kernel_state->kernel_port; \
-		msg.header.reply_port = kernel_state->kernel_port; \
+		msg.header.reply_port = ipc_reply_port(); \
 		msg.header.size = sizeof(msg); \
 		\
 		msg.dest = (unsigned long)(dest); \
@@ -178,7 +178,7 @@ struct msg_mem_reply {
 		msg.src_space = kernel_state->current_space; \
 		\
 		if (mk_msg_send(kernel_state->memory_server, &msg, sizeof(msg)) == 0) { \
-			if (mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size) == 0) { \
+			if (mk_msg_receive(ipc_reply_port(), &reply, &reply_size) == 0) { \
 				if (reply.result != 0) \
 					_res = NULL; \
 			} else { \
@@ -211,7 +211,7 @@ struct msg_mem_reply {
 	if (current_capability & CAP_MEMORY) { \
 		msg.header.msg_id = MSG_MEM_SET; \
 		msg.header.sender_port = kernel_state->kernel_port; \
-		msg.header.reply_port = kernel_state->kernel_port; \
+		msg.header.reply_port = ipc_reply_port(); \
 		msg.header.size = sizeof(msg); \
 		\
 		msg.dest = (unsigned long)(s); \
@@ -222,7 +222,7 @@ struct msg_mem_reply {
 		msg.space_id = kernel_state->current_space; \
 		\
 		if (mk_msg_send(kernel_state->memory_server, &msg, sizeof(msg)) == 0) { \
-			if (mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size) == 0) { \
+			if (mk_msg_receive(ipc_reply_port(), &reply, &reply_size) == 0) { \
 				if (reply.result != 0) \
 					_res = NULL; \
 			} else { \
@@ -255,7 +255,7 @@ struct msg_mem_reply {
 	if (current_capability & CAP_MEMORY) { \
 		msg.header.msg_id = MSG_MEM_CMP; \
 		msg.header.sender_port = kernel_state->kernel_port; \
-		msg.header.reply_port = kernel_state->kernel_port; \
+		msg.header.reply_port = ipc_reply_port(); \
 		msg.header.size = sizeof(msg); \
 		\
 		msg.s1 = (unsigned long)(s1); \
@@ -267,7 +267,7 @@ struct msg_mem_reply {
 		msg.space2_id = kernel_state->current_space; \
 		\
 		if (mk_msg_send(kernel_state->memory_server, &msg, sizeof(msg)) == 0) { \
-			if (mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size) == 0) { \
+			if (mk_msg_receive(ipc_reply_port(), &reply, &reply_size) == 0) { \
 				_res = reply.data.value; /* Comparison result */ \
 			} \
 		} \
@@ -291,7 +291,7 @@ struct msg_mem_reply {
 	if (current_capability & CAP_MEMORY) { \
 		msg.header.msg_id = MSG_MEM_ZERO; \
 		msg.header.sender_port = kernel_state->kernel_port; \
-		msg.header.reply_port = kernel_state->kernel_port; \
+		msg.header.reply_port = ipc_reply_port(); \
 		msg.header.size = sizeof(msg); \
 		\
 		msg.dest = (unsigned long)(s); \
@@ -302,7 +302,7 @@ struct msg_mem_reply {
 		msg.space_id = kernel_state->current_space; \
 		\
 		if (mk_msg_send(kernel_state->memory_server, &msg, sizeof(msg)) == 0) { \
-			if (mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size) == 0) { \
+			if (mk_msg_receive(ipc_reply_port(), &reply, &reply_size) == 0) { \
 				_res = reply.result; \
 			} \
 		} \
@@ -324,7 +324,7 @@ static inline int request_memory_capability(void)
 	
 	msg.header.msg_id = MSG_MEM_REQUEST_CAP; /* Would need to define this */
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.caps = current_capability;
@@ -332,7 +332,7 @@ static inline int request_memory_capability(void)
 	/* Other fields zero */
 	
 	if (mk_msg_send(kernel_state->memory_server, &msg, sizeof(msg)) == 0) {
-		if (mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size) == 0) {
+		if (mk_msg_receive(ipc_reply_port(), &reply, &reply_size) == 0) {
 			if (reply.result == 0) {
 				current_capability |= CAP_MEMORY;
 				return 0;
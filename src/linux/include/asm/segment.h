@@ -127,7 +127,7 @@ static inline unsigned char get_fs_byte(const char * addr)
 	/* Prepare message */
 	msg.header.msg_id = MSG_SEG_GET_BYTE;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.addr = (unsigned long)addr;
@@ -137,7 +137,7 @@ static inline unsigned char get_fs_byte(const char * addr)
 	
 	/* Send to memory server and wait for reply */
 	if (mk_msg_send(kernel_state->memory_server, &msg, sizeof(msg)) == 0) {
-		if (mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size) == 0) {
+		if (mk_msg_receive(ipc_reply_port(), &reply, &reply_size) == 0) {
 			if (reply.result == 0)
 				_v = reply.data.byte;
 		}
@@ -162,7 +162,7 @@ static inline unsigned short get_fs_word(const unsigned short *addr)
 	
 	msg.header.msg_id = MSG_SEG_GET_WORD;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.addr = (unsigned long)addr;
@@ -171,7 +171,7 @@ static inline unsigned short get_fs_word(const unsigned short *addr)
 	msg.task_id = kernel_state->current_task;
 	
 	if (mk_msg_send(kernel_state->memory_server, &msg, sizeof(msg)) == 0) {
-		if (mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size) == 0) {
+		if (mk_msg_receive(ipc_reply_port(), &reply, &reply_size) == 0) {
 			if (reply.result == 0)
 				_v = reply.data.word;
 		}
@@ -196,7 +196,7 @@ static inline unsigned long get_fs_long(const unsigned long *addr)
 	
 	msg.header.msg_id = MSG_SEG_GET_LONG;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.addr = (unsigned long)addr;
@@ -205,7 +205,7 @@ static inline unsigned long get_fs_long(const unsigned long *addr)
 	msg.task_id = kernel_state->current_task;
 	
 	if (mk_msg_send(kernel_state->memory_server, &msg, sizeof(msg)) == 0) {
-		if (mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size) == 0) {
+		if (mk_msg_receive(ipc_reply_port(), &reply, &reply_size) == 0) {
 			if (reply.result == 0)
 				_v = reply.data.dword;
 		}
@@ -316,7 +316,7 @@ static inline unsigned long copy_from_fs(void *to, const void *from, unsigned lo
 	
 	msg.header.msg_id = MSG_SEG_COPY_FROM;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.from_addr = (unsigned long)from;
@@ -328,7 +328,7 @@ static inline unsigned long copy_from_fs(void *to, const void *from, unsigned lo
 	msg.task_id = kernel_state->current_task;
 	
 	if (mk_msg_send(kernel_state->memory_server, &msg, sizeof(msg)) == 0) {
-		if (mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size) == 0) {
+		if (mk_msg_receive(ipc_reply_port(), &reply, &reply_size) == 0) {
 			if (reply.result >= 0)
 				return reply.result;  /* Bytes actually copied */
 		}
@@ -354,7 +354,7 @@ static inline unsigned long copy_to_fs(void *to, const void *from, unsigned long
 	
 	msg.header.msg_id = MSG_SEG_COPY_TO;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.from_addr = (unsigned long)from;
@@ -366,7 +366,7 @@ static inline unsigned long copy_to_fs(void *to, const void *from, unsigned long
 	msg.task_id = kernel_state->current_task;
 	
 	if (mk_msg_send(kernel_state->memory_server, &msg, sizeof(msg)) == 0) {
-		if (mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size) == 0) {
+		if (mk_msg_receive(ipc_reply_port(), &reply, &reply_size) == 0) {
 			if (reply.result >= 0)
 				return reply.result;
 		}
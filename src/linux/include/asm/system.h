@@ -130,7 +130,7 @@ do { \
 	/* Prepare message */ \
 	msg.header.msg_id = MSG_SYS_MOVE_TO_USER; \
 	msg.header.sender_port = kernel_state->kernel_port; \
-	msg.header.reply_port = kernel_state->kernel_port; \
+	msg.header.reply_port = ipc_reply_port(); \
 	msg.header.size = sizeof(msg); \
 	\
 	/* Get current stack and instruction pointers */ \
@@ -147,7 +147,7 @@ do { \
 	\
 	/* Send to system server and wait for confirmation */ \
 	if (mk_msg_send(kernel_state->system_server, &msg, sizeof(msg)) == 0) { \
-		mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size); \
+		mk_msg_receive(ipc_reply_port(), &reply, &reply_size); \
 	} \
 	\
 	/* If we return here, we're back in kernel mode */ \
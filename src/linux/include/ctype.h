@@ -269,7 +269,7 @@ static inline struct ctype_locale *load_ctype_table(const char *locale_name)
 	/* Prepare IPC message to locale server */
 	msg.header.msg_id = MSG_LOCALE_GET;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.locale_name = locale_name;
@@ -281,7 +281,7 @@ static inline struct ctype_locale *load_ctype_table(const char *locale_name)
 		return NULL;
 	
 	/* Receive reply */
-	if (mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size) < 0)
+	if (mk_msg_receive(ipc_reply_port(), &reply, &reply_size) < 0)
 		return NULL;
 	
 	if (reply.result < 0)
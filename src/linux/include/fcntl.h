@@ -214,7 +214,7 @@ static inline long __fcntl_request(int cmd, int fildes, unsigned long arg,
 	/* Prepare message */
 	msg.header.msg_id = msg_id;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = need_reply ? kernel_state->kernel_port : 0;
+	msg.header.reply_port = need_reply ? ipc_reply_port() : 0;
 	msg.header.size = sizeof(msg);
 
 	msg.fildes = fildes;
@@ -231,7 +231,7 @@ static inline long __fcntl_request(int cmd, int fildes, unsigned long arg,
 	if (!need_reply)
 		return 0;
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0)
 		return -1;
 
@@ -282,7 +282,7 @@ extern int open(const char * filename, int flags, ...)
 	/* Prepare message */
 	msg.header.msg_id = MSG_FCNTL_OPEN;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.filename = filename;
@@ -297,7 +297,7 @@ extern int open(const char * filename, int flags, ...)
 		return -1;
 
 	/* Wait for reply */
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0)
 		return -1;
 
@@ -330,7 +330,7 @@ extern int creat(const char * filename, mode_t mode)
 
 	msg.header.msg_id = MSG_FCNTL_CREAT;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.filename = filename;
@@ -342,7 +342,7 @@ extern int creat(const char * filename, mode_t mode)
 	if (result < 0)
 		return -1;
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0)
 		return -1;
 
@@ -381,7 +381,7 @@ extern int fcntl(int fildes, int cmd, ...)
 
 				msg.header.msg_id = MSG_FCNTL_DUPFD;
 				msg.header.sender_port = kernel_state->kernel_port;
-				msg.header.reply_port = kernel_state->kernel_port;
+				msg.header.reply_port = ipc_reply_port();
 				msg.header.size = sizeof(msg);
 
 				msg.fildes = fildes;
@@ -392,7 +392,7 @@ extern int fcntl(int fildes, int cmd, ...)
 				if (mk_msg_send(kernel_state->file_server, &msg, sizeof(msg)) < 0)
 					return -1;
 
-				if (mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size) < 0)
+				if (mk_msg_receive(ipc_reply_port(), &reply, &reply_size) < 0)
 					return -1;
 
 				return (reply.result < 0) ? reply.result : reply.data.fd;
@@ -428,7 +428,7 @@ extern int fcntl(int fildes, int cmd, ...)
 				                          (cmd == F_SETLK) ? MSG_FCNTL_SETLK :
 				                          MSG_FCNTL_SETLKW;
 				msg.header.sender_port = kernel_state->kernel_port;
-				msg.header.reply_port = kernel_state->kernel_port;
+				msg.header.reply_port = ipc_reply_port();
 				msg.header.size = sizeof(msg);
 
 				msg.fildes = fildes;
@@ -441,7 +441,7 @@ extern int fcntl(int fildes, int cmd, ...)
 				if (mk_msg_send(kernel_state->file_server, &msg, sizeof(msg)) < 0)
 					return -1;
 
-				if (mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size) < 0)
+				if (mk_msg_receive(ipc_reply_port(), &reply, &reply_size) < 0)
 					return -1;
 
 				if (reply.result == 0 && cmd == F_GETLK && lock)
@@ -554,14 +554,14 @@ static inline int request_file_capability(unsigned int cap)
 
 	msg.header.msg_id = MSG_CAP_REQUEST_FILE;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.task_id = kernel_state->current_task;
 	msg.requested_cap = cap;
 
 	if (mk_msg_send(kernel_state->file_server, &msg, sizeof(msg)) == 0) {
-		if (mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size) == 0) {
+		if (mk_msg_receive(ipc_reply_port(), &reply, &reply_size) == 0) {
 			if (reply.result == 0) {
 				current_capability |= cap;
 				return 0;
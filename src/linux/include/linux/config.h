@@ -64,7 +64,7 @@
 
 #define CONFIG_PAGE_SIZE	4096	/* Page size in bytes */
 #define CONFIG_MAX_TASKS	64	/* Maximum number of tasks */
-#define CONFIG_MAX_PORTS	256	/* Maximum IPC ports */
+#define CONFIG_MAX_PORTS	32768	/* Maximum IPC ports (table grows by page) */
 #define CONFIG_MAX_CAP_SPACES	16	/* Maximum capability spaces */
 #define CONFIG_MAX_SERVERS	32	/* Maximum number of servers */
 
@@ -93,6 +93,8 @@
 #define CONFIG_IPC_MAX_MSG	4096	/* Maximum IPC message size */
 #define CONFIG_IPC_MAX_QUEUE	64	/* Messages per queue */
 #define CONFIG_IPC_TIMEOUT	5000	/* Default timeout (ms) */
+#define CONFIG_IPC_STATS	1	/* Per-port counters, TSC latency if any */
+#define CONFIG_IPC_SELFTEST	0	/* Reply table round trips at boot */
 
 /*=============================================================================
  * Capability Configuration
@@ -152,7 +154,8 @@
  * Timer Configuration
  *============================================================================*/
 
-#define CONFIG_HZ		100	/* Timer interrupts per second */
+#define CONFIG_HZ		100	/* Jiffies per second */
+#define CONFIG_NO_HZ		1	/* One-shot PIT, no periodic tick */
 #define CONFIG_TIME_QUALITY	1000	/* Time server quality */
 
 /*=============================================================================
@@ -290,7 +293,7 @@ static inline long config_get(unsigned int param)
 
 	msg.header.msg_id = MSG_CONFIG_GET;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.param = param;
@@ -301,7 +304,7 @@ static inline long config_get(unsigned int param)
 	if (result < 0)
 		return -1;
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0)
 		return -1;
 
@@ -328,7 +331,7 @@ static inline int config_set(unsigned int param, unsigned long value)
 
 	msg.header.msg_id = MSG_CONFIG_SET;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.param = param;
@@ -340,7 +343,7 @@ static inline int config_set(unsigned int param, unsigned long value)
 	if (result < 0)
 		return -1;
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0)
 		return -1;
 
@@ -365,7 +368,7 @@ static inline int config_get_system(struct sys_config *config)
 
 	msg.header.msg_id = MSG_CONFIG_GET;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.param = 0;  /* Special: get full config */
@@ -376,7 +379,7 @@ static inline int config_get_system(struct sys_config *config)
 	if (result < 0)
 		return -1;
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0)
 		return -1;
 
@@ -535,7 +538,7 @@ static inline int config_has_feature(unsigned int feature)
 #error "CONFIG_MAX_TASKS too large"
 #endif
 
-#if CONFIG_MAX_PORTS > 1024
+#if CONFIG_MAX_PORTS > 32768
 #error "CONFIG_MAX_PORTS too large"
 #endif
 
@@ -556,7 +559,7 @@ static inline int config_has_feature(unsigned int feature)
 #endif
 
 #ifndef CONFIG_MAX_PORTS
-#define CONFIG_MAX_PORTS 256
+#define CONFIG_MAX_PORTS 32768
 #endif
 
 #ifndef CONFIG_MAX_SERVERS
@@ -112,6 +112,15 @@
 #define MSG_FLOPPY_FORMAT	0x1A0C	/* Format track */
 #define MSG_FLOPPY_REPLY	0x1A0D	/* Reply from device server */
 
+/*
+ * Motor control goes to the device server as notification bits
+ * (MK_NOTIFY_EVENT) rather than messages: floppy_on/off run with
+ * interrupts off and from timers, and repeated requests coalesce.
+ */
+#define FLOPPY_NOTIFY_ON(nr)	(0x10000UL << (nr))	/* Motor on, drive nr */
+#define FLOPPY_NOTIFY_OFF(nr)	(0x100000UL << (nr))	/* Motor off, drive nr */
+#define FLOPPY_NOTIFY_TIMER	0x1000000UL		/* Floppy timer tick */
+
 /*=============================================================================
  * IPC MESSAGE STRUCTURES
  *============================================================================*/
@@ -244,7 +253,7 @@ static inline int __floppy_request(unsigned int msg_id, unsigned int drive,
 
 	msg.header.msg_id = msg_id;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = need_reply ? kernel_state->kernel_port : 0;
+	msg.header.reply_port = need_reply ? ipc_reply_port() : 0;
 	msg.header.size = sizeof(msg);
 
 	msg.drive = drive;
@@ -259,7 +268,7 @@ static inline int __floppy_request(unsigned int msg_id, unsigned int drive,
 	if (!need_reply)
 		return 0;
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0)
 		return -1;
 
@@ -282,7 +291,7 @@ int ticks_to_floppy_on(unsigned int nr)
 
 	msg.header.msg_id = MSG_FLOPPY_TICKS_ON;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.drive = nr;
@@ -293,7 +302,7 @@ int ticks_to_floppy_on(unsigned int nr)
 	if (result < 0)
 		return -1;
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0)
 		return -1;
 
@@ -376,7 +385,7 @@ static inline int floppy_read_sector(unsigned int drive, unsigned int cylinder,
 
 	msg.header.msg_id = MSG_FLOPPY_READ;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.drive = drive;
@@ -394,7 +403,7 @@ static inline int floppy_read_sector(unsigned int drive, unsigned int cylinder,
 	if (result < 0)
 		return -1;
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0)
 		return -1;
 
@@ -425,7 +434,7 @@ static inline int floppy_write_sector(unsigned int drive, unsigned int cylinder,
 
 	msg.header.msg_id = MSG_FLOPPY_WRITE;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.drive = drive;
@@ -443,7 +452,7 @@ static inline int floppy_write_sector(unsigned int drive, unsigned int cylinder,
 	if (result < 0)
 		return -1;
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0)
 		return -1;
 
@@ -469,7 +478,7 @@ static inline int floppy_seek(unsigned int drive, unsigned int cylinder)
 
 	msg.header.msg_id = MSG_FLOPPY_SEEK;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.drive = drive;
@@ -482,7 +491,7 @@ static inline int floppy_seek(unsigned int drive, unsigned int cylinder)
 	if (result < 0)
 		return -1;
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0)
 		return -1;
 
@@ -507,7 +516,7 @@ static inline int floppy_recalibrate(unsigned int drive)
 
 	msg.header.msg_id = MSG_FLOPPY_RECALIBRATE;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.drive = drive;
@@ -519,7 +528,7 @@ static inline int floppy_recalibrate(unsigned int drive)
 	if (result < 0)
 		return -1;
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0)
 		return -1;
 
@@ -545,7 +554,7 @@ static inline int floppy_sense_interrupt(unsigned int drive,
 
 	msg.header.msg_id = MSG_FLOPPY_SENSEI;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.drive = drive;
@@ -557,7 +566,7 @@ static inline int floppy_sense_interrupt(unsigned int drive,
 	if (result < 0)
 		return -1;
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0)
 		return -1;
 
@@ -620,7 +629,7 @@ static inline int floppy_get_status(unsigned int drive, unsigned char *st3)
 
 	msg.header.msg_id = MSG_FLOPPY_GET_STATUS;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.drive = drive;
@@ -631,7 +640,7 @@ static inline int floppy_get_status(unsigned int drive, unsigned char *st3)
 	if (result < 0)
 		return -1;
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0)
 		return -1;
 
@@ -653,14 +662,14 @@ static inline int request_floppy_capability(unsigned int cap)
 
 	msg.header.msg_id = MSG_CAP_REQUEST_FLOPPY;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.task_id = kernel_state->current_task;
 	msg.requested_cap = cap;
 
 	if (mk_msg_send(kernel_state->device_server, &msg, sizeof(msg)) == 0) {
-		if (mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size) == 0) {
+		if (mk_msg_receive(ipc_reply_port(), &reply, &reply_size) == 0) {
 			if (reply.result == 0) {
 				current_capability |= cap;
 				return 0;
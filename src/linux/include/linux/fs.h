@@ -385,7 +385,7 @@ static inline int __fs_simple_request(unsigned int msg_id, int dev, int block,
 
 	msg.header.msg_id = msg_id;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = need_reply ? kernel_state->kernel_port : 0;
+	msg.header.reply_port = need_reply ? ipc_reply_port() : 0;
 	msg.header.size = sizeof(msg);
 
 	msg.dev = dev;
@@ -394,14 +394,14 @@ static inline int __fs_simple_request(unsigned int msg_id, int dev, int block,
 	msg.task_id = kernel_state->current_task;
 	msg.caps = current_capability;
 
-	result = mk_msg_send(kernel_state->file_server, &msg, sizeof(msg));
-	if (result < 0)
-		return -1;
-
-	if (!need_reply)
-		return 0;
+	if (!need_reply) {
+		result = mk_msg_send(kernel_state->file_server, &msg, sizeof(msg));
+		return (result < 0) ? -1 : 0;
+	}
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	/* Send and wait for the reply in a single trap */
+	result = mk_msg_call(kernel_state->file_server, &msg, sizeof(msg),
+	                     &reply, &reply_size);
 	if (result < 0)
 		return -1;
 
@@ -467,7 +467,7 @@ void wait_on(struct m_inode * inode)
 	
 	msg.header.msg_id = MSG_FS_WAIT_ON_INODE;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.inode = inode;
@@ -490,7 +490,7 @@ int bmap(struct m_inode * inode, int block)
 
 	msg.header.msg_id = MSG_FS_BMAP;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.inode = inode;
@@ -503,7 +503,7 @@ int bmap(struct m_inode * inode, int block)
 	if (result < 0)
 		return -1;
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0)
 		return -1;
 
@@ -522,7 +522,7 @@ int create_block(struct m_inode * inode, int block)
 
 	msg.header.msg_id = MSG_FS_CREATE_BLOCK;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.inode = inode;
@@ -535,7 +535,7 @@ int create_block(struct m_inode * inode, int block)
 	if (result < 0)
 		return -1;
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0)
 		return -1;
 
@@ -555,7 +555,7 @@ struct m_inode * namei(const char * pathname)
 
 	msg.header.msg_id = MSG_FS_NAMEI;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.pathname = pathname;
@@ -567,7 +567,7 @@ struct m_inode * namei(const char * pathname)
 	if (result < 0)
 		return NULL;
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0)
 		return NULL;
 
@@ -587,7 +587,7 @@ int open_namei(const char * pathname, int flag, int mode,
 
 	msg.header.msg_id = MSG_FS_OPEN_NAMEI;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.pathname = pathname;
@@ -601,7 +601,7 @@ int open_namei(const char * pathname, int flag, int mode,
 	if (result < 0)
 		return -1;
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0)
 		return -1;
 
@@ -641,7 +641,7 @@ struct m_inode * iget(int dev, int nr)
 
 	msg.header.msg_id = MSG_FS_IGET;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.dev = dev;
@@ -653,7 +653,7 @@ struct m_inode * iget(int dev, int nr)
 	if (result < 0)
 		return NULL;
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0)
 		return NULL;
 
@@ -674,7 +674,7 @@ struct m_inode * get_pipe_inode(void)
 
 	msg.header.msg_id = MSG_FS_GET_PIPE_INODE;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.task_id = kernel_state->current_task;
@@ -684,7 +684,7 @@ struct m_inode * get_pipe_inode(void)
 	if (result < 0)
 		return NULL;
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0)
 		return NULL;
 
@@ -706,7 +706,7 @@ struct buffer_head * getblk(int dev, int block)
 
 	msg.header.msg_id = MSG_FS_GETBLK;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.dev = dev;
@@ -718,7 +718,7 @@ struct buffer_head * getblk(int dev, int block)
 	if (result < 0)
 		return NULL;
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0)
 		return NULL;
 
@@ -794,7 +794,7 @@ struct buffer_head * breada(int dev, int block, ...)
 	
 	msg.header.msg_id = MSG_FS_BREADA;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.dev = dev;
@@ -810,7 +810,7 @@ struct buffer_head * breada(int dev, int block, ...)
 	if (result < 0)
 		return NULL;
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0)
 		return NULL;
 
@@ -836,7 +836,7 @@ struct m_inode * new_inode(int dev)
 
 	msg.header.msg_id = MSG_FS_NEW_INODE;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.dev = dev;
@@ -847,7 +847,7 @@ struct m_inode * new_inode(int dev)
 	if (result < 0)
 		return NULL;
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0)
 		return NULL;
 
@@ -885,7 +885,7 @@ struct super_block * get_super(int dev)
 
 	msg.header.msg_id = MSG_FS_GET_SUPER;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.dev = dev;
@@ -896,7 +896,7 @@ struct super_block * get_super(int dev)
 	if (result < 0)
 		return NULL;
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0)
 		return NULL;
 
@@ -920,14 +920,14 @@ static inline int request_fs_capability(unsigned int cap)
 
 	msg.header.msg_id = MSG_CAP_REQUEST_FS;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.task_id = kernel_state->current_task;
 	msg.requested_cap = cap;
 
 	if (mk_msg_send(kernel_state->file_server, &msg, sizeof(msg)) == 0) {
-		if (mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size) == 0) {
+		if (mk_msg_receive(ipc_reply_port(), &reply, &reply_size) == 0) {
 			if (reply.result == 0) {
 				current_capability |= cap;
 				return 0;
@@ -256,7 +256,7 @@ static inline int __hd_request(unsigned int msg_id, unsigned int drive,
 
 	msg.header.msg_id = msg_id;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = need_reply ? kernel_state->kernel_port : 0;
+	msg.header.reply_port = need_reply ? ipc_reply_port() : 0;
 	msg.header.size = sizeof(msg);
 
 	msg.drive = drive;
@@ -274,7 +274,7 @@ static inline int __hd_request(unsigned int msg_id, unsigned int drive,
 	if (!need_reply)
 		return 0;
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0)
 		return -1;
 
@@ -363,7 +363,7 @@ int hd_seek(unsigned int drive, unsigned int cylinder)
 
 	msg.header.msg_id = MSG_HD_SEEK;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.drive = drive;
@@ -377,7 +377,7 @@ int hd_seek(unsigned int drive, unsigned int cylinder)
 	if (result < 0)
 		return -1;
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0)
 		return -1;
 
@@ -458,7 +458,7 @@ int hd_diagnose(unsigned int drive)
 
 	msg.header.msg_id = MSG_HD_DIAGNOSE;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.drive = drive;
@@ -470,7 +470,7 @@ int hd_diagnose(unsigned int drive)
 	if (result < 0)
 		return -1;
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0)
 		return -1;
 
@@ -525,7 +525,7 @@ int hd_get_status(unsigned int drive, unsigned int *status, unsigned int *error)
 
 	msg.header.msg_id = MSG_HD_GET_STATUS;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.drive = drive;
@@ -536,7 +536,7 @@ int hd_get_status(unsigned int drive, unsigned int *status, unsigned int *error)
 	if (result < 0)
 		return -1;
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0)
 		return -1;
 
@@ -579,7 +579,7 @@ int hd_get_drive_info(unsigned int drive, struct hd_drive_info *info)
 
 	msg.header.msg_id = MSG_HD_GET_INFO;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.drive = drive;
@@ -590,7 +590,7 @@ int hd_get_drive_info(unsigned int drive, struct hd_drive_info *info)
 	if (result < 0)
 		return -1;
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0)
 		return -1;
 
@@ -626,7 +626,7 @@ int hd_get_partitions(unsigned int drive, struct partition *partitions)
 
 	msg.header.msg_id = MSG_HD_GET_PARTITIONS;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.drive = drive;
@@ -637,7 +637,7 @@ int hd_get_partitions(unsigned int drive, struct partition *partitions)
 	if (result < 0)
 		return -1;
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0)
 		return -1;
 
@@ -715,14 +715,14 @@ static inline int request_disk_capability(unsigned int cap)
 
 	msg.header.msg_id = MSG_CAP_REQUEST_DISK;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.task_id = kernel_state->current_task;
 	msg.requested_cap = cap;
 
 	if (mk_msg_send(kernel_state->device_server, &msg, sizeof(msg)) == 0) {
-		if (mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size) == 0) {
+		if (mk_msg_receive(ipc_reply_port(), &reply, &reply_size) == 0) {
 			if (reply.result == 0) {
 				current_capability |= cap;
 				return 0;
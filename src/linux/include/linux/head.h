@@ -176,9 +176,11 @@ struct mk_memory_object {
 	unsigned int shared;		/* Flag de compartilhamento */
 };
 
+/* A tabela cresce por páginas de portas; ver kernel/ipc.c */
 struct mk_port_table {
-	unsigned int count;
-	struct mk_port ports[256];
+	unsigned int count;		/* Portas em uso */
+	unsigned int size;		/* Índices com página alocada */
+	struct mk_port **chunks;	/* Diretório de páginas */
 };
 
 struct mk_task_table {
@@ -120,6 +120,17 @@ int printk(const char * fmt, ...);
 
 int tty_write(unsigned ch, char * buf, int count);
 
+void ipc_show_caches(void);
+
+/* Contadores e histogramas de todas as portas com tráfego */
+void ipc_show_port_stats(void);
+
+/* Porta de resposta privada da tarefa atual, alocada no primeiro uso */
+unsigned int ipc_reply_port(void);
+
+/* Liga bits de notificação numa porta; pode ser chamada em interrupção */
+int ipc_notify(unsigned int port, unsigned long bits);
+
 void * malloc(unsigned int size);
 void free_s(void * obj, int size);
 #define free(x) free_s((x), 0)
@@ -201,7 +212,7 @@ struct msg_panic {
 struct msg_tty_write {
 	struct mk_msg_header header;
 	unsigned int ch;		/* Canal */
-	char * buf;			/* Buffer */
+	char * buf;			/* NULL: os dados seguem a estrutura */
 	int count;			/* Tamanho */
 };
 
@@ -225,6 +236,256 @@ struct mk_kern_kernel_state {
 
 extern struct mk_kernel_state *kernel_state;
 
+#define MK_IPC_SEND		0x1000	/* Enviar mensagem */
+#define MK_IPC_RECEIVE		0x1001	/* Receber mensagem */
+#define MK_IPC_REPLY		0x1002	/* Responder requisição */
+#define MK_IPC_CALL		0x1003	/* Enviar e aguardar resposta */
+#define MK_IPC_REPLY_WAIT	0x1004	/* Responder e aguardar próxima requisição */
+#define MK_IPC_SEND_SHORT	0x1005	/* Enviar mensagem curta em registradores */
+#define MK_IPC_RECV_SHORT	0x1006	/* Receber mensagem curta em registradores */
+#define MK_IPC_SEND_OOL		0x1007	/* Enviar com páginas fora de linha */
+#define MK_IPC_SEND_BATCH	0x1008	/* Enviar várias mensagens de uma vez */
+#define MK_IPC_CHANNEL_OPEN	0x1009	/* Abrir canal de anéis para uma porta */
+#define MK_IPC_CHANNEL_KICK	0x100A	/* Acordar o consumidor de um anel */
+#define MK_IPC_RECEIVE_MATCH	0x100B	/* Receber a primeira mensagem que casa */
+#define MK_IPC_NOTIFY		0x100C	/* Ligar bits de notificação numa porta */
+#define MK_IPC_PORT_STATS	0x100D	/* Ler os contadores de uma porta */
+#define MK_IPC_SENDV		0x100E	/* Enviar juntando segmentos */
+#define MK_IPC_RECEIVEV		0x100F	/* Receber espalhando em segmentos */
+#define MK_SCHED_CONTROL	0x1010	/* Parâmetros de escalonamento */
+#define MK_WAIT			0x1011	/* Dormir num endereço se ele vale X */
+#define MK_WAKE			0x1012	/* Acordar quem dorme num endereço */
+#define MK_IPC_PORTSET_ALLOCATE	0x1013	/* Criar conjunto de portas */
+#define MK_IPC_PORTSET_MOVE	0x1014	/* Pôr uma porta num conjunto */
+#define MK_IPC_PORTSET_DEALLOCATE 0x1015	/* Destruir conjunto de portas */
+
+/*
+ * Mensagens curtas: cabeçalho + MK_SHORT_WORDS palavras, sem cópia de
+ * memória. O tag junta msg_id (16 bits) e porta de resposta (16 bits).
+ * O formato é o de uma resposta (msg_*_reply), e o receptor comum vê
+ * os mesmos bytes que veria com mk_msg_send.
+ */
+#define MK_SHORT_WORDS		3
+#define MK_SHORT_TAG(id, reply)	((((unsigned long)(reply)) << 16) | \
+				 ((id) & 0xFFFF))
+#define MK_TAG_MSG_ID(tag)	((tag) & 0xFFFF)
+#define MK_TAG_REPLY_PORT(tag)	(((tag) >> 16) & 0xFFFF)
+
+/*
+ * Payload fora de linha: a mensagem enviada com MK_IPC_SEND_OOL termina
+ * com um mk_msg_ool. Na entrega as páginas são movidas (MK_OOL_MOVE) ou
+ * compartilhadas copy-on-write (MK_OOL_SHARE) para a janela de recepção
+ * da porta (MK_PORT_OOL_WINDOW), e address passa a apontar para ela. A
+ * janela vale até a próxima recepção na porta. O remetente não deve
+ * alterar a região antes da entrega (use mk_msg_call).
+ */
+struct mk_msg_ool {
+	unsigned long address;		/* Início (alinhado a página) */
+	unsigned long size;		/* Tamanho em bytes */
+	unsigned int copy;		/* MK_OOL_MOVE ou MK_OOL_SHARE */
+};
+
+#define MK_OOL_MOVE		0	/* Páginas saem do remetente */
+#define MK_OOL_SHARE		1	/* Compartilhadas copy-on-write */
+#define MK_OOL_MAX_PAGES	16	/* Tamanho da janela de recepção */
+
+#define MK_PORT_OOL_WINDOW	4	/* Atributo: janela de recepção OOL */
+
+/*
+ * Envio em lote: cada descritor nomeia uma porta e uma mensagem (tamanho
+ * no cabeçalho). Todas entram nas filas numa única entrada no kernel.
+ */
+struct mk_msg_desc {
+	unsigned int port;		/* Porta de destino */
+	void *msg;			/* Mensagem */
+};
+
+#define MK_BATCH_MAX		64	/* Descritores por chamada */
+
+/*
+ * Envio e recepção por segmentos: a mensagem é a concatenação dos
+ * segmentos, copiados direto para o buffer da mensagem no kernel e, na
+ * recepção, espalhados direto nos buffers do receptor. Cabeçalho e
+ * payload podem ficar em lugares diferentes sem cópia intermediária. No
+ * envio o cabeçalho vai inteiro no primeiro segmento, e o kernel põe em
+ * header.size a soma dos segmentos.
+ */
+struct mk_iovec {
+	void *base;			/* Início do segmento */
+	unsigned long len;		/* Tamanho em bytes */
+};
+
+#define MK_IOV_MAX		16	/* Segmentos por chamada */
+
+/*
+ * Canais: dois anéis produtor único/consumidor único, cada um numa página
+ * compartilhada entre cliente e servidor. Cada entrada é uma mensagem
+ * inteira (tamanho no cabeçalho, arredondado para 4 bytes). O kernel só
+ * entra quando o consumidor dorme: ele marca sleeping antes de bloquear
+ * e o produtor, vendo a marca, chama mk_channel_kick, que entrega um
+ * MK_MSG_CHANNEL_KICK na porta do consumidor. Os anéis são endereços do
+ * kernel, portanto só servem a código que roda no kernel (printk, stubs
+ * de mm, servidores).
+ */
+#define MK_RING_BYTES		(4096 - 4 * sizeof(unsigned long))
+#define MK_RING_MAX_MSG		(MK_RING_BYTES / 2)
+#define MK_RING_PAD		0xFFFF	/* msg_id do preenchimento até o fim */
+
+#define MK_RING_REQ		0	/* Anel cliente -> servidor */
+#define MK_RING_REP		1	/* Anel servidor -> cliente */
+
+#define MK_MSG_CHANNEL_KICK	0x1FF0	/* Há mensagens no anel */
+
+/*
+ * Canal do kernel (printk, stubs de mm): qualquer tarefa pode dar kick e
+ * ele não é fechado quando a tarefa que o abriu termina. Os outros canais
+ * só aceitam kick do cliente e dos donos das portas, e são liberados
+ * quando o cliente termina.
+ */
+#define MK_CHANNEL_KERNEL	0x01
+
+struct mk_ring {
+	volatile unsigned long head;	/* Próxima leitura (só o consumidor escreve) */
+	volatile unsigned long tail;	/* Próxima escrita (só o produtor escreve) */
+	volatile unsigned long sleeping;	/* Consumidor dormindo: dar kick */
+	unsigned long kicks;		/* Notificações entregues */
+	char data[MK_RING_BYTES];
+};
+
+struct mk_channel {
+	unsigned int id;		/* Canal, para mk_channel_kick */
+	struct mk_ring *req;		/* Requisições do cliente */
+	struct mk_ring *rep;		/* Respostas do servidor */
+};
+
+/* Notificação entregue na porta do consumidor */
+struct mk_channel_kick {
+	struct mk_msg_header header;
+	unsigned int channel;		/* Canal */
+	struct mk_ring *ring;		/* Anel com mensagens */
+};
+
+/*
+ * Recepção seletiva: tira da fila a primeira mensagem que casa com o
+ * filtro e deixa as outras na ordem em que estavam. id_offset aponta
+ * uma palavra da mensagem (contando o cabeçalho), p.ex. o req_id de uma
+ * resposta; 0 não compara.
+ */
+struct mk_msg_filter {
+	unsigned int msg_id_min;	/* Menor msg_id aceito */
+	unsigned int msg_id_max;	/* Maior msg_id aceito */
+	unsigned int sender;		/* Porta de origem (0 = qualquer) */
+	unsigned int id_offset;		/* Posição do id da requisição */
+	unsigned long id;		/* Id esperado nessa posição */
+};
+
+/* Barreira completa: publica escritas antes de ler a marca do outro lado */
+#define mk_ring_mb()	__asm__ __volatile__("lock; addl $0,0(%%esp)" : : : "memory")
+#define mk_ring_wmb()	__asm__ __volatile__("" : : : "memory")
+
+/* Conjuntos de portas: nome passado a mk_msg_receive no lugar da porta */
+#define MK_PORT_SET_FLAG	0x8000
+#define MK_PORT_SET(id)		(MK_PORT_SET_FLAG | (id))
+
+/*
+ * Nomes de porta: índice na tabela nos bits 0-14 e geração nos bits
+ * 16-30. A geração muda quando a porta é liberada, então um nome guardado
+ * além disso deixa de valer em vez de cair na próxima dona. As portas
+ * reservadas têm geração 0, e um nome de geração 0 vale para a porta que
+ * estiver no índice (é o que cabe nos 16 bits de MK_SHORT_TAG).
+ */
+#define MK_PORT_INDEX(name)	((name) & 0x7FFF)
+
+/*
+ * Prioridade das mensagens: a fila de cada porta é ordenada por nível e
+ * o servidor herda o nível da requisição que atende. Sem nível explícito
+ * vale a prioridade de escalonamento do remetente.
+ */
+#define MK_PRIO_BULK		0	/* Log, escrita em lote */
+#define MK_PRIO_NORMAL		1	/* Padrão das tarefas */
+#define MK_PRIO_INTERACTIVE	2	/* Terminal, E/S interativa */
+#define MK_PRIO_URGENT		3	/* Faltas de página, escalonamento */
+#define MK_NR_PRIO		4
+
+#define MK_MSG_PRIO_SHIFT	4
+#define MK_MSG_PRIO_MASK	(7 << MK_MSG_PRIO_SHIFT)
+#define MK_MSG_PRIO(level)	(((level) + 1) << MK_MSG_PRIO_SHIFT)
+
+#define MK_PORT_PRIO		5	/* Atributo: nível das mensagens da porta */
+
+/*
+ * Cota por remetente: quantas mensagens cada tarefa pode ter na fila da
+ * porta (0 = sem cota). Quem chega à cota espera como se a fila
+ * estivesse cheia, e o resto da fila fica para os outros remetentes.
+ */
+#define MK_PORT_SHARE		6	/* Atributo: cota de fila por remetente */
+
+/*
+ * Notificações: bits acumulados na porta, sem mensagem alocada nem
+ * fila. Eventos repetidos antes da recepção se fundem num só. O receptor
+ * recebe os bits pendentes antes das mensagens da fila, como um
+ * mk_msg_notify montado pelo kernel, e eles voltam a zero. Bits 0-15 são
+ * as linhas de IRQ; os demais cada servidor define para a sua porta.
+ */
+#define MK_MSG_NOTIFY		0x1FF1	/* Bits de notificação pendentes */
+
+#define MK_NOTIFY_IRQ(irq)	(1UL << (irq))
+#define MK_NOTIFY_EVENT(n)	(1UL << (16 + (n)))
+
+struct mk_msg_notify {
+	struct mk_msg_header header;
+	unsigned int port;		/* Porta notificada */
+	unsigned long bits;		/* Bits acumulados */
+};
+
+/*
+ * Estatísticas por porta (CONFIG_IPC_STATS): contadores zerados quando a
+ * porta é alocada e histogramas log2 de latência em ciclos do TSC. O
+ * balde n conta latências entre 2^n e 2^(n+1) ciclos; o último junta
+ * tudo acima. A latência de fila vai do enfileiramento à retirada, a de
+ * resposta do envio de um mk_msg_call à chegada da resposta, e é contada
+ * na porta do servidor.
+ */
+#define MK_STATS_BUCKETS	24
+
+struct mk_port_stats {
+	unsigned long sends;		/* Mensagens entregues */
+	unsigned long receives;		/* Mensagens retiradas */
+	unsigned long blocks;		/* Esperas por espaço ou mensagem */
+	unsigned long eagains;		/* Esperas que deram -EAGAIN */
+	unsigned long bytes;		/* Bytes entregues */
+	unsigned int queue_high;	/* Maior fila vista */
+	unsigned int queue_count;	/* Fila no momento da leitura */
+	unsigned int max_messages;	/* Limite da fila */
+	unsigned long queue_lat[MK_STATS_BUCKETS];	/* Fila, log2 ciclos */
+	unsigned long reply_lat[MK_STATS_BUCKETS];	/* Resposta, log2 ciclos */
+};
+
+/*
+ * Escalonamento: a fila de prontos e a troca de contexto ficam no
+ * kernel; o servidor de processos só decide a política de cada tarefa
+ * com MK_SCHED_CONTROL (exige CAP_SCHED_ADMIN). A prioridade é o nível
+ * na fila (0-31, maior roda antes) e timeslice o quantum em ticks.
+ */
+#define MK_SCHED_NORMAL		0	/* Rodízio no nível, por quantum */
+#define MK_SCHED_FIFO		1	/* Roda até bloquear ou ceder */
+#define MK_SCHED_IDLE		2	/* Só no nível 0, quando nada mais roda */
+
+struct mk_sched_param {
+	unsigned int task;		/* Posição da tarefa em task[] */
+	unsigned int policy;		/* MK_SCHED_* */
+	long priority;			/* Nível na fila de prontos */
+	long timeslice;			/* Quantum em ticks */
+};
+
+/*
+ * Filas de espera por endereço, como futex: MK_WAIT dorme enquanto a
+ * palavra ainda tiver o valor esperado (senão -EAGAIN na hora) e
+ * MK_WAKE acorda até n tarefas dormindo nela, sem sair do kernel. A
+ * palavra deve estar alinhada em 4; o servidor a muda antes de acordar.
+ */
+#define MK_WAKE_ALL		0x7fffffff	/* n para acordar todas */
+
 static inline int mk_msg_send(unsigned int port, void *msg, unsigned int size)
 {
 	/* Chamada de sistema mínima - única entrada no kernel */
@@ -232,11 +493,392 @@ static inline int mk_msg_send(unsigned int port, void *msg, unsigned int size)
 	__asm__ __volatile__ (
 		"int $0x80"	/* Syscall para microkernel */
 		: "=a" (result)
-		: "0" (MK_IPC_SEND), "b" (port), "c" (msg), "d" (size)
+		: "0" (MK_IPC_SEND), "b" (port), "c" (msg), "d" (size), "S" (0)
+	);
+	return result;
+}
+
+static inline int mk_msg_send_prio(unsigned int port, void *msg,
+				   unsigned int size, unsigned int level)
+{
+	/* Como mk_msg_send, com o nível de prioridade dado explicitamente */
+	unsigned int result;
+	__asm__ __volatile__ (
+		"int $0x80"
+		: "=a" (result)
+		: "0" (MK_IPC_SEND), "b" (port), "c" (msg), "d" (size),
+		  "S" (MK_MSG_PRIO(level))
 	);
 	return result;
 }
 
+static inline int mk_msg_call(unsigned int port, void *msg, unsigned int size,
+			      void *reply, unsigned int *reply_size)
+{
+	/* Envio e recepção da resposta numa única entrada no kernel */
+	unsigned int result;
+	__asm__ __volatile__ (
+		"int $0x80"
+		: "=a" (result)
+		: "0" (MK_IPC_CALL), "b" (port), "c" (msg), "d" (size),
+		  "S" (reply), "D" (reply_size)
+	);
+	return result;
+}
+
+static inline int mk_msg_reply_wait(unsigned int reply_port, void *reply,
+				    unsigned int port, void *msg,
+				    unsigned int *size)
+{
+	/* Resposta ao cliente e espera da próxima requisição (servidores) */
+	unsigned int result;
+	__asm__ __volatile__ (
+		"int $0x80"
+		: "=a" (result)
+		: "0" (MK_IPC_REPLY_WAIT), "b" (reply_port), "c" (reply),
+		  "d" (port), "S" (msg), "D" (size)
+	);
+	return result;
+}
+
+static inline int mk_msg_send_short(unsigned int port, unsigned long tag,
+				    unsigned long w0, unsigned long w1,
+				    unsigned long w2)
+{
+	/* Mensagem inteira em registradores: ebx=porta, ecx=tag, edx/esi/edi */
+	unsigned int result;
+	__asm__ __volatile__ (
+		"int $0x80"
+		: "=a" (result)
+		: "0" (MK_IPC_SEND_SHORT), "b" (port), "c" (tag), "d" (w0),
+		  "S" (w1), "D" (w2)
+	);
+	return result;
+}
+
+static inline int mk_msg_recv_short(unsigned int port, unsigned long *tag,
+				    unsigned int *sender, unsigned long *w)
+{
+	/* Bloqueia até chegar mensagem; retorna -E2BIG se não couber */
+	unsigned int result;
+	unsigned long t, s, w0, w1, w2;
+	__asm__ __volatile__ (
+		"int $0x80"
+		: "=a" (result), "=b" (t), "=c" (s), "=d" (w0),
+		  "=S" (w1), "=D" (w2)
+		: "0" (MK_IPC_RECV_SHORT), "1" (port)
+	);
+	if ((int)result < 0)
+		return result;
+	*tag = t;
+	*sender = s;
+	w[0] = w0;
+	w[1] = w1;
+	w[2] = w2;
+	return result;
+}
+
+static inline int mk_msg_send_ool(unsigned int port, void *msg,
+				  unsigned int size)
+{
+	/* Como mk_msg_send; o mk_msg_ool no fim da mensagem vai por páginas */
+	unsigned int result;
+	__asm__ __volatile__ (
+		"int $0x80"
+		: "=a" (result)
+		: "0" (MK_IPC_SEND_OOL), "b" (port), "c" (msg), "d" (size)
+	);
+	return result;
+}
+
+static inline int mk_msg_sendv(unsigned int port, struct mk_iovec *iov,
+			       unsigned int count)
+{
+	/* Como mk_msg_send, com a mensagem em até MK_IOV_MAX pedaços */
+	unsigned int result;
+	__asm__ __volatile__ (
+		"int $0x80"
+		: "=a" (result)
+		: "0" (MK_IPC_SENDV), "b" (port), "c" (iov), "d" (count), "S" (0)
+	);
+	return result;
+}
+
+static inline int mk_msg_receivev(unsigned int port, struct mk_iovec *iov,
+				  unsigned int count)
+{
+	/* Retorna o tamanho da mensagem; -ENOSPC se não couber nos segmentos */
+	unsigned int result;
+	__asm__ __volatile__ (
+		"int $0x80"
+		: "=a" (result)
+		: "0" (MK_IPC_RECEIVEV), "b" (port), "c" (iov), "d" (count), "S" (0)
+	);
+	return result;
+}
+
+static inline int mk_sched_control(struct mk_sched_param *param)
+{
+	/* Vale na próxima decisão do escalonador, sem troca de contexto */
+	unsigned int result;
+	__asm__ __volatile__ (
+		"int $0x80"
+		: "=a" (result)
+		: "0" (MK_SCHED_CONTROL), "b" (param)
+	);
+	return result;
+}
+
+static inline int mk_wait(unsigned long *addr, unsigned long val, long timeout)
+{
+	/* 0 se acordado, -EAGAIN se *addr != val ou no timeout (ticks, 0 = sem) */
+	unsigned int result;
+	__asm__ __volatile__ (
+		"int $0x80"
+		: "=a" (result)
+		: "0" (MK_WAIT), "b" (addr), "c" (val), "d" (timeout)
+	);
+	return result;
+}
+
+static inline int mk_wake(unsigned long *addr, int nr)
+{
+	/* Retorna quantas tarefas foram acordadas */
+	unsigned int result;
+	__asm__ __volatile__ (
+		"int $0x80"
+		: "=a" (result)
+		: "0" (MK_WAKE), "b" (addr), "c" (nr)
+	);
+	return result;
+}
+
+static inline int mk_portset_allocate(void)
+{
+	/* Retorna o nome MK_PORT_SET(), usado em mk_msg_receive */
+	unsigned int result;
+	__asm__ __volatile__ (
+		"int $0x80"
+		: "=a" (result)
+		: "0" (MK_IPC_PORTSET_ALLOCATE)
+	);
+	return result;
+}
+
+static inline int mk_portset_move(unsigned int port, unsigned int set)
+{
+	/* set 0 devolve a porta ao conjunto padrão da dona */
+	unsigned int result;
+	__asm__ __volatile__ (
+		"int $0x80"
+		: "=a" (result)
+		: "0" (MK_IPC_PORTSET_MOVE), "b" (port), "c" (set)
+	);
+	return result;
+}
+
+static inline int mk_portset_deallocate(unsigned int set)
+{
+	/* As portas do conjunto voltam ao conjunto padrão da dona */
+	unsigned int result;
+	__asm__ __volatile__ (
+		"int $0x80"
+		: "=a" (result)
+		: "0" (MK_IPC_PORTSET_DEALLOCATE), "b" (set)
+	);
+	return result;
+}
+
+static inline int mk_msg_send_batch(struct mk_msg_desc *desc,
+				    unsigned int count)
+{
+	/* Retorna quantas mensagens foram enviadas, em ordem */
+	unsigned int result;
+	__asm__ __volatile__ (
+		"int $0x80"
+		: "=a" (result)
+		: "0" (MK_IPC_SEND_BATCH), "b" (desc), "c" (count), "d" (0)
+	);
+	return result;
+}
+
+static inline int mk_channel_open(unsigned int port, unsigned int reply_port,
+				  struct mk_channel *ch, unsigned int flags)
+{
+	/* Cria os anéis; reply_port recebe os kicks do anel de respostas */
+	unsigned int result;
+	__asm__ __volatile__ (
+		"int $0x80"
+		: "=a" (result)
+		: "0" (MK_IPC_CHANNEL_OPEN), "b" (port), "c" (reply_port),
+		  "d" (ch), "S" (flags)
+	);
+	return result;
+}
+
+static inline int mk_channel_kick(unsigned int id, unsigned int which)
+{
+	unsigned int result;
+	__asm__ __volatile__ (
+		"int $0x80"
+		: "=a" (result)
+		: "0" (MK_IPC_CHANNEL_KICK), "b" (id), "c" (which), "d" (0)
+	);
+	return result;
+}
+
+static inline int mk_msg_receive_match(unsigned int port, void *msg,
+				       unsigned int *size,
+				       struct mk_msg_filter *filter)
+{
+	/* Bloqueia até chegar uma mensagem que case com o filtro */
+	unsigned int result;
+	__asm__ __volatile__ (
+		"int $0x80"
+		: "=a" (result)
+		: "0" (MK_IPC_RECEIVE_MATCH), "b" (port), "c" (msg), "d" (size),
+		  "S" (filter), "D" (0)
+	);
+	return result;
+}
+
+static inline int mk_notify(unsigned int port, unsigned long bits)
+{
+	/* Nunca bloqueia: os bits se somam aos já pendentes */
+	unsigned int result;
+	__asm__ __volatile__ (
+		"int $0x80"
+		: "=a" (result)
+		: "0" (MK_IPC_NOTIFY), "b" (port), "c" (bits)
+	);
+	return result;
+}
+
+static inline int mk_port_stats(unsigned int port, struct mk_port_stats *stats)
+{
+	/* -ENOSYS se o kernel foi compilado sem CONFIG_IPC_STATS */
+	unsigned int result;
+	__asm__ __volatile__ (
+		"int $0x80"
+		: "=a" (result)
+		: "0" (MK_IPC_PORT_STATS), "b" (port), "c" (stats)
+	);
+	return result;
+}
+
+/* Cópia por palavras; kernel.h não depende de string.h */
+static inline void mk_ring_copy(void *to, const void *from, unsigned long n)
+{
+	unsigned long *t = (unsigned long *) to;
+	const unsigned long *f = (const unsigned long *) from;
+
+	for ( ; n >= sizeof(unsigned long); n -= sizeof(unsigned long))
+		*t++ = *f++;
+	while (n--)
+		((char *) t)[n] = ((const char *) f)[n];
+}
+
+/*
+ * mk_ring_put - Coloca uma mensagem no anel (lado produtor)
+ * Retorna 0, ou -1 se não houver espaço ou a mensagem for grande demais.
+ */
+static inline int mk_ring_put(struct mk_ring *ring, void *msg)
+{
+	struct mk_msg_header *h = (struct mk_msg_header *) msg;
+	unsigned long size = (h->size + 3) & ~3UL;
+	unsigned long head = ring->head, tail = ring->tail;
+	unsigned long used, pad = 0;
+
+	if (h->size < sizeof(*h) || size > MK_RING_MAX_MSG)
+		return -1;
+
+	/* A mensagem fica contígua; o resto até o fim vira preenchimento */
+	if (tail + size > MK_RING_BYTES)
+		pad = MK_RING_BYTES - tail;
+
+	/* Sempre sobra um espaço, para cheio não parecer vazio */
+	used = (tail + MK_RING_BYTES - head) % MK_RING_BYTES;
+	if (used + pad + size >= MK_RING_BYTES)
+		return -1;
+
+	if (pad) {
+		if (pad >= sizeof(*h)) {
+			((struct mk_msg_header *)(ring->data + tail))->msg_id = MK_RING_PAD;
+			((struct mk_msg_header *)(ring->data + tail))->size = pad;
+		}
+		tail = 0;
+	}
+
+	mk_ring_copy(ring->data + tail, msg, h->size);
+	mk_ring_wmb();
+	ring->tail = (tail + size) % MK_RING_BYTES;
+	return 0;
+}
+
+/*
+ * mk_ring_get - Tira a próxima mensagem do anel (lado consumidor)
+ * Retorna o tamanho, 0 se o anel estiver vazio, ou -1 se não couber.
+ */
+static inline int mk_ring_get(struct mk_ring *ring, void *buf, unsigned int max)
+{
+	struct mk_msg_header *h;
+	unsigned long head = ring->head;
+
+	if (head == ring->tail)
+		return 0;
+	mk_ring_wmb();
+
+	/* Pula o preenchimento do fim */
+	h = (struct mk_msg_header *)(ring->data + head);
+	if (MK_RING_BYTES - head < sizeof(*h) || h->msg_id == MK_RING_PAD) {
+		head = 0;
+		h = (struct mk_msg_header *) ring->data;
+	}
+
+	if (h->size > max) {
+		ring->head = head;
+		return -1;
+	}
+
+	mk_ring_copy(buf, h, h->size);
+	mk_ring_wmb();
+	ring->head = (head + ((h->size + 3) & ~3UL)) % MK_RING_BYTES;
+	return h->size;
+}
+
+/*
+ * mk_ring_sleep - Marca o consumidor como dormindo antes de bloquear
+ * Retorna 1 se o anel continua vazio, 0 se chegou mensagem (não dormir).
+ */
+static inline int mk_ring_sleep(struct mk_ring *ring)
+{
+	ring->sleeping = 1;
+	mk_ring_mb();
+	if (ring->head != ring->tail) {
+		ring->sleeping = 0;
+		return 0;
+	}
+	return 1;
+}
+
+/*
+ * mk_channel_send - Envia uma requisição pelo canal, sem syscall se o
+ * servidor estiver acordado. Retorna 0, ou -1 com o anel cheio (o
+ * chamador cai para mk_msg_send).
+ */
+static inline int mk_channel_send(struct mk_channel *ch, void *msg)
+{
+	int result = mk_ring_put(ch->req, msg);
+
+	if (result < 0)
+		return result;
+
+	mk_ring_mb();
+	if (ch->req->sleeping)
+		mk_channel_kick(ch->id, MK_RING_REQ);
+	return 0;
+}
+
 static inline void verify_area(void * addr, int count)
 {
 	struct msg_memory_verify msg;
@@ -322,17 +964,23 @@ static inline int printk(const char * fmt, ...)
 static inline int tty_write(unsigned ch, char * buf, int count)
 {
 	struct msg_tty_write msg;
+	struct mk_iovec iov[2];
 	
 	msg.header.msg_id = MSG_TTY_WRITE;
 	msg.header.sender_port = kernel_state->kernel_port;
 	msg.header.reply_port = 0;
-	msg.header.size = sizeof(msg);
 	
 	msg.ch = ch;
-	msg.buf = buf;
+	msg.buf = NULL;
 	msg.count = count;
 	
-	return mk_msg_send(kernel_state->tty_server, &msg, sizeof(msg));
+	/* Os bytes seguem a estrutura na mensagem, sem cópia no caminho */
+	iov[0].base = &msg;
+	iov[0].len = sizeof(msg);
+	iov[1].base = buf;
+	iov[1].len = count;
+	
+	return mk_msg_sendv(kernel_state->tty_server, iov, 2);
 }
 
 static inline void * malloc(unsigned int size)
@@ -341,7 +989,7 @@ static inline void * malloc(unsigned int size)
 	
 	msg.header.msg_id = MSG_MEM_ALLOC;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;	/* Aguarda resposta */
+	msg.header.reply_port = ipc_reply_port();	/* Aguarda resposta */
 	msg.header.size = sizeof(msg);
 	
 	msg.size = size;
@@ -166,6 +166,8 @@ Traditional functions become IPC clients that send messages to this server.
 extern unsigned long get_free_page(void);
 extern unsigned long put_page(unsigned long page, unsigned long address);
 extern void free_page(unsigned long addr);
+extern int remap_pages(unsigned long from, unsigned long to,
+		       unsigned long size, unsigned int copy);
 
 
 typedef unsigned int		memory_object_t;	/* Objeto de memória */
@@ -195,6 +197,7 @@ typedef unsigned int		vm_attribute_t;		/* Atributos de memória */
 #define MSG_MEM_PROTECT		0x0107	/* Proteger região */
 #define MSG_MEM_INHERIT		0x0108	/* Definir herança */
 #define MSG_MEM_COPY		0x0109	/* Copiar região (copy-on-write) */
+#define MSG_MEM_REMAP		0x010A	/* Mover/compartilhar páginas (IPC) */
 
 
 struct msg_get_free_page {
@@ -217,6 +220,17 @@ struct msg_free_page {
 	unsigned int task_id;		/* Task dona */
 };
 
+/* Endereços lineares; copy = MEM_COPY_NONE (mover) ou MEM_COPY_ON_WRITE */
+struct msg_mem_remap {
+	struct mk_msg_header header;
+	unsigned long from;		/* Origem (linear, alinhada a página) */
+	unsigned long to;		/* Destino (linear, alinhado a página) */
+	unsigned long size;		/* Tamanho em bytes */
+	unsigned int copy;		/* Estratégia de cópia */
+	unsigned int task_id;		/* Task solicitante */
+	capability_t caps;		/* Capacidades do solicitante */
+};
+
 struct msg_memory_reply {
 	struct mk_msg_header header;
 	int result;			/* Código de resultado */
@@ -306,6 +320,8 @@ struct memory_server_state {
 /* Declaração da função de envio IPC (definida em kernel.h) */
 extern int mk_msg_send(unsigned int port, void *msg, unsigned int size);
 extern int mk_msg_receive(unsigned int port, void *msg, unsigned int *size);
+extern int mk_msg_call(unsigned int port, void *msg, unsigned int size,
+		       void *reply, unsigned int *reply_size);
 
 /* Estado do kernel (definido em kernel.h) */
 extern struct mk_kernel_state *kernel_state;
@@ -320,7 +336,7 @@ static inline unsigned long get_free_page(void)
 	/* Preparar mensagem */
 	msg.header.msg_id = MSG_MEM_GET_FREE_PAGE;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.task_id = kernel_state->current_task;
@@ -332,7 +348,7 @@ static inline unsigned long get_free_page(void)
 		return 0;
 	
 	/* Aguardar resposta */
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0 || reply.result < 0)
 		return 0;
 	
@@ -349,7 +365,7 @@ static inline unsigned long put_page(unsigned long page, unsigned long address)
 	/* Preparar mensagem */
 	msg.header.msg_id = MSG_MEM_PUT_PAGE;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.page = page;
@@ -363,7 +379,7 @@ static inline unsigned long put_page(unsigned long page, unsigned long address)
 		return 0;
 	
 	/* Aguardar resposta */
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0 || reply.result < 0)
 		return 0;
 	
@@ -47,6 +47,9 @@
 #define FIRST_TASK task[0]
 #define LAST_TASK task[NR_TASKS-1]
 
+/* Run queue levels; a task's level is its priority, higher runs first */
+#define SCHED_NR_PRIO	32
+
 #if (NR_OPEN > 32)
 #error "Currently the close-on-exec-flags are in one word, max 32 files/proc"
 #endif
@@ -58,6 +61,10 @@
 #define TASK_ZOMBIE		3
 #define TASK_STOPPED		4
 
+/* schedule_to(): which way a synchronous IPC hand-off goes */
+#define SCHED_TO_CALL		0	/* Caller to server, lends its slice */
+#define SCHED_TO_REPLY		1	/* Server to caller, returns the loan */
+
 /* Microkernel task state extensions */
 #define TASK_SUSPENDED		5	/* Suspended waiting for IPC */
 #define TASK_WAITING_IPC	6	/* Waiting for IPC reply */
@@ -82,6 +89,31 @@ struct i387_struct {
 	long	st_space[20];	/* 8*10 bytes for each FP-reg = 80 bytes */
 };
 
+/*
+ * i387_fxsave - FXSAVE image (P6/SSE and later), 512 bytes, 16-aligned
+ */
+struct i387_fxsave {
+	unsigned short	cwd;
+	unsigned short	swd;
+	unsigned short	twd;	/* Abridged tag word */
+	unsigned short	fop;
+	long	fip;
+	long	fcs;
+	long	foo;
+	long	fos;
+	long	mxcsr;
+	long	mxcsr_mask;
+	long	st_space[32];	/* 8 FP-regs in 16 bytes each = 128 bytes */
+	long	xmm_space[32];	/* 8 XMM-regs in 16 bytes each = 128 bytes */
+	long	padding[56];
+};
+
+/* Save area of a task; which image is used depends on the CPU */
+union i387_union {
+	struct i387_struct fsave;
+	struct i387_fxsave fxsave;
+};
+
 /*
  * tss_struct - Task State Segment
  * 
@@ -114,7 +146,6 @@ struct tss_struct {
 	long	gs;		/* 16 high bits zero */
 	long	ldt;		/* 16 high bits zero */
 	long	trace_bitmap;	/* bits: trace 0, bitmap 16-31 */
-	struct i387_struct i387;
 };
 
 /*
@@ -159,17 +190,34 @@ struct task_struct {
  *============================================================================*/
 	/* Capability fields */
 	capability_t caps;		/* Task capabilities */
-	unsigned int port_space;	/* IPC port space */
+	unsigned int port_space;	/* IPC port space (task slot) */
 	unsigned int mem_space;	/* Memory capability space */
 	unsigned int server_id;		/* Server this task belongs to */
 	
 	/* IPC fields */
-	unsigned int reply_port;	/* Port for pending reply */
+	unsigned int reply_port;	/* Private reply port, 0 until first use */
 	unsigned int wait_port;		/* Port task is waiting on */
 	unsigned long ipc_timeout;	/* IPC timeout */
+	long ipc_base_priority;		/* Own priority while inheriting, or 0 */
+	
+	/* Scheduling, set by the process server through MK_SCHED_CONTROL */
+	unsigned int sched_nr;		/* Slot in task[], selects the TSS */
+	unsigned int policy;		/* MK_SCHED_NORMAL, _FIFO or _IDLE */
+	long timeslice;			/* Ticks per turn, refills counter */
+	struct task_struct *run_next;	/* Next on its run queue level */
+	struct task_struct *run_prev;	/* Previous on it */
+	int run_level;			/* Level queued at, -1 if not queued */
+	struct task_struct *donor;	/* Caller that lent us its timeslice */
+	long donated;			/* Ticks of it left, spent before counter */
+	unsigned long child_events;	/* Bumped when a child exits, waitpid key */
 	
 	/* Debug fields */
 	unsigned int debug_flags;	/* Debug flags */
+	
+	/* FPU state while someone else owns the unit, used_math says if valid.
+	 * Kept off the task page, where it would come out of the kernel stack;
+	 * NULL until the task first touches the FPU. */
+	union i387_union *i387;
 };
 
 /*
@@ -196,8 +244,7 @@ struct task_struct {
 /*tss*/	{0,PAGE_SIZE+(long)&init_task,0x10,0,0,0,0,(long)&pg_dir,\
 	 0,0,0,0,0,0,0,0, \
 	 0,0,0x17,0x17,0x17,0x17,0x17,0x17, \
-	 _LDT(0),0x80000000, \
-		{} \
+	 _LDT(0),0x80000000 \
 	}, \
 /* microkernel extensions */ \
 	CAP_ALL,		/* Kernel has all capabilities */ \
@@ -207,7 +254,18 @@ struct task_struct {
 	0,			/* reply_port */ \
 	0,			/* wait_port */ \
 	0,			/* ipc_timeout */ \
-	0			/* debug_flags */ \
+	0,			/* ipc_base_priority */ \
+	0,			/* sched_nr */ \
+	0,			/* policy */ \
+	15,			/* timeslice */ \
+	NULL,			/* run_next */ \
+	NULL,			/* run_prev */ \
+	-1,			/* run_level */ \
+	NULL,			/* donor */ \
+	0,			/* donated */ \
+	0,			/* child_events */ \
+	0,			/* debug_flags */ \
+	NULL			/* i387 */ \
 }
 
 /*=============================================================================
@@ -237,6 +295,10 @@ extern long startup_time;
 #define MSG_SCHED_SET_PRIO	0x1608	/* Set task priority */
 #define MSG_SCHED_YIELD		0x1609	/* Yield CPU */
 #define MSG_SCHED_REPLY		0x160A	/* Reply from scheduler */
+#define MSG_SCHED_ALARM		0x1700	/* Set alarm (time server) */
+
+/* Notification to the process server: CPU times in task[] have moved on */
+#define SCHED_NOTIFY_ACCT	MK_NOTIFY_EVENT(0)
 
 /*=============================================================================
  * IPC MESSAGE STRUCTURES
@@ -269,6 +331,33 @@ struct msg_sched_reply {
 	capability_t granted_caps;	/* New capabilities granted */
 };
 
+/*=============================================================================
+ * KERNEL TIMERS
+ *============================================================================*/
+
+/**
+ * timer_list - One-shot kernel timer
+ * 
+ * Owned by the caller and linked into the timing wheel in kernel/sched.c
+ * while pending; pprev is NULL otherwise. The function runs from the
+ * timer interrupt once jiffies reaches expires.
+ */
+struct timer_list {
+	struct timer_list *next;	/* Next timer in the same slot */
+	struct timer_list **pprev;	/* Link pointing at this timer */
+	unsigned long expires;		/* Absolute expiry in jiffies */
+	void (*function)(unsigned long);	/* Expiry handler */
+	unsigned long data;		/* Argument to function */
+};
+
+#define timer_pending(timer)	((timer)->pprev != NULL)
+
+extern void init_timer(struct timer_list *timer,
+                       void (*function)(unsigned long), unsigned long data);
+extern void mod_timer(struct timer_list *timer, unsigned long expires);
+extern int del_timer(struct timer_list *timer);
+extern long set_alarm(unsigned int nr, long seconds);
+
 /*=============================================================================
  * CAPABILITY FLAGS
  *============================================================================*/
@@ -286,7 +375,19 @@ extern int free_page_tables(unsigned long from, unsigned long size);
 
 extern void sched_init(void);
 extern void schedule(void);
+extern void schedule_to(struct task_struct *p, int how);
+extern void sched_return_loan(struct task_struct *p);
+extern void sched_fork(struct task_struct *p, int nr);
+extern void sched_set_priority(struct task_struct *p, long priority);
+extern void wake_up_process(struct task_struct *p);
+extern void signal_wake_up(struct task_struct *p);
+extern int need_resched;
 extern void trap_init(void);
+extern void math_state_restore(void);
+extern void math_save(struct task_struct *p);
+extern int math_fork(struct task_struct *p);
+extern void math_release(struct task_struct *p);
+extern int has_tsc;
 #ifndef PANIC
 void panic(const char * str);
 #endif
@@ -295,9 +396,13 @@ extern int tty_write(unsigned minor,char * buf,int count);
 typedef int (*fn_ptr)();
 
 extern void add_timer(long jiffies, void (*fn)(void));
+extern void ipc_release_task(struct task_struct *p);
+extern void ipc_space_init(struct task_struct *p, int nr);
 extern void sleep_on(struct task_struct ** p);
 extern void interruptible_sleep_on(struct task_struct ** p);
 extern void wake_up(struct task_struct ** p);
+extern int sleep_on_key(unsigned long key, int state);
+extern int wake_up_key(unsigned long key, int nr);
 
 /*=============================================================================
  * TASK MANAGEMENT FUNCTIONS
@@ -325,110 +430,6 @@ static inline void sched_init(void)
 	mk_msg_send(kernel_state->process_server, &msg, sizeof(msg));
 }
 
-/**
- * schedule - Run scheduler
- * 
- * Yields CPU and lets process server choose next task.
- */
-static inline void schedule(void)
-{
-	struct msg_sched_task msg;
-	struct msg_sched_reply reply;
-	unsigned int reply_size = sizeof(reply);
-
-	msg.header.msg_id = MSG_SCHED_SCHEDULE;
-	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
-	msg.header.size = sizeof(msg);
-	msg.task_id = kernel_state->current_task;
-	msg.caps = current_capability;
-
-	if (mk_msg_send(kernel_state->process_server, &msg, sizeof(msg)) == 0) {
-		mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
-	}
-}
-
-/**
- * add_timer - Add a kernel timer
- * @jiffies: Number of jiffies to wait
- * @fn: Function to call
- * 
- * Sends timer request to process server.
- */
-static inline void add_timer(long jiffies, void (*fn)(void))
-{
-	struct msg_sched_timer msg;
-	
-	msg.header.msg_id = MSG_SCHED_ADD_TIMER;
-	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = 0;
-	msg.header.size = sizeof(msg);
-	msg.jiffies = jiffies;
-	msg.fn = fn;
-	msg.task_id = kernel_state->current_task;
-	msg.caps = current_capability;
-
-	mk_msg_send(kernel_state->process_server, &msg, sizeof(msg));
-}
-
-/**
- * sleep_on - Sleep on a wait queue
- * @p: Wait queue head
- */
-static inline void sleep_on(struct task_struct ** p)
-{
-	struct msg_sched_task msg;
-	
-	msg.header.msg_id = MSG_SCHED_SLEEP_ON;
-	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
-	msg.header.size = sizeof(msg);
-	msg.p = p;
-	msg.task_id = kernel_state->current_task;
-	msg.caps = current_capability;
-
-	mk_msg_send(kernel_state->process_server, &msg, sizeof(msg));
-	/* Will block until woken */
-}
-
-/**
- * interruptible_sleep_on - Interruptible sleep on wait queue
- * @p: Wait queue head
- */
-static inline void interruptible_sleep_on(struct task_struct ** p)
-{
-	struct msg_sched_task msg;
-	
-	msg.header.msg_id = MSG_SCHED_INTR_SLEEP;
-	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
-	msg.header.size = sizeof(msg);
-	msg.p = p;
-	msg.task_id = kernel_state->current_task;
-	msg.caps = current_capability;
-
-	mk_msg_send(kernel_state->process_server, &msg, sizeof(msg));
-}
-
-/**
- * wake_up - Wake up tasks on wait queue
- * @p: Wait queue head
- */
-static inline void wake_up(struct task_struct ** p)
-{
-	struct msg_sched_task msg;
-	
-	msg.header.msg_id = MSG_SCHED_WAKE_UP;
-	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = 0;
-	msg.header.size = sizeof(msg);
-	msg.p = p;
-	msg.task_id = kernel_state->current_task;
-	msg.caps = current_capability;
-
-	mk_msg_send(kernel_state->process_server, &msg, sizeof(msg));
-}
-
 /*=============================================================================
  * CONTEXT SWITCHING MACROS (Now using IPC)
  *============================================================================*/
@@ -476,12 +477,12 @@ do { \
 	unsigned int reply_size = sizeof(reply); \
 	msg.header.msg_id = MSG_SCHED_STR; \
 	msg.header.sender_port = kernel_state->kernel_port; \
-	msg.header.reply_port = kernel_state->kernel_port; \
+	msg.header.reply_port = ipc_reply_port(); \
 	msg.header.size = sizeof(msg); \
 	msg.task_id = 0; \
 	msg.caps = current_capability; \
 	if (mk_msg_send(kernel_state->process_server, &msg, sizeof(msg)) == 0) { \
-		if (mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size) == 0) { \
+		if (mk_msg_receive(ipc_reply_port(), &reply, &reply_size) == 0) { \
 			(n) = reply.data.value; \
 		} \
 	} \
@@ -491,35 +492,24 @@ do { \
  * switch_to - Switch to another task
  * @n: Task number to switch to
  * 
- * Sends IPC to process server to perform context switch.
- * The process server saves current task state and loads new task.
+ * A jump through the task's TSS, as in the original kernel. Policy lives
+ * in the process server, but the switch itself never waits on it.
+ * Clears TS if the task switched to owns the math unit.
  */
-#define switch_to(n) \
-do { \
-	struct msg_sched_task msg; \
-	struct msg_sched_reply reply; \
-	unsigned int reply_size = sizeof(reply); \
-	\
-	/* Don't switch to current task */ \
-	if ((n) == kernel_state->current_task) \
-		break; \
-	\
-	msg.header.msg_id = MSG_SCHED_SWITCH_TO; \
-	msg.header.sender_port = kernel_state->kernel_port; \
-	msg.header.reply_port = kernel_state->kernel_port; \
-	msg.header.size = sizeof(msg); \
-	msg.task_id = (n); \
-	msg.task_id2 = kernel_state->current_task; \
-	msg.caps = current_capability; \
-	\
-	if (mk_msg_send(kernel_state->process_server, &msg, sizeof(msg)) == 0) { \
-		mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size); \
-		/* Update current task pointer */ \
-		if (reply.result == 0) { \
-			current = task[n]; \
-		} \
-	} \
-} while (0)
+#define switch_to(n) {\
+struct {long a,b;} __tmp; \
+__asm__("cmpl %%ecx,current\n\t" \
+	"je 1f\n\t" \
+	"movw %%dx,%1\n\t" \
+	"xchgl %%ecx,current\n\t" \
+	"ljmp *%0\n\t" \
+	"cmpl %%ecx,last_task_used_math\n\t" \
+	"jne 1f\n\t" \
+	"clts\n" \
+	"1:" \
+	::"m" (*&__tmp.a),"m" (*&__tmp.b), \
+	"d" (_TSS(n)),"c" ((long) task[n])); \
+}
 
 /*=============================================================================
  * MEMORY MANAGEMENT FUNCTIONS
@@ -539,7 +529,7 @@ static inline int copy_page_tables(unsigned long from, unsigned long to, long si
 	
 	msg.header.msg_id = MSG_MEM_COPY_TABLES;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	msg.from = from;
 	msg.to = to;
@@ -550,7 +540,7 @@ static inline int copy_page_tables(unsigned long from, unsigned long to, long si
 	if (mk_msg_send(kernel_state->memory_server, &msg, sizeof(msg)) < 0)
 		return -1;
 
-	if (mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size) < 0)
+	if (mk_msg_receive(ipc_reply_port(), &reply, &reply_size) < 0)
 		return -1;
 
 	return reply.result;
@@ -567,7 +557,7 @@ static inline int free_page_tables(unsigned long from, unsigned long size)
 	
 	msg.header.msg_id = MSG_MEM_FREE_TABLES;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	msg.from = from;
 	msg.size = size;
@@ -577,7 +567,7 @@ static inline int free_page_tables(unsigned long from, unsigned long size)
 	if (mk_msg_send(kernel_state->memory_server, &msg, sizeof(msg)) < 0)
 		return -1;
 
-	if (mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size) < 0)
+	if (mk_msg_receive(ipc_reply_port(), &reply, &reply_size) < 0)
 		return -1;
 
 	return reply.result;
@@ -628,7 +618,7 @@ static inline unsigned long _get_base(char * addr)
 	
 	msg.header.msg_id = MSG_GET_BASE;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	msg.addr = (unsigned long)addr;
 	msg.task_id = kernel_state->current_task;
@@ -637,7 +627,7 @@ static inline unsigned long _get_base(char * addr)
 	if (mk_msg_send(kernel_state->memory_server, &msg, sizeof(msg)) < 0)
 		return 0;
 
-	if (mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size) < 0)
+	if (mk_msg_receive(ipc_reply_port(), &reply, &reply_size) < 0)
 		return 0;
 
 	return reply.data.value;
@@ -651,13 +641,13 @@ static inline unsigned long _get_base(char * addr)
 	unsigned int reply_size = sizeof(reply); \
 	msg.header.msg_id = MSG_GET_LIMIT; \
 	msg.header.sender_port = kernel_state->kernel_port; \
-	msg.header.reply_port = kernel_state->kernel_port; \
+	msg.header.reply_port = ipc_reply_port(); \
 	msg.header.size = sizeof(msg); \
 	msg.addr = (segment); \
 	msg.task_id = kernel_state->current_task; \
 	msg.caps = current_capability; \
 	if (mk_msg_send(kernel_state->memory_server, &msg, sizeof(msg)) == 0) { \
-		if (mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size) == 0) { \
+		if (mk_msg_receive(ipc_reply_port(), &reply, &reply_size) == 0) { \
 			reply.data.value; \
 		} else 0; \
 	} else 0; \
@@ -675,14 +665,14 @@ static inline int request_sched_capability(unsigned int cap)
 
 	msg.header.msg_id = MSG_CAP_REQUEST_SCHED;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.task_id = kernel_state->current_task;
 	msg.requested_cap = cap;
 
 	if (mk_msg_send(kernel_state->process_server, &msg, sizeof(msg)) == 0) {
-		if (mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size) == 0) {
+		if (mk_msg_receive(ipc_reply_port(), &reply, &reply_size) == 0) {
 			if (reply.result == 0) {
 				current_capability |= cap;
 				return 0;
@@ -701,6 +701,8 @@ fn_ptr sys_call_table[__NR_syscalls] = {
 /* Função de envio IPC (implementada em assembly) */
 extern int mk_msg_send(unsigned int port, void *msg, unsigned int size);
 extern int mk_msg_receive(unsigned int port, void *msg, unsigned int *size);
+extern int mk_msg_call(unsigned int port, void *msg, unsigned int size,
+		       void *reply, unsigned int *reply_size);
 
 
 
@@ -743,14 +745,14 @@ static inline int do_syscall(unsigned int nr, unsigned long a1,
 		case 0:
 			msg.msg0.header.syscall_nr = nr;
 			msg.msg0.header.sender_task = kernel_state->current_task;
-			msg.msg0.header.reply_port = kernel_state->kernel_port;
+			msg.msg0.header.reply_port = ipc_reply_port();
 			msg.msg0.header.server_id = syscall_to_server[nr];
 			result = mk_msg_send(server_port, &msg.msg0, sizeof(msg.msg0));
 			break;
 		case 1:
 			msg.msg1.header.syscall_nr = nr;
 			msg.msg1.header.sender_task = kernel_state->current_task;
-			msg.msg1.header.reply_port = kernel_state->kernel_port;
+			msg.msg1.header.reply_port = ipc_reply_port();
 			msg.msg1.header.server_id = syscall_to_server[nr];
 			msg.msg1.arg1 = a1;
 			result = mk_msg_send(server_port, &msg.msg1, sizeof(msg.msg1));
@@ -758,7 +760,7 @@ static inline int do_syscall(unsigned int nr, unsigned long a1,
 		case 2:
 			msg.msg2.header.syscall_nr = nr;
 			msg.msg2.header.sender_task = kernel_state->current_task;
-			msg.msg2.header.reply_port = kernel_state->kernel_port;
+			msg.msg2.header.reply_port = ipc_reply_port();
 			msg.msg2.header.server_id = syscall_to_server[nr];
 			msg.msg2.arg1 = a1;
 			msg.msg2.arg2 = a2;
@@ -767,7 +769,7 @@ static inline int do_syscall(unsigned int nr, unsigned long a1,
 		case 3:
 			msg.msg3.header.syscall_nr = nr;
 			msg.msg3.header.sender_task = kernel_state->current_task;
-			msg.msg3.header.reply_port = kernel_state->kernel_port;
+			msg.msg3.header.reply_port = ipc_reply_port();
 			msg.msg3.header.server_id = syscall_to_server[nr];
 			msg.msg3.arg1 = a1;
 			msg.msg3.arg2 = a2;
@@ -782,7 +784,7 @@ static inline int do_syscall(unsigned int nr, unsigned long a1,
 		return result;
 	
 	/* Aguardar resposta (para chamadas síncronas) */
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0)
 		return result;
 	
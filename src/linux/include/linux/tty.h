@@ -244,7 +244,7 @@ static inline int __tty_request(unsigned int msg_id, unsigned int channel,
 
 	msg.header.msg_id = msg_id;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = need_reply ? kernel_state->kernel_port : 0;
+	msg.header.reply_port = need_reply ? ipc_reply_port() : 0;
 	msg.header.size = sizeof(msg);
 
 	msg.channel = channel;
@@ -260,7 +260,7 @@ static inline int __tty_request(unsigned int msg_id, unsigned int channel,
 	if (!need_reply)
 		return 0;
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0)
 		return -1;
 
@@ -482,14 +482,14 @@ static inline int request_tty_capability(unsigned int cap)
 
 	msg.header.msg_id = MSG_CAP_REQUEST_TTY;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.task_id = kernel_state->current_task;
 	msg.requested_cap = cap;
 
 	if (mk_msg_send(kernel_state->tty_server, &msg, sizeof(msg)) == 0) {
-		if (mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size) == 0) {
+		if (mk_msg_receive(ipc_reply_port(), &reply, &reply_size) == 0) {
 			if (reply.result == 0) {
 				current_capability |= cap;
 				return 0;
@@ -242,7 +242,7 @@ static inline int __do_signal_action(int sig, struct sigaction *act,
 	/* Prepare message */
 	msg.header.msg_id = MSG_SIGNAL_ACTION;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.sig = sig;
@@ -259,7 +259,7 @@ static inline int __do_signal_action(int sig, struct sigaction *act,
 	}
 
 	/* Wait for reply */
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0) {
 		return -1;
 	}
@@ -329,7 +329,7 @@ int kill(pid_t pid, int sig)
 
 	msg.header.msg_id = MSG_SIGNAL_KILL;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.pid = pid;
@@ -342,7 +342,7 @@ int kill(pid_t pid, int sig)
 		return -1;
 	}
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0) {
 		return -1;
 	}
@@ -374,7 +374,7 @@ int sigprocmask(int how, sigset_t *set, sigset_t *oldset)
 
 	msg.header.msg_id = MSG_SIGNAL_PROCMASK;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.how = how;
@@ -387,7 +387,7 @@ int sigprocmask(int how, sigset_t *set, sigset_t *oldset)
 		return -1;
 	}
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0) {
 		return -1;
 	}
@@ -415,7 +415,7 @@ int sigpending(sigset_t *set)
 
 	msg.header.msg_id = MSG_SIGNAL_PENDING;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.set = set;
@@ -427,7 +427,7 @@ int sigpending(sigset_t *set)
 		return -1;
 	}
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0) {
 		return -1;
 	}
@@ -451,7 +451,7 @@ int sigsuspend(sigset_t *sigmask)
 
 	msg.header.msg_id = MSG_SIGNAL_SUSPEND;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.sigmask = sigmask;
@@ -464,7 +464,7 @@ int sigsuspend(sigset_t *sigmask)
 	}
 
 	/* This will only return after signal delivery */
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	
 	return -1;  /* Should not reach here normally */
 }
@@ -567,14 +567,14 @@ static inline int request_signal_capability(unsigned int caps)
 
 	msg.header.msg_id = MSG_CAP_REQUEST_SIGNAL;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.task_id = kernel_state->current_task;
 	msg.requested_cap = caps;
 
 	if (mk_msg_send(kernel_state->signal_server, &msg, sizeof(msg)) == 0) {
-		if (mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size) == 0) {
+		if (mk_msg_receive(ipc_reply_port(), &reply, &reply_size) == 0) {
 			if (reply.result == 0) {
 				current_capability |= caps;
 				return 0;
@@ -257,7 +257,7 @@ static inline int va_build_ipc_message(struct ipc_msg_template *template,
 	/* Fill header */
 	header->msg_id = template->msg_id;
 	header->sender_port = kernel_state->kernel_port;
-	header->reply_port = kernel_state->kernel_port;
+	header->reply_port = ipc_reply_port();
 	header->size = sizeof(struct mk_msg_header) + 
 	               template->arg_count * sizeof(ipc_arg_t);
 	
@@ -368,7 +368,7 @@ extern inline void * memcpy(void * dest, const void * src, int n)
 	
 	msg.header.msg_id = MSG_MEM_STRING_COPY;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.dest = (unsigned long)dest;
@@ -381,7 +381,7 @@ extern inline void * memcpy(void * dest, const void * src, int n)
 	if (mk_msg_send(kernel_state->memory_server, &msg, sizeof(msg)) < 0)
 		return NULL;
 	
-	if (mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size) < 0)
+	if (mk_msg_receive(ipc_reply_port(), &reply, &reply_size) < 0)
 		return NULL;
 	
 	if (reply.result < 0)
@@ -451,7 +451,7 @@ extern inline void * memmove(void * dest, const void * src, int n)
 	
 	msg.header.msg_id = MSG_MEM_STRING_MOVE;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.dest = d;
@@ -464,7 +464,7 @@ extern inline void * memmove(void * dest, const void * src, int n)
 	if (mk_msg_send(kernel_state->memory_server, &msg, sizeof(msg)) < 0)
 		return NULL;
 	
-	if (mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size) < 0)
+	if (mk_msg_receive(ipc_reply_port(), &reply, &reply_size) < 0)
 		return NULL;
 	
 	if (reply.result < 0)
@@ -509,7 +509,7 @@ extern inline void * memchr(const void * cs, char c, int count)
 	
 	msg.header.msg_id = MSG_MEM_STRING_CHR;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.dest = 0;  /* Not used for chr */
@@ -522,7 +522,7 @@ extern inline void * memchr(const void * cs, char c, int count)
 	if (mk_msg_send(kernel_state->memory_server, &msg, sizeof(msg)) < 0)
 		return NULL;
 	
-	if (mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size) < 0)
+	if (mk_msg_receive(ipc_reply_port(), &reply, &reply_size) < 0)
 		return NULL;
 	
 	if (reply.result < 0)
@@ -711,14 +711,14 @@ static inline int request_mem_string_capability(void)
 
 	msg.header.msg_id = MSG_CAP_REQUEST_MEM_STRING;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.task_id = kernel_state->current_task;
 	msg.requested_cap = CAP_MEM_STRING;
 
 	if (mk_msg_send(kernel_state->memory_server, &msg, sizeof(msg)) == 0) {
-		if (mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size) == 0) {
+		if (mk_msg_receive(ipc_reply_port(), &reply, &reply_size) == 0) {
 			if (reply.result == 0) {
 				current_capability |= CAP_MEM_STRING;
 				return 0;
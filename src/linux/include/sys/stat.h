@@ -254,7 +254,7 @@ static inline int __do_stat(const char *path, struct stat *stat_buf, int is_fsta
 		/* fstat message */
 		fmsg.header.msg_id = MSG_FSTAT;
 		fmsg.header.sender_port = kernel_state->kernel_port;
-		fmsg.header.reply_port = kernel_state->kernel_port;
+		fmsg.header.reply_port = ipc_reply_port();
 		fmsg.header.size = sizeof(fmsg);
 		
 		fmsg.fd = fd;
@@ -268,7 +268,7 @@ static inline int __do_stat(const char *path, struct stat *stat_buf, int is_fsta
 		/* stat message */
 		msg.header.msg_id = MSG_STAT;
 		msg.header.sender_port = kernel_state->kernel_port;
-		msg.header.reply_port = kernel_state->kernel_port;
+		msg.header.reply_port = ipc_reply_port();
 		msg.header.size = sizeof(msg);
 		
 		msg.path = (char *)path;
@@ -288,7 +288,7 @@ static inline int __do_stat(const char *path, struct stat *stat_buf, int is_fsta
 	}
 
 	/* Wait for reply */
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0) {
 		return -1;
 	}
@@ -340,7 +340,7 @@ int chmod(const char *_path, mode_t mode)
 
 	msg.header.msg_id = MSG_CHMOD;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.path = (char *)_path;
@@ -353,7 +353,7 @@ int chmod(const char *_path, mode_t mode)
 		return -1;
 	}
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0) {
 		return -1;
 	}
@@ -378,7 +378,7 @@ int mkdir(const char *_path, mode_t mode)
 
 	msg.header.msg_id = MSG_MKDIR;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.path = (char *)_path;
@@ -391,7 +391,7 @@ int mkdir(const char *_path, mode_t mode)
 		return -1;
 	}
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0) {
 		return -1;
 	}
@@ -416,7 +416,7 @@ int mkfifo(const char *_path, mode_t mode)
 
 	msg.header.msg_id = MSG_MKFIFO;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.path = (char *)_path;
@@ -429,7 +429,7 @@ int mkfifo(const char *_path, mode_t mode)
 		return -1;
 	}
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0) {
 		return -1;
 	}
@@ -454,7 +454,7 @@ mode_t umask(mode_t mask)
 
 	msg.header.msg_id = MSG_UMASK;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.mask = mask;
@@ -466,7 +466,7 @@ mode_t umask(mode_t mask)
 		return current_umask;  /* Fallback to local */
 	}
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0) {
 		return current_umask;
 	}
@@ -485,14 +485,14 @@ static inline int request_file_capability(void)
 
 	msg.header.msg_id = MSG_CAP_REQUEST_FILE;  /* Would need definition */
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.task_id = kernel_state->current_task;
 	msg.requested_cap = CAP_FILE;
 
 	if (mk_msg_send(kernel_state->file_server, &msg, sizeof(msg)) == 0) {
-		if (mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size) == 0) {
+		if (mk_msg_receive(ipc_reply_port(), &reply, &reply_size) == 0) {
 			if (reply.result == 0) {
 				current_capability |= CAP_FILE;
 				return 0;
@@ -121,7 +121,7 @@ static inline time_t __times(struct tms *tp, pid_t pid, unsigned int flags)
 	/* Prepare times request message */
 	msg.header.msg_id = MSG_TIMES;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.pid = (pid == 0) ? kernel_state->current_task : pid;
@@ -136,7 +136,7 @@ static inline time_t __times(struct tms *tp, pid_t pid, unsigned int flags)
 	}
 	
 	/* Wait for reply */
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0) {
 		return -1;
 	}
@@ -246,7 +246,7 @@ static inline long sysconf(int name)
 	/* Quick query just for ticks per second */
 	msg.header.msg_id = MSG_TIMES;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.pid = kernel_state->current_task;
@@ -257,7 +257,7 @@ static inline long sysconf(int name)
 	if (mk_msg_send(kernel_state->process_server, &msg, sizeof(msg)) < 0)
 		return -1;
 	
-	if (mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size) < 0)
+	if (mk_msg_receive(ipc_reply_port(), &reply, &reply_size) < 0)
 		return -1;
 	
 	return reply.ticks_per_sec;
@@ -304,7 +304,7 @@ static inline int getrusage(int who, struct rusage *rusage)
 	/* Would need new message types for extended info */
 	msg.header.msg_id = MSG_GETRUSAGE;  /* Would need definition */
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.who = who;
@@ -314,7 +314,7 @@ static inline int getrusage(int who, struct rusage *rusage)
 	if (mk_msg_send(kernel_state->process_server, &msg, sizeof(msg)) < 0)
 		return -1;
 	
-	if (mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size) < 0)
+	if (mk_msg_receive(ipc_reply_port(), &reply, &reply_size) < 0)
 		return -1;
 	
 	memcpy(rusage, &reply.rusage, sizeof(struct rusage));
@@ -105,7 +105,7 @@ static inline int __uname(struct utsname *utsbuf, unsigned int flags)
 	/* Prepare uname request message */
 	msg.header.msg_id = MSG_UNAME;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.task_id = kernel_state->current_task;
@@ -119,7 +119,7 @@ static inline int __uname(struct utsname *utsbuf, unsigned int flags)
 	}
 	
 	/* Wait for reply */
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0) {
 		return -1;
 	}
@@ -231,7 +231,7 @@ static inline int sethostname(const char *name, size_t len)
 	/* Prepare message (would need new message type) */
 	msg.header.msg_id = MSG_SET_HOSTNAME;  /* Would need definition */
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.task_id = kernel_state->current_task;
@@ -243,7 +243,7 @@ static inline int sethostname(const char *name, size_t len)
 		return -1;
 	}
 	
-	if (mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size) < 0) {
+	if (mk_msg_receive(ipc_reply_port(), &reply, &reply_size) < 0) {
 		return -1;
 	}
 	
@@ -295,7 +295,7 @@ static inline int sysinfo(struct sysinfo *info)
 	
 	msg.header.msg_id = MSG_SYSINFO;  /* Would need definition */
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.task_id = kernel_state->current_task;
@@ -305,7 +305,7 @@ static inline int sysinfo(struct sysinfo *info)
 		return -1;
 	}
 	
-	if (mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size) < 0) {
+	if (mk_msg_receive(ipc_reply_port(), &reply, &reply_size) < 0) {
 		return -1;
 	}
 	
@@ -136,7 +136,7 @@ static inline pid_t __do_wait(pid_t pid, int *stat_loc, int options)
 	/* Prepare wait message */
 	msg.header.msg_id = (pid == -1 || pid == 0) ? MSG_WAIT : MSG_WAITPID;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.pid = pid;
@@ -150,7 +150,7 @@ static inline pid_t __do_wait(pid_t pid, int *stat_loc, int options)
 		return -1;
 	
 	/* Wait for reply (unless WNOHANG and no child available) */
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0)
 		return -1;
 	
@@ -225,14 +225,14 @@ static inline int request_process_capability(void)
 	
 	msg.header.msg_id = MSG_CAP_REQUEST_PROCESS;  /* Would need definition */
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.task_id = kernel_state->current_task;
 	msg.requested_cap = CAP_PROCESS;
 	
 	if (mk_msg_send(kernel_state->process_server, &msg, sizeof(msg)) == 0) {
-		if (mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size) == 0) {
+		if (mk_msg_receive(ipc_reply_port(), &reply, &reply_size) == 0) {
 			if (reply.result == 0) {
 				current_capability |= CAP_PROCESS;
 				return 0;
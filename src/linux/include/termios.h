@@ -387,7 +387,7 @@ static inline int __tty_request(int fildes, int request, void *arg, int msg_id)
 
 	msg.header.msg_id = msg_id;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.fildes = fildes;
@@ -400,7 +400,7 @@ static inline int __tty_request(int fildes, int request, void *arg, int msg_id)
 	if (result < 0)
 		return -1;
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0)
 		return -1;
 
@@ -459,7 +459,7 @@ int tcsetattr(int fildes, int optional_actions, struct termios *termios_p)
 
 	msg.header.msg_id = MSG_TTY_TCSETS + optional_actions;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.fildes = fildes;
@@ -472,7 +472,7 @@ int tcsetattr(int fildes, int optional_actions, struct termios *termios_p)
 	if (result < 0)
 		return -1;
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0)
 		return -1;
 
@@ -532,7 +532,7 @@ int tcflow(int fildes, int action)
 
 	msg.header.msg_id = MSG_TTY_TCXONC;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.fildes = fildes;
@@ -544,7 +544,7 @@ int tcflow(int fildes, int action)
 	if (result < 0)
 		return -1;
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	return result;
 }
 
@@ -560,7 +560,7 @@ int tcflush(int fildes, int queue_selector)
 
 	msg.header.msg_id = MSG_TTY_TCFLSH;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.fildes = fildes;
@@ -572,7 +572,7 @@ int tcflush(int fildes, int queue_selector)
 	if (result < 0)
 		return -1;
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	return result;
 }
 
@@ -588,7 +588,7 @@ int tcsendbreak(int fildes, int duration)
 
 	msg.header.msg_id = MSG_TTY_TCSBRK;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.fildes = fildes;
@@ -600,7 +600,7 @@ int tcsendbreak(int fildes, int duration)
 	if (result < 0)
 		return -1;
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	return result;
 }
 
@@ -744,14 +744,14 @@ static inline int request_tty_capability(void)
 
 	msg.header.msg_id = MSG_CAP_REQUEST_TTY;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.task_id = kernel_state->current_task;
 	msg.requested_cap = CAP_TTY;
 
 	if (mk_msg_send(kernel_state->tty_server, &msg, sizeof(msg)) == 0) {
-		if (mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size) == 0) {
+		if (mk_msg_receive(ipc_reply_port(), &reply, &reply_size) == 0) {
 			if (reply.result == 0) {
 				current_capability |= CAP_TTY;
 				return 0;
@@ -116,7 +116,7 @@ static inline int __do_utime(const char *filename, struct utimbuf *times,
 	/* Prepare utime message */
 	msg.header.msg_id = MSG_UTIME;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.filename = (char *)filename;
@@ -132,7 +132,7 @@ static inline int __do_utime(const char *filename, struct utimbuf *times,
 	}
 
 	/* Wait for reply */
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0) {
 		return -1;
 	}
@@ -361,14 +361,14 @@ static inline int request_file_capability(void)
 
 	msg.header.msg_id = MSG_CAP_REQUEST_FILE;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.task_id = kernel_state->current_task;
 	msg.requested_cap = CAP_FILE;
 
 	if (mk_msg_send(kernel_state->file_server, &msg, sizeof(msg)) == 0) {
-		if (mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size) == 0) {
+		if (mk_msg_receive(ipc_reply_port(), &reply, &reply_size) == 0) {
 			if (reply.result == 0) {
 				current_capability |= CAP_FILE;
 				return 0;
@@ -106,6 +106,9 @@ extern long startup_time;
 /* Server stack size (4KB per server) */
 #define SERVER_STACK_SIZE	4096
 
+/* Requests one client may have queued on a server (a quarter of the queue) */
+#define SERVER_SHARE		16
+
 /*=============================================================================
  * ORIGINAL CMOS/RTC FUNCTIONS (Preserved)
  *============================================================================*/
@@ -168,12 +171,14 @@ capability_t current_capability = CAP_ALL;
  * @server_main: Server main function
  * @name: Server name (for debugging)
  * @port: Server's IPC port
+ * @prio: MK_PRIO_* level of requests to the server
  * @stack_size: Stack size for server
  * 
  * Returns PID of server process, or negative error code.
  */
 static int start_server(void (*server_main)(void), const char *name,
-                         unsigned int port, unsigned int stack_size)
+                         unsigned int port, unsigned int prio,
+                         unsigned int stack_size)
 {
 	int pid;
 	
@@ -197,6 +202,8 @@ static int start_server(void (*server_main)(void), const char *name,
 			printk("failed to allocate port %d\n", port);
 			_exit(1);
 		}
+		sys_ipc_port_set(port, MK_PORT_PRIO, prio);
+		sys_ipc_port_set(port, MK_PORT_SHARE, SERVER_SHARE);
 		
 		printk("OK (PID %d, port %d)\n", getpid(), port);
 		
@@ -278,17 +285,26 @@ void main(void)
 	printk("Starting microkernel servers...\n");
 	
 	/* Start core servers in order of dependency */
-	start_server(memory_server_main, "Memory server", PORT_MEMORY, SERVER_STACK_SIZE);
-	start_server(process_server_main, "Process server", PORT_PROCESS, SERVER_STACK_SIZE);
-	start_server(device_server_main, "Device server", PORT_DEVICE, SERVER_STACK_SIZE);
-	start_server(time_server_main, "Time server", PORT_TIME, SERVER_STACK_SIZE);
+	start_server(memory_server_main, "Memory server", PORT_MEMORY,
+	             MK_PRIO_URGENT, SERVER_STACK_SIZE);
+	start_server(process_server_main, "Process server", PORT_PROCESS,
+	             MK_PRIO_URGENT, SERVER_STACK_SIZE);
+	start_server(device_server_main, "Device server", PORT_DEVICE,
+	             MK_PRIO_INTERACTIVE, SERVER_STACK_SIZE);
+	start_server(time_server_main, "Time server", PORT_TIME,
+	             MK_PRIO_NORMAL, SERVER_STACK_SIZE);
 	
 	/* Servers that depend on core servers */
-	start_server(file_server_main, "File server", PORT_FILE, SERVER_STACK_SIZE);
-	start_server(signal_server_main, "Signal server", PORT_SIGNAL, SERVER_STACK_SIZE);
-	start_server(console_server_main, "Console server", PORT_CONSOLE, SERVER_STACK_SIZE);
-	start_server(log_server_main, "Log server", PORT_LOG, SERVER_STACK_SIZE);
-	start_server(system_server_main, "System server", PORT_SYSTEM, SERVER_STACK_SIZE);
+	start_server(file_server_main, "File server", PORT_FILE,
+	             MK_PRIO_NORMAL, SERVER_STACK_SIZE);
+	start_server(signal_server_main, "Signal server", PORT_SIGNAL,
+	             MK_PRIO_NORMAL, SERVER_STACK_SIZE);
+	start_server(console_server_main, "Console server", PORT_CONSOLE,
+	             MK_PRIO_INTERACTIVE, SERVER_STACK_SIZE);
+	start_server(log_server_main, "Log server", PORT_LOG,
+	             MK_PRIO_BULK, SERVER_STACK_SIZE);
+	start_server(system_server_main, "System server", PORT_SYSTEM,
+	             MK_PRIO_NORMAL, SERVER_STACK_SIZE);
 	
 	/* Establish connections between servers */
 	establish_server_connections();
@@ -63,6 +63,7 @@ MSG_TRAP_COPROC_ERROR	= 0x1910
 .globl double_fault, coprocessor_segment_overrun
 .globl invalid_TSS, segment_not_present, stack_segment
 .globl general_protection, coprocessor_error, irq13, reserved
+.globl simd_coprocessor_error
 
 /*=============================================================================
  * TEXT SECTION
@@ -357,6 +358,19 @@ coprocessor_error:
 	SEND_EXCEPTION_IPC MSG_TRAP_COPROC_ERROR
 2:	ORIGINAL_NO_ERROR_CODE do_coprocessor_error
 
+/*=============================================================================
+ * SIMD FLOATING-POINT EXCEPTION (#XM, vector 19)
+ *============================================================================*/
+
+/*
+ * Raised for unmasked SSE exceptions once math_init() has set
+ * CR4.OSXMMEXCPT. The C handler tells the process server itself and
+ * always signals the task, so it is entered directly.
+ */
+.align 2
+simd_coprocessor_error:
+	ORIGINAL_NO_ERROR_CODE do_simd_coprocessor_error
+
 /*=============================================================================
  * IRQ13 HANDLER (Coprocessor interrupt)
  *============================================================================*/
@@ -28,6 +28,7 @@
 #ifndef _BLK_H
 #define _BLK_H
 
+#include <stddef.h>
 #include <linux/kernel.h>
 #include <linux/sched.h>
 #include <linux/head.h>
@@ -191,12 +192,33 @@ static struct pending_request {
 	unsigned long req_id;
 	struct request *req;
 	struct task_struct *waiting;
-	unsigned long timeout;
+	struct timer_list timer;	/* Request timeout */
 	struct pending_request *next;
 } *pending_requests = NULL;
 
 static unsigned long next_req_id = 1;
 
+/**
+ * request_timeout - Drop a request the device server never answered
+ * @data: The pending request
+ * 
+ * Runs from the timer interrupt.
+ */
+static void request_timeout(unsigned long data)
+{
+	struct pending_request *p, **pp;
+	
+	for (pp = &pending_requests; (p = *pp) != NULL; pp = &p->next) {
+		if (p == (struct pending_request *) data) {
+			*pp = p->next;
+			if (p->waiting)
+				wake_up(&p->waiting);
+			kfree(p);
+			return;
+		}
+	}
+}
+
 /**
  * add_pending_request - Track request sent to device server
  * @req: Original request structure
@@ -220,11 +242,13 @@ static unsigned long add_pending_request(struct request *req)
 	p->req_id = req_id;
 	p->req = req;
 	p->waiting = current;
-	p->timeout = jiffies + 30*HZ;  /* 30 second timeout */
 	p->next = pending_requests;
 	
 	pending_requests = p;
 	
+	init_timer(&p->timer, request_timeout, (unsigned long) p);
+	mod_timer(&p->timer, jiffies + 30*HZ);  /* 30 second timeout */
+	
 	sti();
 	return req_id;
 }
@@ -246,6 +270,7 @@ static struct pending_request *find_pending_request(unsigned long req_id)
 				prev->next = p->next;
 			else
 				pending_requests = p->next;
+			del_timer(&p->timer);
 			return p;
 		}
 	}
@@ -253,34 +278,6 @@ static struct pending_request *find_pending_request(unsigned long req_id)
 	return NULL;
 }
 
-/**
- * check_request_timeouts - Check for timed-out requests
- */
-static void check_request_timeouts(void)
-{
-	struct pending_request *p, *prev = NULL, *next;
-	unsigned long now = jiffies;
-	
-	for (p = pending_requests; p; p = next) {
-		next = p->next;
-		
-		if (p->timeout < now) {
-			/* Request timed out */
-			if (p->waiting)
-				wake_up(&p->waiting);
-			
-			if (prev)
-				prev->next = next;
-			else
-				pending_requests = next;
-			
-			kfree(p);
-		} else {
-			prev = p;
-		}
-	}
-}
-
 /*=============================================================================
  * BLOCK DEVICE OPERATIONS (IPC Stubs)
  *============================================================================*/
@@ -301,6 +298,7 @@ static int blk_request(int dev, int cmd, unsigned long sector,
 	struct msg_blk_request msg;
 	struct msg_blk_reply reply;
 	unsigned int reply_size = sizeof(reply);
+	struct mk_msg_filter filter;
 	unsigned long req_id;
 	struct pending_request *p;
 	int result;
@@ -319,7 +317,7 @@ static int blk_request(int dev, int cmd, unsigned long sector,
 	/* Prepare IPC message */
 	msg.header.msg_id = (cmd == READ) ? MSG_BLK_READ : MSG_BLK_WRITE;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.dev = dev;
@@ -341,8 +339,14 @@ static int blk_request(int dev, int cmd, unsigned long sector,
 		return -EAGAIN;
 	}
 
-	/* Wait for reply */
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	/* Wait for the reply to this request; others stay queued */
+	filter.msg_id_min = 0;
+	filter.msg_id_max = ~0U;
+	filter.sender = 0;
+	filter.id_offset = offsetof(struct msg_blk_reply, req_id);
+	filter.id = req_id;
+	result = mk_msg_receive_match(ipc_reply_port(), &reply, &reply_size,
+	                              &filter);
 	if (result < 0) {
 		/* Receive failed */
 		cli();
@@ -351,8 +355,10 @@ static int blk_request(int dev, int cmd, unsigned long sector,
 		return -EIO;
 	}
 
-	/* Find pending request */
+	/* Find pending request; the timeout may have dropped it meanwhile */
+	cli();
 	p = find_pending_request(reply.req_id);
+	sti();
 	if (!p)
 		return -EINVAL;
 
@@ -484,9 +490,6 @@ void DEVICE_INTR(void)
 	msg.caps = current_capability;
 	
 	mk_msg_send(kernel_state->device_server, &msg, sizeof(msg));
-	
-	/* Check for timed out requests */
-	check_request_timeouts();
 }
 
 #endif /* DEVICE_INTR */
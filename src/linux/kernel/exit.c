@@ -34,6 +34,7 @@
 #include <linux/tty.h>
 #include <linux/head.h>
 #include <asm/segment.h>
+#include <asm/system.h>
 
 /*=============================================================================
  * MICROKERNEL IPC MESSAGE CODES
@@ -149,16 +150,16 @@ static inline int exit_request(unsigned int msg_id, void *msg_data,
 	if (!(current_capability & CAP_EXIT_PROCESS))
 		return -EPERM;
 
-	result = mk_msg_send(kernel_state->process_server, msg_data, msg_size);
-	if (result < 0)
-		return -EAGAIN;
-
-	if (!need_reply)
-		return 0;
+	if (!need_reply) {
+		result = mk_msg_send(kernel_state->process_server, msg_data, msg_size);
+		return (result < 0) ? -EAGAIN : 0;
+	}
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	/* Send and wait for the reply in a single trap */
+	result = mk_msg_call(kernel_state->process_server, msg_data, msg_size,
+	                     &reply, &reply_size);
 	if (result < 0)
-		return -EAGAIN;
+		return -EIPCNOREPLY;	/* Not -EAGAIN, which waitpid sleeps on */
 
 	if (reply_data)
 		*reply_data = reply;
@@ -197,6 +198,9 @@ void release(struct task_struct * p)
 
 	exit_request(MSG_EXIT_RELEASE, &msg, sizeof(msg), 0, NULL);
 
+	ipc_release_task(p);
+	math_release(p);
+
 	/* Free local task structure */
 	for (i = 1; i < NR_TASKS; i++) {
 		if (task[i] == p) {
@@ -225,7 +229,7 @@ static inline int send_sig(long sig, struct task_struct * p, int priv)
 	/* Prepare IPC message */
 	msg.header.msg_id = MSG_EXIT_SEND_SIG;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.sig = sig;
@@ -237,9 +241,10 @@ static inline int send_sig(long sig, struct task_struct * p, int priv)
 	result = exit_request(MSG_EXIT_SEND_SIG, &msg, sizeof(msg), 1, &reply);
 	if (result < 0) {
 		/* Fallback to local implementation */
-		if (priv || (current->euid == p->euid) || suser())
+		if (priv || (current->euid == p->euid) || suser()) {
 			p->signal |= (1 << (sig - 1));
-		else
+			signal_wake_up(p);
+		} else
 			return -EPERM;
 		return 0;
 	}
@@ -284,7 +289,7 @@ int sys_kill(int pid, int sig)
 	/* Prepare IPC message */
 	msg.header.msg_id = MSG_EXIT_KILL;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.pid = pid;
@@ -360,7 +365,7 @@ int do_exit(long code)
 	/* Prepare IPC message */
 	msg.header.msg_id = MSG_EXIT_DO_EXIT;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.code = code;
@@ -429,15 +434,20 @@ int sys_waitpid(pid_t pid, unsigned long * stat_addr, int options)
 {
 	struct msg_exit_waitpid msg;
 	struct msg_exit_reply reply;
+	unsigned long events;
 	int result;
 
 	/* Verify user area */
 	verify_area(stat_addr, 4);
 
+again:
+	/* A child exiting after this read makes the sleep below return */
+	events = current->child_events;
+
 	/* Prepare IPC message */
 	msg.header.msg_id = MSG_EXIT_WAITPID;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.pid = pid;
@@ -447,6 +457,20 @@ int sys_waitpid(pid_t pid, unsigned long * stat_addr, int options)
 	msg.caps = current_capability;
 
 	result = exit_request(MSG_EXIT_WAITPID, &msg, sizeof(msg), 1, &reply);
+	if (result == -EAGAIN) {
+		/* Children but no zombie yet: the server wakes us on an exit */
+		if (options & WNOHANG)
+			return 0;
+		cli();
+		if (current->child_events == events &&
+		    sleep_on_key((unsigned long) &current->child_events,
+		                 TASK_INTERRUPTIBLE) < 0) {
+			sti();
+			return -EINTR;
+		}
+		sti();
+		goto again;
+	}
 	if (result < 0) {
 		/* Fallback to local implementation */
 		int flag, code;
@@ -136,14 +136,14 @@ static inline int fork_request(unsigned int msg_id, void *msg_data,
 	if (!(current_capability & CAP_FORK_PROCESS))
 		return -EPERM;
 
-	result = mk_msg_send(kernel_state->process_server, msg_data, msg_size);
-	if (result < 0)
-		return -EAGAIN;
-
-	if (!need_reply)
-		return 0;
+	if (!need_reply) {
+		result = mk_msg_send(kernel_state->process_server, msg_data, msg_size);
+		return (result < 0) ? -EAGAIN : 0;
+	}
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	/* Send and wait for the reply in a single trap */
+	result = mk_msg_call(kernel_state->process_server, msg_data, msg_size,
+	                     &reply, &reply_size);
 	if (result < 0)
 		return -EAGAIN;
 
@@ -184,7 +184,7 @@ void verify_area(void * addr, int size)
 
 	msg.header.msg_id = MSG_FORK_VERIFY_AREA;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.addr = addr;
@@ -247,7 +247,7 @@ int copy_mem(int nr, struct task_struct * p)
 	/* Send request to memory server */
 	msg.header.msg_id = MSG_FORK_COPY_MEM;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.nr = nr;
@@ -312,7 +312,7 @@ int copy_process(int nr, long ebp, long edi, long esi, long gs, long none,
 	/* Prepare message for process server */
 	msg.header.msg_id = MSG_FORK_COPY_PROCESS;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.nr = nr;
@@ -342,9 +342,11 @@ int copy_process(int nr, long ebp, long edi, long esi, long gs, long none,
 		p->state = TASK_UNINTERRUPTIBLE;
 		p->pid = last_pid;
 		p->father = current->pid;
-		p->counter = p->priority;
+		sched_fork(p, nr);
 		p->signal = 0;
 		p->alarm = 0;
+		p->reply_port = 0;
+		ipc_space_init(p, nr);
 		p->leader = 0;
 		p->utime = p->stime = 0;
 		p->cutime = p->cstime = 0;
@@ -372,10 +374,14 @@ int copy_process(int nr, long ebp, long edi, long esi, long gs, long none,
 		p->tss.ldt = _LDT(nr);
 		p->tss.trace_bitmap = 0x80000000;
 		
-		if (last_task_used_math == current)
-			__asm__("clts ; fnsave %0" : : "m" (p->tss.i387));
+		if (math_fork(p)) {
+			task[nr] = NULL;
+			free_page((long) p);
+			return -EAGAIN;
+		}
 		
 		if (copy_mem(nr, p)) {
+			math_release(p);
 			task[nr] = NULL;
 			free_page((long) p);
 			return -EAGAIN;
@@ -395,15 +401,23 @@ int copy_process(int nr, long ebp, long edi, long esi, long gs, long none,
 		set_tss_desc(gdt + (nr << 1) + FIRST_TSS_ENTRY, &(p->tss));
 		set_ldt_desc(gdt + (nr << 1) + FIRST_LDT_ENTRY, &(p->ldt));
 		
-		p->state = TASK_RUNNING;
+		wake_up_process(p);
 		return last_pid;
 	}
 
 	/* Copy file pointers locally */
 	*p = *current;  /* Copy basic task struct */
+	if (math_fork(p)) {	/* Its own FPU save area, not current's */
+		task[nr] = NULL;
+		free_page((long) p);
+		return -EAGAIN;
+	}
 	p->pid = reply.data.pid;
 	p->father = current->pid;
-	p->state = TASK_RUNNING;
+	p->state = TASK_UNINTERRUPTIBLE;
+	p->reply_port = 0;	/* Allocated on the child's first request */
+	ipc_space_init(p, nr);	/* Rights are derived again, not inherited */
+	sched_fork(p, nr);	/* Not queued until it is complete */
 
 	/* Update file reference counts */
 	for (i = 0; i < NR_OPEN; i++)
@@ -422,6 +436,7 @@ int copy_process(int nr, long ebp, long edi, long esi, long gs, long none,
 	set_tss_desc(gdt + (nr << 1) + FIRST_TSS_ENTRY, &(p->tss));
 	set_ldt_desc(gdt + (nr << 1) + FIRST_LDT_ENTRY, &(p->ldt));
 
+	wake_up_process(p);
 	return reply.data.pid;
 }
 
@@ -451,7 +466,7 @@ int find_empty_process(void)
 			/* Verify with process server */
 			msg.header.msg_id = MSG_FORK_FIND_EMPTY;
 			msg.header.sender_port = kernel_state->kernel_port;
-			msg.header.reply_port = kernel_state->kernel_port;
+			msg.header.reply_port = ipc_reply_port();
 			msg.header.size = sizeof(msg);
 			
 			msg.task_id = kernel_state->current_task;
@@ -472,7 +487,7 @@ int find_empty_process(void)
 	/* No local slot found, ask server */
 	msg.header.msg_id = MSG_FORK_FIND_EMPTY;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.task_id = kernel_state->current_task;
@@ -27,6 +27,7 @@
 #include <linux/sched.h>
 #include "blk_drv/blk.h"
 #include <linux/head.h>
+#include <linux/mm.h>
 #include <asm/system.h>
 #include <asm/segment.h>
 #include <errno.h>
@@ -35,11 +36,87 @@
  * CONSTANTS
  *============================================================================*/
 
-#define MAX_PORTS		256	/* Maximum number of IPC ports */
+#define MAX_PORTS		(1 << IPC_PORT_INDEX_BITS)	/* Port table limit */
 #define MAX_MSG_QUEUE		64	/* Maximum messages per queue */
 #define MAX_MSG_SIZE		4096	/* Maximum message size */
 #define MAX_REPLY_QUEUE		16	/* Maximum pending replies */
 
+/* Message cache sizes (pages taken at boot) */
+#define IPC_MSG_POOL_PAGES	4	/* ipc_message headers */
+#define IPC_NR_DATA_CLASSES	4	/* Payload size classes */
+
+/* Pending reply table (open addressing, kept at most half full) */
+#define IPC_REPLY_HASH_BITS	8
+#define IPC_REPLY_HASH		(1 << IPC_REPLY_HASH_BITS)
+#define IPC_REPLY_MAX		(IPC_REPLY_HASH / 2)
+
+/* Per-sender credits (one entry per sender with queued messages) */
+#define IPC_CREDIT_HASH_BITS	9
+#define IPC_CREDIT_HASH		(1 << IPC_CREDIT_HASH_BITS)
+#define IPC_CREDIT_MAX		(IPC_CREDIT_HASH / 2)
+
+/* Per-port counters and latency histograms, as in linux/config.h */
+#ifndef CONFIG_IPC_STATS
+#define CONFIG_IPC_STATS	1
+#endif
+
+/* Boot-time IPC self-test, as in linux/config.h */
+#ifndef CONFIG_IPC_SELFTEST
+#define CONFIG_IPC_SELFTEST	0
+#endif
+
+/*
+ * Port names: table index in bits 0-14, generation in bits 16-30. Bit 15
+ * is MK_PORT_SET_FLAG, and bit 31 stays clear so names fit an int return.
+ * Reserved ports keep generation 0; a dynamic port gets a new generation
+ * each time it is freed, so names held past the free stop resolving.
+ */
+#define IPC_PORT_INDEX_BITS	15
+#define IPC_PORT_GEN_SHIFT	16
+#define IPC_PORT_GEN_MASK	0x7FFF
+#define IPC_PORT_INDEX(name)	((name) & (MAX_PORTS - 1))
+#define IPC_PORT_GEN(name)	(((name) >> IPC_PORT_GEN_SHIFT) & IPC_PORT_GEN_MASK)
+#define IPC_PORT_NAME(gen, index) \
+	(((gen) << IPC_PORT_GEN_SHIFT) | (index))
+#define IPC_PORT_BAD_BITS	(~(IPC_PORT_NAME(IPC_PORT_GEN_MASK, MAX_PORTS - 1)))
+
+/*
+ * Port table: directory of page-sized chunks, as many ports to a chunk
+ * as fit in a page. The reserved ports the servers use (none above 0x0C)
+ * and the dynamic ports needed before the memory server can hand out
+ * pages are static; the rest of the reserved range shares one empty
+ * chunk, and ipc_port_grow() adds pages. The chunk size is not a power
+ * of two, but dividing by a constant compiles to a multiply.
+ */
+#define IPC_PORT_CHUNK		(PAGE_SIZE / sizeof(struct ipc_port))
+#define IPC_PORT_CHUNKS		((MAX_PORTS + IPC_PORT_CHUNK - 1) / IPC_PORT_CHUNK)
+#define IPC_PORT_BOOT_LOW	IPC_PORT_CHUNK		/* Static reserved ports */
+#define IPC_PORT_BOOT_DYN	IPC_PORT_CHUNK		/* Static dynamic ports */
+#define IPC_PORT_BOOT		(IPC_PORT_BOOT_LOW + IPC_PORT_BOOT_DYN)
+
+/* Port spaces (per-task rights, direct-mapped by port index) */
+#define IPC_SPACE_BITS		6
+#define IPC_SPACE_SIZE		(1 << IPC_SPACE_BITS)
+
+#define IPC_RIGHT_SEND		0x01	/* Passes the port's caps and domain */
+#define IPC_RIGHT_RECEIVE	0x02	/* Owns the port */
+#define IPC_RIGHT_SEND_ONCE	0x04	/* May send one reply to it */
+
+/* Port sets */
+#define MAX_PORT_SETS		64	/* One default set per task, plus extras */
+#define SET_FLAG_DEFAULT	0x02	/* All ports of one owner */
+
+/* Ring channels */
+#define MAX_CHANNELS		32
+
+/* Messages up to this size are stored inside the ipc_message itself */
+#define IPC_INLINE_WORDS	16
+#define IPC_INLINE_SIZE		(IPC_INLINE_WORDS * sizeof(unsigned long))
+
+/* Short messages: a header plus MK_SHORT_WORDS words, passed in registers */
+#define IPC_SHORT_SIZE		(sizeof(struct mk_msg_header) + \
+				 MK_SHORT_WORDS * sizeof(unsigned long))
+
 /* Port flags */
 #define PORT_FLAG_FREE		0x00	/* Port is free */
 #define PORT_FLAG_USED		0x01	/* Port is allocated */
@@ -47,12 +124,19 @@
 #define PORT_FLAG_SEND		0x04	/* Task waiting to send */
 #define PORT_FLAG_LIMITED	0x08	/* Limited access port */
 
+/* Message priority levels; a level's tasks run at priority >= IPC_PRIO_FLOOR */
+#define IPC_NR_PRIO		MK_NR_PRIO
+#define IPC_PRIO_LEVEL(priority) \
+	((priority) >= (IPC_NR_PRIO << 3) ? IPC_NR_PRIO - 1 : (priority) >> 3)
+#define IPC_PRIO_FLOOR(level)	(((level) << 3) | 7)
+
 /* Message flags */
 #define MSG_FLAG_NONE		0x00	/* No flags */
 #define MSG_FLAG_REPLY		0x01	/* This is a reply */
 #define MSG_FLAG_REQUEST	0x02	/* This is a request */
 #define MSG_FLAG_BLOCK		0x04	/* Blocking operation */
 #define MSG_FLAG_NONBLOCK	0x08	/* Non-blocking operation */
+#define MSG_FLAG_NOTIFY		0x100	/* Wait also ends on notify bits */
 
 /*=============================================================================
  * DATA STRUCTURES
@@ -67,688 +151,4065 @@ struct ipc_message {
 	unsigned int receiver;		/* Receiver port */
 	unsigned int type;		/* Message type */
 	unsigned int size;		/* Data size */
-	unsigned long data[2];		/* Data (or pointer to data) */
+	unsigned long data[IPC_INLINE_WORDS];	/* Data (or pointer to data) */
 	unsigned int flags;		/* Message flags */
+	unsigned long ool_addr;		/* Out-of-line pages (linear, sender) */
+	unsigned long ool_size;		/* Out-of-line size (0 if none) */
+	unsigned int ool_copy;		/* MK_OOL_MOVE or MK_OOL_SHARE */
+	unsigned int prio;		/* Queue level, 0 (bulk) and up */
+	unsigned int seq;		/* sys_ipc_call it belongs to, 0 if none */
+	struct task_struct *task;	/* Sending task, NULL if not charged */
 	struct ipc_message *next;	/* Next in queue */
+#if CONFIG_IPC_STATS
+	unsigned long stamp;		/* TSC when delivered, low word */
+#endif
+};
+
+/* Message body: inline, or the payload buffer data[0] points to */
+#define IPC_MSG_DATA(msg) \
+	((msg)->size <= IPC_INLINE_SIZE ? (void *)(msg)->data : (void *)(msg)->data[0])
+
+/* Descriptor at the tail of a MK_IPC_SEND_OOL message body */
+#define IPC_MSG_OOL(msg) \
+	((struct mk_msg_ool *)((char *)IPC_MSG_DATA(msg) + (msg)->size - \
+	                       sizeof(struct mk_msg_ool)))
+
+/**
+ * ipc_waiter - Task blocked on an IPC wait queue
+ * 
+ * Lives on the blocked task's kernel stack. A wakeup unlinks the waiter
+ * before waking the task, so queued tells whether it still has to be
+ * taken off the queue and woken whether a wakeup was used up on it.
+ */
+struct ipc_waiter {
+	struct task_struct *task;	/* Blocked task */
+	struct ipc_waiter *next;	/* Next waiter in FIFO order */
+	int queued;			/* On a wait queue */
+	int woken;			/* Dequeued by a wakeup */
+};
+
+/**
+ * ipc_wait_queue - FIFO of blocked tasks
+ */
+struct ipc_wait_queue {
+	struct ipc_waiter *head;	/* Woken first */
+	struct ipc_waiter *tail;	/* Most recent waiter */
 };
 
 /**
  * ipc_port - IPC port structure
  */
 struct ipc_port {
-	unsigned int port_id;		/* Port ID */
-	unsigned int owner;		/* Owner task ID */
+	unsigned int port_id;		/* Port name (generation and index) */
+	unsigned int owner;		/* Owner task slot in task[] */
 	unsigned int flags;		/* Port flags */
 	
-	/* Message queue */
+	/* Message queue, highest level first and FIFO within a level */
 	struct ipc_message *queue_head;	/* Head of queue */
 	struct ipc_message *queue_tail;	/* Tail of queue */
+	struct ipc_message *prio_tail[IPC_NR_PRIO];	/* Last of each level */
 	unsigned int queue_count;	/* Number of messages */
 	unsigned int max_messages;	/* Maximum messages allowed */
+	unsigned int share;		/* Queued messages per sender, 0 = any */
+	unsigned long throttled;	/* Sends held back by share */
+	unsigned long notify_bits;	/* Pending notifications, no message */
 	
 	/* Waiting tasks */
-	struct task_struct *recv_wait;	/* Task waiting to receive */
-	struct task_struct *send_wait;	/* Task waiting to send */
+	struct ipc_wait_queue recv_q;	/* Tasks waiting to receive */
+	struct ipc_wait_queue send_q;	/* Tasks waiting for queue space */
+	struct ipc_wait_queue match_q;	/* Tasks in a selective receive */
+	struct ipc_message *handoff;	/* Message handed to blocked receiver */
+	struct task_struct *server;	/* Last receiver, inherits priority */
+	int prio;			/* Level of its messages, -1 = sender's */
+	
+	/* Port set membership (-1 if none) */
+	int set;
+	int ready;			/* On the set's ready list */
+	struct ipc_port *ready_next;	/* Next ready port of the set */
+	struct ipc_port *ready_prev;	/* Previous ready port of the set */
+	
+	/* Free list link, while free */
+	struct ipc_port *free_next;
+	
+	/* Out-of-line receive window */
+	unsigned long ool_window;	/* Receiver address (0 if none) */
+	unsigned long ool_linear;	/* Same, as a linear address */
 	
 	/* Capabilities */
 	capability_t required_caps;	/* Capabilities needed to use */
 	unsigned int domain;		/* Capability domain */
+	
+#if CONFIG_IPC_STATS
+	struct mk_port_stats *stats;	/* Counters, ipc_stats_none if unused */
+#endif
 };
 
 /**
  * ipc_reply - Pending reply tracking
+ * 
+ * Slots of ipc_reply_table; reply_port 0 marks a free slot. request_id
+ * is the request type the server echoes, so entries for the same type
+ * and port are told apart by seq and answered oldest first.
  */
 struct ipc_reply {
 	unsigned int request_id;	/* Request message ID */
 	unsigned int reply_port;	/* Port to send reply to */
+	unsigned int seq;		/* Call waiting for it, 0 if none */
 	struct task_struct *waiting_task;	/* Task waiting for reply */
-	unsigned long timeout;		/* Reply timeout */
-	struct ipc_reply *next;		/* Next in chain */
+};
+
+/**
+ * ipc_deadline - Bound on how long a task blocks in IPC
+ * 
+ * Lives on the blocked task's kernel stack; the timer wakes the task and
+ * sets expired, which the wait loop checks after every wakeup.
+ */
+struct ipc_deadline {
+	struct timer_list timer;
+	struct task_struct *task;	/* Task to wake */
+	int expired;			/* Set when the timer fired */
+	
+	/*
+	 * Partner of a synchronous call or reply that the task is about to
+	 * block for. The first ipc_block() that sleeps switches straight to
+	 * it, once; NULL for every other wait.
+	 */
+	struct task_struct *partner;
+	int partner_how;		/* SCHED_TO_CALL or SCHED_TO_REPLY */
+};
+
+/**
+ * ipc_credit - Messages one sender has queued on one port
+ * 
+ * Slots of ipc_credit_table; port 0 marks a free slot. An entry lives
+ * only while the sender has messages queued there.
+ */
+struct ipc_credit {
+	unsigned int port;		/* Port */
+	struct task_struct *task;	/* Sender */
+	unsigned int queued;		/* Its messages in the port's queue */
+};
+
+/**
+ * ipc_entry - Right a task holds on a port
+ * 
+ * Entries are keyed by full port name, so the generation bump of a freed
+ * port turns every entry for it into a miss with no sweep of the spaces.
+ */
+struct ipc_entry {
+	unsigned int name;		/* Port name, 0 if empty */
+	unsigned int rights;		/* IPC_RIGHT_* */
+};
+
+/**
+ * ipc_space - Port name space of a task
+ * 
+ * task->port_space indexes ipc_spaces[]. The space caches what the task
+ * may do with the ports it has used; the port table is only consulted
+ * to fill an entry. Send-once rights exist only here: receiving a request
+ * grants one on its reply port, and the reply uses it up.
+ */
+struct ipc_space {
+	struct ipc_entry entry[IPC_SPACE_SIZE];
+};
+
+/**
+ * ipc_port_set - Group of ports received from as one
+ * 
+ * A port is in exactly one set: its owner's default set, which serves
+ * receive-from-any (port 0), or a set made with sys_ipc_portset_allocate.
+ * Member ports with something pending are linked on the ready list in
+ * the order they became ready, so finding one costs the same however
+ * large the port table grows.
+ */
+struct ipc_port_set {
+	unsigned int owner;		/* Owner task slot, as for ports */
+	unsigned int flags;		/* PORT_FLAG_* and SET_FLAG_DEFAULT */
+	unsigned int nr_ports;		/* Member ports */
+	struct ipc_port *ready_head;	/* Received from first */
+	struct ipc_port *ready_tail;	/* Most recently ready */
+	struct ipc_wait_queue recv_q;	/* Tasks waiting on the set */
+};
+
+/**
+ * ipc_channel - Pair of shared rings between a client and a server port
+ * 
+ * Messages go through the rings without entering the kernel; the kernel
+ * only turns a kick into a MK_MSG_CHANNEL_KICK message for a consumer
+ * that went to sleep. Each ring is one page.
+ */
+struct ipc_channel {
+	unsigned int flags;		/* PORT_FLAG_FREE or PORT_FLAG_USED */
+	unsigned int owner;		/* Client task slot, TASK_ID_KERNEL if shared */
+	unsigned int port;		/* Consumer of the request ring */
+	unsigned int reply_port;	/* Consumer of the reply ring (0 if none) */
+	struct mk_ring *ring[2];	/* MK_RING_REQ and MK_RING_REP */
+};
+
+/**
+ * ipc_cache - Free-list allocator for fixed-size IPC objects
+ */
+struct ipc_cache {
+	const char *name;		/* Cache name (for reports) */
+	unsigned int obj_size;		/* Object size in bytes */
+	unsigned int nr_objs;		/* Objects cut from the cache's pages */
+	void *free_list;		/* Free objects, linked through word 0 */
+	unsigned int in_use;		/* Objects currently allocated */
+	unsigned int high_water;	/* Maximum in_use seen */
+	unsigned long hits;		/* Allocations served */
+	unsigned long misses;		/* Allocations refused (cache empty) */
 };
 
 /*=============================================================================
  * GLOBAL STATE
  *============================================================================*/
 
-static struct ipc_port ipc_ports[MAX_PORTS];
-static struct ipc_reply *pending_replies = NULL;
-static unsigned int next_port_id = PORT_DYNAMIC_START;
+static struct ipc_port *ipc_port_dir[IPC_PORT_CHUNKS];
+static struct ipc_port ipc_port_boot[IPC_PORT_BOOT];
+static struct ipc_port ipc_port_hole[IPC_PORT_CHUNK];	/* Unused reserved */
+static unsigned int ipc_nr_ports;	/* Indices backed by a chunk */
+static struct ipc_port *ipc_port_free;	/* Free dynamic ports */
+
+/* Port at a table index below ipc_nr_ports */
+#define ipc_port_at(index) \
+	(&ipc_port_dir[(unsigned int) (index) / IPC_PORT_CHUNK] \
+	              [(unsigned int) (index) % IPC_PORT_CHUNK])
+static struct ipc_port_set ipc_port_sets[MAX_PORT_SETS];
+static struct ipc_space ipc_spaces[NR_TASKS];
+static struct ipc_reply ipc_reply_table[IPC_REPLY_HASH];
+static unsigned int ipc_call_seq;	/* Last sys_ipc_call stamped */
+static struct ipc_credit ipc_credit_table[IPC_CREDIT_HASH];
+static struct ipc_channel ipc_channels[MAX_CHANNELS];
+
+/* Payload size classes for messages larger than the inline area */
+static const unsigned int ipc_data_sizes[IPC_NR_DATA_CLASSES] = {
+	128, 512, 2048, MAX_MSG_SIZE
+};
+static const unsigned int ipc_data_pages[IPC_NR_DATA_CLASSES] = {
+	2, 4, 2, 8
+};
+
+static struct ipc_cache ipc_msg_cache;
+static struct ipc_cache ipc_data_cache[IPC_NR_DATA_CLASSES];
+
+/* Pending reply table statistics */
+static struct {
+	unsigned int used;		/* Occupied slots */
+	unsigned int high_water;	/* Maximum used seen */
+	unsigned long lookups;		/* Inserts and removals */
+	unsigned long probes;		/* Slots examined by them */
+	unsigned int max_probe;		/* Longest probe sequence */
+	unsigned long overflows;	/* Inserts refused (table full) */
+} ipc_reply_stats;
+
+/* Flow control statistics */
+static struct {
+	unsigned int used;		/* Occupied credit slots */
+	unsigned int high_water;	/* Maximum used seen */
+	unsigned long throttled;	/* Sends held back, all ports */
+	unsigned long overflows;	/* Messages left uncharged (table full) */
+} ipc_flow_stats;
+
+#if CONFIG_IPC_STATS
+/*
+ * Per-port statistics. The static ports have static counters. A grown
+ * port takes a block when it is allocated and gives it back when it is
+ * freed; blocks are cut from pages shared by all ports, so free ports
+ * cost nothing. Ports without a block, and the hole, count into
+ * ipc_stats_none, so the hooks never test for NULL.
+ */
+static struct mk_port_stats ipc_stats_boot[IPC_PORT_BOOT];
+static struct mk_port_stats ipc_stats_none;
+static struct mk_port_stats *ipc_stats_free;	/* Linked through word 0 */
+
+#define ipc_stats(port)		((port)->stats)
+#endif
+
+/* Compile-time check: a negative array size stops the build */
+typedef char ipc_port_chunk_holds_servers[IPC_PORT_CHUNK > 0x0C ? 1 : -1];
 
 /*=============================================================================
  * FORWARD DECLARATIONS
  *============================================================================*/
 
-static int port_validate_access(unsigned int port_id, struct task_struct *task);
+static inline int port_validate_access(unsigned int port_id,
+                                       struct task_struct *task,
+                                       unsigned int rights);
+static void ipc_free_message(struct ipc_message *msg);
 static void ipc_queue_message(struct ipc_port *port, struct ipc_message *msg);
 static struct ipc_message *ipc_dequeue_message(struct ipc_port *port);
+static void ipc_wait_init(struct ipc_wait_queue *q);
+static void ipc_wake_all(struct ipc_wait_queue *q);
 static void ipc_wakeup_sender(struct ipc_port *port);
+static int ipc_credit_get(struct ipc_port *port, struct task_struct *task);
+static void ipc_credit_put(struct ipc_port *port, struct task_struct *task);
+static int ipc_throttled(struct ipc_port *port);
+static void ipc_space_revoke(unsigned int name);
+static void ipc_channel_close(unsigned int id);
 static void ipc_wakeup_receiver(struct ipc_port *port);
+static struct task_struct *ipc_deliver_message(struct ipc_port *port,
+                                               struct ipc_message *msg);
+static struct ipc_message *ipc_take_message(struct ipc_port *port);
+static void ipc_map_ool(struct ipc_message *msg);
+static int ipc_copy_out(struct ipc_message *msg, void *buf,
+                        unsigned int *size_ptr, unsigned int max_size);
+static int ipc_copy_outv(struct ipc_message *msg, struct mk_iovec *iov,
+                         unsigned int count, unsigned int *size_ptr,
+                         unsigned int max_size);
 static int ipc_add_reply(unsigned int request_id, unsigned int reply_port,
-                          struct task_struct *task, unsigned long timeout);
-static struct ipc_reply *ipc_find_reply(unsigned int request_id);
+                          struct task_struct *task, unsigned int seq);
+static int ipc_find_reply(unsigned int request_id, unsigned int reply_port,
+                          struct ipc_reply *out);
 
 /*=============================================================================
- * PORT MANAGEMENT
+ * MESSAGE CACHES
  *============================================================================*/
 
 /**
- * ipc_init - Initialize IPC subsystem
+ * ipc_cache_init - Set up a cache over freshly allocated pages
+ * @c: Cache
+ * @name: Cache name
+ * @obj_size: Object size (at least one pointer, at most PAGE_SIZE)
+ * @nr_pages: Pages to cut into objects
+ * 
+ * The pages are kept for good. A cache that gets fewer pages than asked
+ * for just holds fewer objects.
  */
-void ipc_init(void)
+static void ipc_cache_init(struct ipc_cache *c, const char *name,
+                           unsigned int obj_size, unsigned int nr_pages)
 {
-	int i;
-	
-	printk("Initializing IPC subsystem...\n");
+	unsigned long page;
+	unsigned int i;
 	
-	/* Initialize all ports as free */
-	for (i = 0; i < MAX_PORTS; i++) {
-		ipc_ports[i].port_id = i;
-		ipc_ports[i].owner = 0;
-		ipc_ports[i].flags = PORT_FLAG_FREE;
-		ipc_ports[i].queue_head = NULL;
-		ipc_ports[i].queue_tail = NULL;
-		ipc_ports[i].queue_count = 0;
-		ipc_ports[i].max_messages = MAX_MSG_QUEUE;
-		ipc_ports[i].recv_wait = NULL;
-		ipc_ports[i].send_wait = NULL;
-		ipc_ports[i].required_caps = CAP_NULL;
-		ipc_ports[i].domain = 0;
-	}
+	c->name = name;
+	c->obj_size = obj_size;
+	c->nr_objs = 0;
+	c->free_list = NULL;
+	c->in_use = 0;
+	c->high_water = 0;
+	c->hits = 0;
+	c->misses = 0;
 	
-	/* Initialize reserved ports (0 is invalid, 1-0xFF are system) */
-	for (i = PORT_RESERVED_START; i <= PORT_RESERVED_END; i++) {
-		ipc_ports[i].flags = PORT_FLAG_USED;
-		ipc_ports[i].owner = TASK_ID_KERNEL;
-		ipc_ports[i].required_caps = CAP_SYSTEM;
+	while (nr_pages-- > 0) {
+		page = get_free_page();
+		if (!page) {
+			printk("IPC: %s cache short of pages\n", name);
+			break;
+		}
+		for (i = PAGE_SIZE / obj_size; i-- > 0; ) {
+			void **obj = (void **)(page + i * obj_size);
+			*obj = c->free_list;
+			c->free_list = obj;
+			c->nr_objs++;
+		}
 	}
-	
-	pending_replies = NULL;
-	next_port_id = PORT_DYNAMIC_START;
-	
-	printk("IPC subsystem initialized (%d ports available)\n", 
-	       MAX_PORTS - PORT_RESERVED_END);
 }
 
 /**
- * ipc_allocate_port - Allocate a new IPC port
- * @owner: Owner task ID
- * @caps: Required capabilities for access
+ * ipc_cache_alloc - Allocate an object from a cache
+ * @c: Cache
  * 
- * Returns port ID, or -1 on error.
+ * Never falls back to a general allocator, so the IPC path cannot sleep
+ * here; an empty cache is counted as a miss and the send fails with
+ * -EAGAIN.
+ * Returns object, or NULL if the cache is empty.
  */
-int ipc_allocate_port(unsigned int owner, capability_t caps)
+static void *ipc_cache_alloc(struct ipc_cache *c)
 {
-	int i;
+	unsigned long flags;
+	void **obj;
 	
-	cli();	/* Disable interrupts during allocation */
+	save_flags(flags);
+	cli();
 	
-	for (i = PORT_DYNAMIC_START; i < MAX_PORTS; i++) {
-		if (ipc_ports[i].flags == PORT_FLAG_FREE) {
-			ipc_ports[i].flags = PORT_FLAG_USED;
-			ipc_ports[i].owner = owner;
-			ipc_ports[i].required_caps = caps;
-			ipc_ports[i].queue_head = NULL;
-			ipc_ports[i].queue_tail = NULL;
-			ipc_ports[i].queue_count = 0;
-			ipc_ports[i].recv_wait = NULL;
-			ipc_ports[i].send_wait = NULL;
-			
-			sti();
-			return i;
-		}
+	obj = (void **) c->free_list;
+	if (obj) {
+		c->free_list = *obj;
+		c->hits++;
+		if (++c->in_use > c->high_water)
+			c->high_water = c->in_use;
+	} else {
+		c->misses++;
 	}
 	
-	sti();
-	return -1;
+	restore_flags(flags);
+	
+	return obj;
 }
 
 /**
- * ipc_deallocate_port - Deallocate an IPC port
- * @port_id: Port to deallocate
- * 
- * Returns 0 on success, -1 on error.
+ * ipc_cache_free - Return an object to its cache
+ * @c: Cache
+ * @obj: Object from ipc_cache_alloc
  */
-int ipc_deallocate_port(unsigned int port_id)
+static void ipc_cache_free(struct ipc_cache *c, void *obj)
 {
-	struct ipc_port *port;
-	struct ipc_message *msg, *next;
-	
-	if (port_id >= MAX_PORTS)
-		return -EINVAL;
+	unsigned long flags;
 	
-	port = &ipc_ports[port_id];
+	if (!obj)
+		return;
 	
+	save_flags(flags);
 	cli();
 	
-	/* Check if port is allocated */
-	if (port->flags == PORT_FLAG_FREE) {
-		sti();
-		return -EINVAL;
-	}
-	
-	/* Check if caller is owner */
-	if (port->owner != kernel_state->current_task) {
-		sti();
-		return -EPERM;
-	}
-	
-	/* Free all messages in queue */
-	msg = port->queue_head;
-	while (msg) {
-		next = msg->next;
-		kfree(msg);
-		msg = next;
-	}
+	c->in_use--;
+	*(void **)obj = c->free_list;
+	c->free_list = obj;
 	
-	/* Wake up any waiting tasks */
-	if (port->recv_wait)
-		wake_up(&port->recv_wait);
-	if (port->send_wait)
-		wake_up(&port->send_wait);
+	restore_flags(flags);
+}
+
+/**
+ * ipc_data_cache_for - Pick the payload cache for a size
+ * @size: Payload size (at most MAX_MSG_SIZE)
+ */
+static struct ipc_cache *ipc_data_cache_for(unsigned int size)
+{
+	int i;
 	
-	/* Mark port as free */
-	port->flags = PORT_FLAG_FREE;
-	port->owner = 0;
+	for (i = 0; i < IPC_NR_DATA_CLASSES - 1; i++)
+		if (size <= ipc_data_sizes[i])
+			break;
 	
-	sti();
-	return 0;
+	return &ipc_data_cache[i];
 }
 
 /**
- * port_validate_access - Check if task can access port
- * @port_id: Port ID
- * @task: Task attempting access
- * 
- * Returns 1 if access allowed, 0 otherwise.
+ * ipc_caches_init - Fill the message caches from free pages
  */
-static int port_validate_access(unsigned int port_id, struct task_struct *task)
+static void ipc_caches_init(void)
 {
-	struct ipc_port *port;
-	
-	if (port_id >= MAX_PORTS)
-		return 0;
+	int i;
 	
-	port = &ipc_ports[port_id];
+	ipc_cache_init(&ipc_msg_cache, "message",
+	               sizeof(struct ipc_message), IPC_MSG_POOL_PAGES);
 	
-	/* Free ports cannot be accessed */
-	if (port->flags == PORT_FLAG_FREE)
-		return 0;
+	for (i = 0; i < IPC_NR_DATA_CLASSES; i++)
+		ipc_cache_init(&ipc_data_cache[i], "data",
+		               ipc_data_sizes[i], ipc_data_pages[i]);
+}
+
+/**
+ * ipc_show_caches - Print message cache, reply and credit statistics
+ */
+void ipc_show_caches(void)
+{
+	struct ipc_cache *c;
+	int i;
 	
-	/* Kernel can access any port */
-	if (task->pid == TASK_ID_KERNEL)
-		return 1;
+	printk("IPC caches: name size in_use/total high hits misses\n");
+	for (i = -1; i < IPC_NR_DATA_CLASSES; i++) {
+		c = (i < 0) ? &ipc_msg_cache : &ipc_data_cache[i];
+		
+		printk("  %s %d %d/%d %d %d %d\n", c->name, c->obj_size,
+		       c->in_use, c->nr_objs, c->high_water,
+		       c->hits, c->misses);
+	}
 	
-	/* Check if task has required capabilities */
-	if ((task->caps & port->required_caps) != port->required_caps)
-		return 0;
+	printk("IPC replies: %d/%d high %d lookups %d probes %d max %d full %d\n",
+	       ipc_reply_stats.used, IPC_REPLY_HASH, ipc_reply_stats.high_water,
+	       ipc_reply_stats.lookups, ipc_reply_stats.probes,
+	       ipc_reply_stats.max_probe, ipc_reply_stats.overflows);
 	
-	/* Check capability domain */
-	if (port->domain != 0 && (task->caps & 0x0F) != port->domain)
-		return 0;
+	printk("IPC credits: %d/%d high %d throttled %d full %d\n",
+	       ipc_flow_stats.used, IPC_CREDIT_HASH, ipc_flow_stats.high_water,
+	       ipc_flow_stats.throttled, ipc_flow_stats.overflows);
+	for (i = 0; i < ipc_nr_ports; i++)
+		if (ipc_port_at(i)->throttled)
+			printk("  port %x share %d/%d throttled %d\n",
+			       ipc_port_at(i)->port_id, ipc_port_at(i)->share,
+			       ipc_port_at(i)->max_messages,
+			       ipc_port_at(i)->throttled);
 	
-	return 1;
+	printk("IPC ports: %d of %d backed, %d static, %d unused reserved\n",
+	       ipc_nr_ports, MAX_PORTS, IPC_PORT_BOOT,
+	       PORT_DYNAMIC_START - IPC_PORT_BOOT_LOW);
 }
 
 /*=============================================================================
- * MESSAGE QUEUE MANAGEMENT
+ * PORT SETS
  *============================================================================*/
 
 /**
- * ipc_create_message - Create a new message
- * @msg_id: Message ID
- * @sender: Sender port
- * @receiver: Receiver port
- * @type: Message type
- * @size: Data size
- * @data: Data pointer
- * @flags: Message flags
+ * ipc_set_bit - Put a port on or take it off its set's ready list
+ * @port: Port
+ * @ready: Whether the port has something pending
  * 
- * Returns pointer to new message, or NULL on error.
+ * Must be called with interrupts disabled.
  */
-static struct ipc_message *ipc_create_message(unsigned int msg_id,
-                                                unsigned int sender,
-                                                unsigned int receiver,
-                                                unsigned int type,
-                                                unsigned int size,
-                                                void *data,
-                                                unsigned int flags)
+static void ipc_set_bit(struct ipc_port *port, int ready)
 {
-	struct ipc_message *msg;
-	
-	if (size > MAX_MSG_SIZE)
-		return NULL;
+	struct ipc_port_set *set;
 	
-	msg = (struct ipc_message *) kmalloc(sizeof(struct ipc_message));
-	if (!msg)
-		return NULL;
+	if (port->set < 0 || port->ready == ready)
+		return;
 	
-	msg->msg_id = msg_id;
-	msg->sender = sender;
-	msg->receiver = receiver;
-	msg->type = type;
-	msg->size = size;
-	msg->flags = flags;
-	msg->next = NULL;
+	set = &ipc_port_sets[port->set];
+	port->ready = ready;
 	
-	/* Copy data */
-	if (size <= 8) {
-		/* Small data fits in message */
-		memcpy(msg->data, data, size);
+	if (ready) {
+		port->ready_next = NULL;
+		port->ready_prev = set->ready_tail;
+		if (set->ready_tail)
+			set->ready_tail->ready_next = port;
+		else
+			set->ready_head = port;
+		set->ready_tail = port;
 	} else {
-		/* Large data - copy to kernel space */
-		msg->data[0] = (unsigned long) kmalloc(size);
-		if (!msg->data[0]) {
-			kfree(msg);
-			return NULL;
-		}
-		memcpy((void *)msg->data[0], data, size);
+		if (port->ready_prev)
+			port->ready_prev->ready_next = port->ready_next;
+		else
+			set->ready_head = port->ready_next;
+		if (port->ready_next)
+			port->ready_next->ready_prev = port->ready_prev;
+		else
+			set->ready_tail = port->ready_prev;
 	}
-	
-	return msg;
 }
 
+/* Bring a port's place on the ready list in line with its queue */
+#define ipc_set_mark(port) \
+	ipc_set_bit((port), (port)->handoff || (port)->queue_head || \
+	                    (port)->notify_bits)
+
 /**
- * ipc_free_message - Free a message
- * @msg: Message to free
+ * ipc_set_first - Find a ready port in a set
+ * @set: Port set
+ * 
+ * The port found goes to the back of the list, so a port that stays
+ * busy cannot starve the other members.
+ * Must be called with interrupts disabled.
+ * Returns port, or NULL if no member has a message.
  */
-static void ipc_free_message(struct ipc_message *msg)
+static struct ipc_port *ipc_set_first(struct ipc_port_set *set)
 {
-	if (!msg)
-		return;
+	struct ipc_port *port = set->ready_head;
 	
-	/* Free large data if allocated */
-	if (msg->size > 8 && msg->data[0])
-		kfree((void *)msg->data[0]);
+	if (port && port->ready_next) {
+		ipc_set_bit(port, 0);
+		ipc_set_bit(port, 1);
+	}
 	
-	kfree(msg);
+	return port;
 }
 
 /**
- * ipc_queue_message - Add message to port queue
- * @port: Target port
- * @msg: Message to queue
+ * ipc_set_alloc - Allocate a port set
+ * @owner: Owner task
+ * @flags: SET_FLAG_DEFAULT for an owner's default set
+ * 
+ * Must be called with interrupts disabled.
+ * Returns set index, or -1 if none is free.
  */
-static void ipc_queue_message(struct ipc_port *port, struct ipc_message *msg)
+static int ipc_set_alloc(unsigned int owner, unsigned int flags)
 {
-	msg->next = NULL;
+	struct ipc_port_set *set;
+	int i;
 	
-	if (!port->queue_head) {
-		port->queue_head = msg;
-		port->queue_tail = msg;
-	} else {
-		port->queue_tail->next = msg;
-		port->queue_tail = msg;
+	for (i = 1; i < MAX_PORT_SETS; i++) {
+		set = &ipc_port_sets[i];
+		if (set->flags != PORT_FLAG_FREE)
+			continue;
+		
+		set->owner = owner;
+		set->flags = PORT_FLAG_USED | flags;
+		set->nr_ports = 0;
+		set->ready_head = NULL;
+		set->ready_tail = NULL;
+		ipc_wait_init(&set->recv_q);
+		return i;
 	}
 	
-	port->queue_count++;
+	return -1;
 }
 
 /**
- * ipc_dequeue_message - Remove message from port queue
- * @port: Source port
+ * ipc_default_set - Find an owner's default set
+ * @owner: Owner task
+ * @create: Allocate the set if it does not exist
  * 
- * Returns first message in queue, or NULL if empty.
+ * Must be called with interrupts disabled.
+ * Returns set index, or -1.
  */
-static struct ipc_message *ipc_dequeue_message(struct ipc_port *port)
+static int ipc_default_set(unsigned int owner, int create)
 {
-	struct ipc_message *msg = port->queue_head;
+	int i;
 	
-	if (msg) {
-		port->queue_head = msg->next;
-		if (!port->queue_head)
-			port->queue_tail = NULL;
-		port->queue_count--;
+	for (i = 1; i < MAX_PORT_SETS; i++)
+		if ((ipc_port_sets[i].flags & SET_FLAG_DEFAULT) &&
+		    ipc_port_sets[i].owner == owner)
+			return i;
+	
+	return create ? ipc_set_alloc(owner, SET_FLAG_DEFAULT) : -1;
+}
+
+/**
+ * ipc_set_join - Move a port into a set
+ * @port: Port
+ * @set: Set index, or -1 to leave its current set
+ * 
+ * Must be called with interrupts disabled.
+ */
+static void ipc_set_join(struct ipc_port *port, int set)
+{
+	if (port->set >= 0) {
+		ipc_set_bit(port, 0);
+		ipc_port_sets[port->set].nr_ports--;
 	}
 	
-	return msg;
+	port->set = set;
+	
+	if (set >= 0) {
+		ipc_port_sets[set].nr_ports++;
+		ipc_set_mark(port);
+		if (port->handoff || port->queue_head || port->notify_bits)
+			ipc_wakeup_receiver(port);
+	}
+}
+
+/*=============================================================================
+ * PORT STATISTICS
+ *============================================================================*/
+
+/*
+ * Counters are bumped on paths that already run with interrupts off, so
+ * they need no lock of their own. With CONFIG_IPC_STATS at 0 every hook
+ * below compiles to nothing and sys_ipc_port_stats returns -ENOSYS.
+ */
+#if CONFIG_IPC_STATS
+
+#define IPC_STAT(port, field)	(ipc_stats(port)->field++)
+
+/*
+ * Low word of the time stamp counter; deltas up to 2^32 cycles. A 386
+ * or 486 has no TSC and RDTSC would fault, so latencies all read 0.
+ */
+static inline unsigned long ipc_tsc(void)
+{
+	unsigned long lo;
+	
+	if (!has_tsc)
+		return 0;
+	__asm__ __volatile__("rdtsc" : "=a" (lo) : : "dx");
+	return lo;
+}
+
+/**
+ * ipc_stats_hist - Count a latency in its log2 bucket
+ * @hist: MK_STATS_BUCKETS buckets
+ * @cycles: Latency
+ */
+static inline void ipc_stats_hist(unsigned long *hist, unsigned long cycles)
+{
+	unsigned long bucket = 0;
+	
+	if (cycles)
+		__asm__("bsrl %1,%0" : "=r" (bucket) : "rm" (cycles));
+	if (bucket >= MK_STATS_BUCKETS)
+		bucket = MK_STATS_BUCKETS - 1;
+	hist[bucket]++;
+}
+
+/**
+ * ipc_stats_send - Account a message just delivered to a port
+ * @port: Port
+ * @msg: Message, handed off or queued
+ */
+static inline void ipc_stats_send(struct ipc_port *port,
+                                  struct ipc_message *msg)
+{
+	struct mk_port_stats *st = ipc_stats(port);
+	unsigned int depth = port->queue_count + (port->handoff != NULL);
+	
+	msg->stamp = ipc_tsc();
+	st->sends++;
+	st->bytes += msg->size;
+	if (depth > st->queue_high)
+		st->queue_high = depth;
+}
+
+/**
+ * ipc_stats_recv - Account a message taken off a port
+ * @port: Port
+ * @msg: Message
+ */
+static inline void ipc_stats_recv(struct ipc_port *port,
+                                  struct ipc_message *msg)
+{
+	struct mk_port_stats *st = ipc_stats(port);
+	
+	st->receives++;
+	ipc_stats_hist(st->queue_lat, ipc_tsc() - msg->stamp);
+}
+
+/* Round trip of a call, from before the request went out */
+#define ipc_stats_reply(port, start) \
+	ipc_stats_hist(ipc_stats(port)->reply_lat, ipc_tsc() - (start))
+
+#define ipc_stats_reset(port) \
+	memset(ipc_stats(port), 0, sizeof(struct mk_port_stats))
+
+/* Bucket below which half of a histogram's samples fall */
+static int ipc_stats_median(unsigned long *hist)
+{
+	unsigned long total = 0, sum = 0;
+	int i;
+	
+	for (i = 0; i < MK_STATS_BUCKETS; i++)
+		total += hist[i];
+	for (i = 0; i < MK_STATS_BUCKETS; i++)
+		if ((sum += hist[i]) * 2 >= total)
+			break;
+	return i;
+}
+
+#else
+
+#define IPC_STAT(port, field)		do { } while (0)
+#define ipc_tsc()			0UL
+#define ipc_stats_send(port, msg)	do { } while (0)
+#define ipc_stats_recv(port, msg)	do { } while (0)
+#define ipc_stats_reply(port, start)	((void) (start))
+#define ipc_stats_reset(port)		do { } while (0)
+
+#endif /* CONFIG_IPC_STATS */
+
+/**
+ * ipc_show_port_stats - Print counters of every port that saw traffic
+ * 
+ * Latencies are shown as the log2 bucket holding the median, in cycles.
+ */
+void ipc_show_port_stats(void)
+{
+#if CONFIG_IPC_STATS
+	struct mk_port_stats *st;
+	unsigned int i;
+	
+	printk("IPC ports: port sends recv blocks eagain bytes high/max q~2^ r~2^\n");
+	for (i = 0; i < ipc_nr_ports; i++) {
+		st = ipc_port_at(i)->stats;
+		if (st == &ipc_stats_none)
+			continue;	/* Free, or the hole */
+		if (!st->sends && !st->blocks)
+			continue;
+		printk("  %x %d %d %d %d %d %d/%d %d %d\n",
+		       ipc_port_at(i)->port_id, st->sends, st->receives,
+		       st->blocks, st->eagains, st->bytes, st->queue_high,
+		       ipc_port_at(i)->max_messages,
+		       ipc_stats_median(st->queue_lat),
+		       ipc_stats_median(st->reply_lat));
+	}
+#else
+	printk("IPC port statistics not compiled in\n");
+#endif
+}
+
+/*=============================================================================
+ * PORT MANAGEMENT
+ *============================================================================*/
+
+/**
+ * ipc_port_lookup - Resolve a port name
+ * @name: Port name
+ * 
+ * A directory lookup and an index, whatever the size of the table. A
+ * name of generation 0 is taken as a bare index and resolves to whatever
+ * port is there now: reserved ports are named that way, and so is the
+ * reply port in the 16-bit field of a short message tag.
+ * Returns port (which may be free), or NULL if the name is invalid or
+ * stale.
+ */
+static inline struct ipc_port *ipc_port_lookup(unsigned int name)
+{
+	unsigned int index = IPC_PORT_INDEX(name);
+	struct ipc_port *port;
+	
+	if ((name & IPC_PORT_BAD_BITS) || index >= ipc_nr_ports)
+		return NULL;
+	
+	/* A bare index must at least be where the port is (not the hole) */
+	port = ipc_port_at(index);
+	if (name != index ? port->port_id != name :
+	                    IPC_PORT_INDEX(port->port_id) != index)
+		return NULL;
+	
+	return port;
+}
+
+/* Full name of the port now at a bare index, as found in a short tag */
+static inline unsigned int ipc_port_widen(unsigned int index)
+{
+	return index < ipc_nr_ports ? ipc_port_at(index)->port_id : index;
+}
+
+/**
+ * ipc_port_setup - Initialize a free port
+ * @port: Port
+ * @index: Its table index
+ */
+static void ipc_port_setup(struct ipc_port *port, unsigned int index)
+{
+	/* Dynamic ports start at generation 1, reserved ones stay at 0 */
+	port->port_id = index < PORT_DYNAMIC_START ? index :
+	                IPC_PORT_NAME(1, index);
+	port->owner = 0;
+	port->flags = PORT_FLAG_FREE;
+	port->queue_head = NULL;
+	port->queue_tail = NULL;
+	memset(port->prio_tail, 0, sizeof(port->prio_tail));
+	port->queue_count = 0;
+	port->max_messages = MAX_MSG_QUEUE;
+	port->share = 0;
+	port->throttled = 0;
+	port->notify_bits = 0;
+	ipc_wait_init(&port->recv_q);
+	ipc_wait_init(&port->send_q);
+	ipc_wait_init(&port->match_q);
+	port->handoff = NULL;
+	port->server = NULL;
+	port->prio = -1;
+	port->set = -1;
+	port->ready = 0;
+	port->free_next = NULL;
+	port->ool_window = 0;
+	port->ool_linear = 0;
+	port->required_caps = CAP_NULL;
+	port->domain = 0;
+#if CONFIG_IPC_STATS
+	port->stats = &ipc_stats_none;
+#endif
+}
+
+/**
+ * ipc_port_add_chunk - Back the next IPC_PORT_CHUNK indices
+ * @chunk: IPC_PORT_CHUNK ports of storage
+ * @stats: Static counters for them, or NULL to take blocks on allocation
+ * 
+ * Its dynamic ports go on the free list, lowest index first out. The
+ * last chunk may reach past MAX_PORTS; those ports are never used.
+ * Must be called with interrupts disabled.
+ */
+static void ipc_port_add_chunk(struct ipc_port *chunk,
+                               struct mk_port_stats *stats)
+{
+	unsigned int base = ipc_nr_ports;
+	int i;
+	
+	ipc_port_dir[base / IPC_PORT_CHUNK] = chunk;
+	
+	for (i = IPC_PORT_CHUNK - 1; i >= 0; i--) {
+		ipc_port_setup(&chunk[i], base + i);
+#if CONFIG_IPC_STATS
+		if (stats)
+			chunk[i].stats = &stats[i];
+#endif
+		if (base + i >= PORT_DYNAMIC_START && base + i < MAX_PORTS) {
+			chunk[i].free_next = ipc_port_free;
+			ipc_port_free = &chunk[i];
+		}
+	}
+	
+	ipc_nr_ports = base + IPC_PORT_CHUNK;
+	if (ipc_nr_ports > MAX_PORTS)
+		ipc_nr_ports = MAX_PORTS;
+}
+
+/**
+ * ipc_port_add_hole - Map the next IPC_PORT_CHUNK indices to the hole
+ * 
+ * For reserved indices nothing will use. The hole's ports carry index 0
+ * in their names, so ipc_port_lookup() never resolves to one.
+ */
+static void ipc_port_add_hole(void)
+{
+	unsigned int base = ipc_nr_ports;
+	
+	ipc_port_dir[base / IPC_PORT_CHUNK] = ipc_port_hole;
+	ipc_nr_ports = base + IPC_PORT_CHUNK;
+}
+
+/**
+ * ipc_port_grow - Add a page of ports to the table
+ * 
+ * Chunks are never given back, so a port pointer stays valid for the
+ * life of the system; only its name goes stale.
+ * Returns 0 on success, -ENOMEM or -ENOSPC.
+ */
+static int ipc_port_grow(void)
+{
+	unsigned long page;
+	
+	page = get_free_page();
+	if (!page)
+		return -ENOMEM;
+	
+	cli();
+	
+	/* Another task may have filled the table while we slept */
+	if (ipc_nr_ports >= MAX_PORTS) {
+		sti();
+		free_page(page);
+		return -ENOSPC;
+	}
+	
+	ipc_port_add_chunk((struct ipc_port *) page, NULL);
+	
+	sti();
+	return 0;
+}
+
+#if CONFIG_IPC_STATS
+/**
+ * ipc_stats_grow - Cut a page into statistics blocks
+ * 
+ * Like port chunks, the pages are kept for good.
+ * Returns 0 on success, -ENOMEM.
+ */
+static int ipc_stats_grow(void)
+{
+	struct mk_port_stats *st;
+	unsigned long page;
+	int i;
+	
+	page = get_free_page();
+	if (!page)
+		return -ENOMEM;
+	
+	cli();
+	st = (struct mk_port_stats *) page;
+	for (i = 0; i < PAGE_SIZE / sizeof(*st); i++) {
+		*(struct mk_port_stats **) &st[i] = ipc_stats_free;
+		ipc_stats_free = &st[i];
+	}
+	sti();
+	return 0;
+}
+
+/* Give a grown port a block; one is known to be free. Interrupts off. */
+#define ipc_stats_attach(port) do { \
+	if ((port)->stats == &ipc_stats_none) { \
+		(port)->stats = ipc_stats_free; \
+		ipc_stats_free = *(struct mk_port_stats **) ipc_stats_free; \
+	} \
+} while (0)
+
+/* Take it back when the port is freed; static counters stay. */
+#define ipc_stats_detach(port) do { \
+	if ((port)->stats != &ipc_stats_none && \
+	    ((port)->stats < ipc_stats_boot || \
+	     (port)->stats >= ipc_stats_boot + IPC_PORT_BOOT)) { \
+		*(struct mk_port_stats **) (port)->stats = ipc_stats_free; \
+		ipc_stats_free = (port)->stats; \
+		(port)->stats = &ipc_stats_none; \
+	} \
+} while (0)
+
+/* A grown port without a block, and none left to give it */
+#define ipc_stats_needs_grow(port) \
+	((port)->stats == &ipc_stats_none && !ipc_stats_free)
+#else
+#define ipc_stats_grow()	0
+#define ipc_stats_attach(port)	do { } while (0)
+#define ipc_stats_detach(port)	do { } while (0)
+#define ipc_stats_needs_grow(port)	0
+#endif
+
+/**
+ * ipc_init - Initialize IPC subsystem
+ */
+void ipc_init(void)
+{
+	int i;
+	
+	printk("Initializing IPC subsystem...\n");
+	
+	ipc_caches_init();
+	
+	/*
+	 * The static chunks hold the low reserved ports and the first
+	 * dynamic ones; the reserved indices between them are the hole.
+	 */
+	ipc_nr_ports = 0;
+	ipc_port_free = NULL;
+	for (i = 0; i < IPC_PORT_CHUNK; i++)
+		ipc_port_setup(&ipc_port_hole[i], 0);
+	for (i = 0; i < IPC_PORT_BOOT; i += IPC_PORT_CHUNK) {
+		if (i == IPC_PORT_BOOT_LOW)
+			while (ipc_nr_ports < PORT_DYNAMIC_START)
+				ipc_port_add_hole();
+#if CONFIG_IPC_STATS
+		ipc_port_add_chunk(&ipc_port_boot[i], &ipc_stats_boot[i]);
+#else
+		ipc_port_add_chunk(&ipc_port_boot[i], NULL);
+#endif
+	}
+	
+	/* Set 0 is never used, so MK_PORT_SET(0) stays invalid */
+	for (i = 0; i < MAX_PORT_SETS; i++)
+		ipc_port_sets[i].flags = PORT_FLAG_FREE;
+	
+	for (i = 0; i < MAX_CHANNELS; i++)
+		ipc_channels[i].flags = PORT_FLAG_FREE;
+	
+	/* Initialize reserved ports (0 is invalid, 1-0xFF are system) */
+	for (i = PORT_RESERVED_START; i < IPC_PORT_BOOT_LOW; i++) {
+		ipc_port_at(i)->flags = PORT_FLAG_USED;
+		ipc_port_at(i)->owner = TASK_ID_KERNEL;
+		ipc_port_at(i)->required_caps = CAP_SYSTEM;
+	}
+	
+	for (i = 0; i < IPC_REPLY_HASH; i++)
+		ipc_reply_table[i].reply_port = 0;
+	for (i = 0; i < IPC_CREDIT_HASH; i++)
+		ipc_credit_table[i].port = 0;
+	
+	printk("IPC subsystem initialized (%d ports available)\n", 
+	       MAX_PORTS - PORT_RESERVED_END);
+}
+
+/**
+ * ipc_allocate_port - Allocate a new IPC port
+ * @owner: Owner task ID
+ * @caps: Required capabilities for access
+ * 
+ * Takes the first port off the free list, growing the table by a page
+ * when the list is empty, and a statistics block if it has none.
+ * Returns port name, or -1 on error.
+ */
+int ipc_allocate_port(unsigned int owner, capability_t caps)
+{
+	struct ipc_port *port;
+	
+	cli();	/* Disable interrupts during allocation */
+	
+	for (;;) {
+		port = ipc_port_free;
+		if (!port) {
+			sti();
+			if (ipc_port_grow() < 0)
+				return -1;
+		} else if (ipc_stats_needs_grow(port)) {
+			sti();
+			if (ipc_stats_grow() < 0)
+				return -1;
+		} else {
+			break;
+		}
+		cli();
+	}
+	
+	ipc_port_free = port->free_next;
+	port->free_next = NULL;
+	ipc_stats_attach(port);
+	
+	port->flags = PORT_FLAG_USED;
+	port->owner = owner;
+	port->required_caps = caps;
+	port->max_messages = MAX_MSG_QUEUE;
+	port->share = 0;
+	port->throttled = 0;
+	port->notify_bits = 0;
+	port->domain = 0;
+	port->ool_window = 0;
+	port->ool_linear = 0;
+	ipc_stats_reset(port);
+	
+	/* Receive-from-any goes through the owner's default set */
+	ipc_set_join(port, ipc_default_set(owner, 1));
+	
+	sti();
+	return port->port_id;
+}
+
+/**
+ * ipc_free_port - Tear down an allocated port
+ * @port: Port to free
+ * 
+ * A dynamic port moves to its next generation and back onto the free
+ * list, most recently freed first, while its page is still warm.
+ * Must be called with interrupts disabled.
+ */
+static void ipc_free_port(struct ipc_port *port)
+{
+	struct ipc_message *msg, *next;
+	unsigned int gen;
+	
+	/* Free all messages in queue */
+	msg = port->queue_head;
+	while (msg) {
+		next = msg->next;
+		if (msg->task)
+			ipc_credit_put(port, msg->task);
+		ipc_free_message(msg);
+		msg = next;
+	}
+	
+	/* Drop a message handed off but never picked up */
+	if (port->handoff) {
+		ipc_free_message(port->handoff);
+		port->handoff = NULL;
+	}
+	
+	port->queue_head = NULL;
+	port->queue_tail = NULL;
+	memset(port->prio_tail, 0, sizeof(port->prio_tail));
+	port->queue_count = 0;
+	port->notify_bits = 0;
+	port->server = NULL;
+	port->prio = -1;
+	ipc_set_join(port, -1);
+	
+	/* Mark port as free */
+	port->flags = PORT_FLAG_FREE;
+	port->owner = 0;
+	
+	if (IPC_PORT_INDEX(port->port_id) >= PORT_DYNAMIC_START) {
+		ipc_stats_detach(port);
+		gen = IPC_PORT_GEN(port->port_id) + 1;
+		if (gen > IPC_PORT_GEN_MASK)
+			gen = 1;
+		port->port_id = IPC_PORT_NAME(gen, IPC_PORT_INDEX(port->port_id));
+		port->free_next = ipc_port_free;
+		ipc_port_free = port;
+	} else {
+		ipc_space_revoke(port->port_id);
+	}
+	
+	/* Everybody blocked on it sees the port gone and fails */
+	ipc_wake_all(&port->recv_q);
+	ipc_wake_all(&port->send_q);
+	ipc_wake_all(&port->match_q);
+}
+
+/**
+ * ipc_deallocate_port - Deallocate an IPC port
+ * @port_id: Port to deallocate
+ * 
+ * Returns 0 on success, -1 on error.
+ */
+int ipc_deallocate_port(unsigned int port_id)
+{
+	struct ipc_port *port;
+	
+	cli();
+	
+	/* Check if port is allocated */
+	port = ipc_port_lookup(port_id);
+	if (!port || port->flags == PORT_FLAG_FREE) {
+		sti();
+		return -EINVAL;
+	}
+	
+	/* Check if caller is owner */
+	if (port->owner != kernel_state->current_task) {
+		sti();
+		return -EPERM;
+	}
+	
+	/* The private reply port goes away with the task */
+	if (port->port_id == current->reply_port) {
+		sti();
+		return -EPERM;
+	}
+	
+	ipc_free_port(port);
+	
+	sti();
+	return 0;
+}
+
+/**
+ * ipc_reply_port - Get the current task's private reply port
+ * 
+ * Stubs name this port as reply_port and receive on it, so a reply can
+ * only be dequeued by the task that made the request, and requests from
+ * different tasks can be outstanding at the same time. The port is
+ * allocated on first use and kept until the task is released. It stays
+ * out of the task's default port set, so a receive-from-any never
+ * consumes a reply meant for a stub.
+ * 
+ * Falls back to the shared kernel port before ipc_init() has run or if
+ * no port is left.
+ */
+unsigned int ipc_reply_port(void)
+{
+	int port;
+	
+	if (current->reply_port)
+		return current->reply_port;
+	
+	/* Port table not set up yet */
+	if (!ipc_nr_ports)
+		return kernel_state->kernel_port;
+	
+	port = ipc_allocate_port(kernel_state->current_task, CAP_NULL);
+	if (port < 0)
+		return kernel_state->kernel_port;
+	
+	cli();
+	ipc_set_join(ipc_port_lookup(port), -1);
+	sti();
+	
+	current->reply_port = port;
+	return port;
+}
+
+/**
+ * ipc_release_task - Drop the IPC state of a task
+ * @p: Task being released
+ * 
+ * Frees its private reply port and forgets it as the server of any
+ * port. Called from release(), by the parent, so the owner check of
+ * ipc_deallocate_port() does not apply.
+ */
+void ipc_release_task(struct task_struct *p)
+{
+	struct ipc_port *port;
+	unsigned int i;
+	
+	cli();
+	
+	for (i = 0; i < ipc_nr_ports; i++)
+		if (ipc_port_at(i)->server == p)
+			ipc_port_at(i)->server = NULL;
+	
+	port = p->reply_port ? ipc_port_lookup(p->reply_port) : NULL;
+	if (port && port->flags != PORT_FLAG_FREE)
+		ipc_free_port(port);
+	p->reply_port = 0;
+	
+	sti();
+	
+	/* Channels it opened, other than those shared by the kernel */
+	for (i = 0; i < MAX_CHANNELS; i++)
+		if (ipc_channels[i].flags != PORT_FLAG_FREE &&
+		    ipc_channels[i].owner == p->sched_nr &&
+		    p->sched_nr != TASK_ID_KERNEL)
+			ipc_channel_close(i);
+}
+
+/*=============================================================================
+ * PORT SPACES
+ *============================================================================*/
+
+/* Entry a port name maps to in a task's space */
+#define ipc_space_entry(task, name) \
+	(&ipc_spaces[(task)->port_space].entry[(name) & (IPC_SPACE_SIZE - 1)])
+
+/**
+ * ipc_space_init - Give a new task an empty port space
+ * @p: New task
+ * @nr: Its task slot
+ * 
+ * Called from copy_process(); rights are not inherited, the child
+ * derives its own on first use.
+ */
+void ipc_space_init(struct task_struct *p, int nr)
+{
+	p->port_space = nr;
+	memset(&ipc_spaces[nr], 0, sizeof(struct ipc_space));
+}
+
+/**
+ * ipc_space_fill - Derive a task's rights on a port and cache them
+ * @task: Task
+ * @port_id: Port name
+ * @need: IPC_RIGHT_* wanted, any one of them will do
+ * 
+ * The slow path of port_validate_access(). Only full names are cached;
+ * a bare index (generation 0) of a dynamic port is checked every time,
+ * since it does not pin the port it names. A pending send-once right is
+ * not evicted for a right that can be derived again.
+ * Returns 1 if access allowed, 0 otherwise.
+ */
+static int ipc_space_fill(struct task_struct *task, unsigned int port_id,
+                          unsigned int need)
+{
+	struct ipc_port *port;
+	struct ipc_entry *e;
+	unsigned int rights = 0;
+	
+	/* Free ports cannot be accessed, nor stale names used */
+	port = ipc_port_lookup(port_id);
+	if (!port || port->flags == PORT_FLAG_FREE)
+		return 0;
+	
+	/*
+	 * Owners are task slots, as ipc_allocate_port() records them. The
+	 * reserved ports belong to the kernel, and the system servers, which
+	 * hold CAP_SYSTEM, receive on them in its place.
+	 */
+	if (port->owner == task->sched_nr ||
+	    (port->owner == TASK_ID_KERNEL &&
+	     IPC_PORT_INDEX(port->port_id) < PORT_DYNAMIC_START &&
+	     (task->caps & CAP_SYSTEM)))
+		rights |= IPC_RIGHT_RECEIVE;
+	
+	/* Kernel can access any port; others need its caps and domain */
+	if (task->pid == TASK_ID_KERNEL ||
+	    ((task->caps & port->required_caps) == port->required_caps &&
+	     (port->domain == 0 || (task->caps & 0x0F) == port->domain)))
+		rights |= IPC_RIGHT_SEND;
+	
+	if (!rights)
+		return 0;
+	
+	if (port_id == port->port_id) {
+		e = ipc_space_entry(task, port_id);
+		if (e->name == port_id)
+			e->rights |= rights;
+		else if (!(e->rights & IPC_RIGHT_SEND_ONCE)) {
+			e->name = port_id;
+			e->rights = rights;
+		}
+	}
+	
+	return (rights & need) != 0;
+}
+
+/**
+ * port_validate_access - Check if task can access port
+ * @port_id: Port ID
+ * @task: Task attempting access
+ * @rights: IPC_RIGHT_SEND to send, IPC_RIGHT_RECEIVE to dequeue
+ * 
+ * One load from the task's own space when the right is cached. Any one
+ * of @rights will do; a send right never lets a task drain the port.
+ * Returns 1 if access allowed, 0 otherwise.
+ */
+static inline int port_validate_access(unsigned int port_id,
+                                       struct task_struct *task,
+                                       unsigned int rights)
+{
+	struct ipc_entry *e = ipc_space_entry(task, port_id);
+	
+	if (e->name == port_id && (e->rights & rights))
+		return 1;
+	
+	return ipc_space_fill(task, port_id, rights);
+}
+
+/**
+ * ipc_space_grant - Give a task a send-once right for a reply
+ * @task: Task that received a request
+ * @name: Reply port of the request
+ * 
+ * A send-once right pushed out by a newer one only means the reply
+ * falls back to the ordinary check.
+ */
+static void ipc_space_grant(struct task_struct *task, unsigned int name)
+{
+	struct ipc_port *port = ipc_port_lookup(name);
+	struct ipc_entry *e;
+	
+	if (!port || !name)
+		return;
+	
+	e = ipc_space_entry(task, port->port_id);
+	if (e->name != port->port_id) {
+		e->name = port->port_id;
+		e->rights = 0;
+	}
+	e->rights |= IPC_RIGHT_SEND_ONCE;
+}
+
+/**
+ * ipc_space_reply - Check a reply, using up a send-once right
+ * @task: Replying task
+ * @name: Reply port
+ * 
+ * Returns 1 if the reply may be sent, 0 otherwise.
+ */
+static int ipc_space_reply(struct task_struct *task, unsigned int name)
+{
+	struct ipc_entry *e = ipc_space_entry(task, name);
+	
+	if (e->name == name && (e->rights & IPC_RIGHT_SEND_ONCE)) {
+		e->rights &= ~IPC_RIGHT_SEND_ONCE;
+		return 1;
+	}
+	
+	return port_validate_access(name, task, IPC_RIGHT_SEND);
+}
+
+/**
+ * ipc_space_revoke - Drop every task's cached rights on a port
+ * @name: Port name
+ * 
+ * Needed only when a port changes without changing name: its caps or
+ * domain are set, or a reserved port is freed.
+ */
+static void ipc_space_revoke(unsigned int name)
+{
+	struct ipc_entry *e;
+	int i;
+	
+	for (i = 0; i < NR_TASKS; i++) {
+		e = &ipc_spaces[i].entry[name & (IPC_SPACE_SIZE - 1)];
+		if (e->name == name) {
+			e->name = 0;
+			e->rights = 0;
+		}
+	}
+}
+
+/*=============================================================================
+ * PRIORITY INHERITANCE
+ *============================================================================*/
+
+/**
+ * ipc_msg_prio - Queue level for a new message
+ * @flags: Send flags; MK_MSG_PRIO(level) picks the level explicitly
+ * @receiver: Destination port
+ * 
+ * Without an explicit level the port's MK_PORT_PRIO applies, so all
+ * traffic to the memory server counts as urgent and all log traffic as
+ * bulk. Failing that, the sender's scheduling priority decides.
+ */
+static unsigned int ipc_msg_prio(unsigned int flags, unsigned int receiver)
+{
+	struct ipc_port *port;
+	unsigned int level = (flags & MK_MSG_PRIO_MASK) >> MK_MSG_PRIO_SHIFT;
+	
+	if (level)
+		return level > IPC_NR_PRIO ? IPC_NR_PRIO - 1 : level - 1;
+	
+	port = ipc_port_lookup(receiver);
+	if (port && port->prio >= 0)
+		return port->prio;
+	
+	return IPC_PRIO_LEVEL(current->priority);
+}
+
+/**
+ * ipc_boost - Raise a server to the priority of a message it has to serve
+ * @p: Server task
+ * @level: Message level
+ * 
+ * The task's own priority is kept in ipc_base_priority until
+ * ipc_unboost() puts it back.
+ */
+static void ipc_boost(struct task_struct *p, unsigned int level)
+{
+	long prio = IPC_PRIO_FLOOR(level);
+	
+	if (p->priority >= prio)
+		return;
+	
+	if (!p->ipc_base_priority)
+		p->ipc_base_priority = p->priority;
+	sched_set_priority(p, prio);
+}
+
+/**
+ * ipc_unboost - Drop an inherited priority
+ * @p: Server task
+ */
+static inline void ipc_unboost(struct task_struct *p)
+{
+	if (p->ipc_base_priority) {
+		long prio = p->ipc_base_priority;
+		
+		p->ipc_base_priority = 0;
+		sched_set_priority(p, prio);
+	}
+}
+
+/**
+ * ipc_inherit - Run at the priority of the request being served
+ * @port: Port the request came from
+ * @msg: Request just taken
+ * 
+ * The receiver becomes the port's server: until it comes back to
+ * receive, it runs at least at the level of this request and of the
+ * best one still queued, and later arrivals raise it further in
+ * ipc_deliver_message(). Replies confer nothing.
+ * Must be called with interrupts disabled.
+ */
+static void ipc_inherit(struct ipc_port *port, struct ipc_message *msg)
+{
+	port->server = current;
+	
+	if (!(msg->flags & MSG_FLAG_REPLY))
+		ipc_boost(current, msg->prio);
+	if (port->queue_head)
+		ipc_boost(current, port->queue_head->prio);
+}
+
+/*=============================================================================
+ * MESSAGE QUEUE MANAGEMENT
+ *============================================================================*/
+
+/**
+ * ipc_alloc_message - Allocate a message with room for its data
+ * @msg_id: Message ID
+ * @sender: Sender port
+ * @receiver: Receiver port
+ * @type: Message type
+ * @size: Data size
+ * @flags: Message flags
+ * 
+ * The body, at IPC_MSG_DATA(), is left for the caller to fill.
+ * Returns pointer to new message, or NULL on error.
+ */
+static struct ipc_message *ipc_alloc_message(unsigned int msg_id,
+                                               unsigned int sender,
+                                               unsigned int receiver,
+                                               unsigned int type,
+                                               unsigned int size,
+                                               unsigned int flags)
+{
+	struct ipc_message *msg;
+	
+	if (size > MAX_MSG_SIZE)
+		return NULL;
+	
+	msg = (struct ipc_message *) ipc_cache_alloc(&ipc_msg_cache);
+	if (!msg)
+		return NULL;
+	
+	msg->msg_id = msg_id;
+	msg->sender = sender;
+	msg->receiver = receiver;
+	msg->type = type;
+	msg->size = size;
+	msg->flags = flags;
+	msg->ool_size = 0;
+	msg->prio = ipc_msg_prio(flags, receiver);
+	msg->seq = 0;
+	msg->task = current;
+	msg->next = NULL;
+	
+	/* Small data fits in message, large data gets a payload buffer */
+	if (size > IPC_INLINE_SIZE) {
+		msg->data[0] = (unsigned long) ipc_cache_alloc(ipc_data_cache_for(size));
+		if (!msg->data[0]) {
+			ipc_cache_free(&ipc_msg_cache, msg);
+			return NULL;
+		}
+	}
+	
+	return msg;
+}
+
+/**
+ * ipc_create_message - Create a new message
+ * @msg_id: Message ID
+ * @sender: Sender port
+ * @receiver: Receiver port
+ * @type: Message type
+ * @size: Data size
+ * @data: Data pointer
+ * @flags: Message flags
+ * 
+ * Returns pointer to new message, or NULL on error.
+ */
+static struct ipc_message *ipc_create_message(unsigned int msg_id,
+                                                unsigned int sender,
+                                                unsigned int receiver,
+                                                unsigned int type,
+                                                unsigned int size,
+                                                void *data,
+                                                unsigned int flags)
+{
+	struct ipc_message *msg;
+	
+	msg = ipc_alloc_message(msg_id, sender, receiver, type, size, flags);
+	if (msg)
+		memcpy(IPC_MSG_DATA(msg), data, size);
+	
+	return msg;
+}
+
+/**
+ * ipc_free_message - Free a message
+ * @msg: Message to free
+ */
+static void ipc_free_message(struct ipc_message *msg)
+{
+	if (!msg)
+		return;
+	
+	/* Free large data if allocated */
+	if (msg->size > IPC_INLINE_SIZE && msg->data[0])
+		ipc_cache_free(ipc_data_cache_for(msg->size), (void *)msg->data[0]);
+	
+	ipc_cache_free(&ipc_msg_cache, msg);
+}
+
+/**
+ * ipc_queue_message - Add message to port queue
+ * @port: Target port
+ * @msg: Message to queue
+ * 
+ * The message goes after the last one of its level, or of the nearest
+ * level above if its own is empty, so the queue stays ordered by level
+ * without being walked.
+ */
+static void ipc_queue_message(struct ipc_port *port, struct ipc_message *msg)
+{
+	struct ipc_message *after = NULL;
+	unsigned int level;
+	
+	for (level = msg->prio; level < IPC_NR_PRIO; level++)
+		if ((after = port->prio_tail[level]) != NULL)
+			break;
+	
+	if (after) {
+		msg->next = after->next;
+		after->next = msg;
+	} else {
+		msg->next = port->queue_head;
+		port->queue_head = msg;
+	}
+	
+	if (!msg->next)
+		port->queue_tail = msg;
+	port->prio_tail[msg->prio] = msg;
+	
+	port->queue_count++;
+	
+	if (msg->task && ipc_credit_get(port, msg->task) < 0)
+		msg->task = NULL;
+}
+
+/**
+ * ipc_unlink_message - Take a queued message out of the queue
+ * @port: Port
+ * @msg: Message
+ * @prev: Message before it, NULL if it is the head
+ */
+static void ipc_unlink_message(struct ipc_port *port, struct ipc_message *msg,
+                               struct ipc_message *prev)
+{
+	if (prev)
+		prev->next = msg->next;
+	else
+		port->queue_head = msg->next;
+	if (port->queue_tail == msg)
+		port->queue_tail = prev;
+	
+	/* The level's new last is prev, if prev is of the same level */
+	if (port->prio_tail[msg->prio] == msg)
+		port->prio_tail[msg->prio] =
+			(prev && prev->prio == msg->prio) ? prev : NULL;
+	
+	port->queue_count--;
+	
+	if (msg->task)
+		ipc_credit_put(port, msg->task);
+}
+
+/**
+ * ipc_dequeue_message - Remove message from port queue
+ * @port: Source port
+ * 
+ * Returns first message in queue, or NULL if empty.
+ */
+static struct ipc_message *ipc_dequeue_message(struct ipc_port *port)
+{
+	struct ipc_message *msg = port->queue_head;
+	
+	if (msg) {
+		ipc_unlink_message(port, msg, NULL);
+		if (!port->queue_head)
+			ipc_set_mark(port);
+	}
+	
+	return msg;
+}
+
+/**
+ * ipc_cancel_request - Withdraw a call the server has not taken yet
+ * @port: Port the request was sent to
+ * @msg: The request
+ * @seq: Sequence number of the call
+ * 
+ * Called with interrupts off when a call gives up waiting. The request
+ * is matched on its sequence number as well as its address, since a
+ * request that was already received may have been freed and the memory
+ * reused.
+ */
+static void ipc_cancel_request(struct ipc_port *port, struct ipc_message *msg,
+                               unsigned int seq)
+{
+	struct ipc_message *m, *prev = NULL;
+	
+	if (port->handoff == msg && msg->seq == seq) {
+		port->handoff = NULL;
+		ipc_set_mark(port);
+		ipc_free_message(msg);
+		return;
+	}
+	
+	for (m = port->queue_head; m; prev = m, m = m->next) {
+		if (m == msg && m->seq == seq) {
+			ipc_unlink_message(port, m, prev);
+			if (!port->queue_head)
+				ipc_set_mark(port);
+			ipc_free_message(m);
+			ipc_wakeup_sender(port);
+			return;
+		}
+	}
+}
+
+/* A blocked receiver will take the next message straight from handoff */
+#define ipc_can_handoff(port) \
+	((port)->recv_q.head && !(port)->handoff && !(port)->queue_head)
+
+/* No room for another message */
+#define ipc_port_full(port) \
+	(!ipc_can_handoff(port) && (port)->queue_count >= (port)->max_messages)
+
+/**
+ * ipc_deliver_message - Deliver message to a port
+ * @port: Target port
+ * @msg: Message to deliver
+ * 
+ * If a receiver is already blocked on the port and nothing is queued
+ * ahead of it, the message is handed straight to that receiver and the
+ * queue is bypassed. Otherwise the message is queued as usual, and the
+ * port's server inherits its priority while it works through the queue.
+ * Must be called with interrupts disabled.
+ * 
+ * Returns the receiver the message was handed to, or NULL if queued.
+ */
+static struct task_struct *ipc_deliver_message(struct ipc_port *port,
+                                               struct ipc_message *msg)
+{
+	struct task_struct *receiver = NULL;
+	
+	if (port->server && !(msg->flags & MSG_FLAG_REPLY))
+		ipc_boost(port->server, msg->prio);
+	
+	if (ipc_can_handoff(port)) {
+		receiver = port->recv_q.head->task;
+		msg->next = NULL;
+		port->handoff = msg;
+	} else {
+		ipc_queue_message(port, msg);
+	}
+	
+	ipc_stats_send(port, msg);
+	ipc_set_mark(port);
+	ipc_wakeup_receiver(port);
+	return receiver;
+}
+
+/**
+ * ipc_take_message - Take next message for a receiver
+ * @port: Source port
+ * 
+ * A handed-off message always precedes the queue, since it is only
+ * set while the queue is empty.
+ * Returns message, or NULL if none is pending.
+ */
+static struct ipc_message *ipc_take_message(struct ipc_port *port)
+{
+	struct ipc_message *msg = port->handoff;
+	
+	if (msg) {
+		port->handoff = NULL;
+		ipc_set_mark(port);
+	} else {
+		msg = ipc_dequeue_message(port);
+	}
+	
+	if (msg)
+		ipc_stats_recv(port, msg);
+	return msg;
+}
+
+/**
+ * ipc_match - Check a message against a receive filter
+ * @msg: Queued message
+ * @f: Filter
+ */
+static int ipc_match(struct ipc_message *msg, struct mk_msg_filter *f)
+{
+	if (msg->msg_id < f->msg_id_min || msg->msg_id > f->msg_id_max)
+		return 0;
+	if (f->sender && msg->sender != f->sender)
+		return 0;
+	if (f->id_offset) {
+		if (f->id_offset + sizeof(unsigned long) > msg->size)
+			return 0;
+		return *(unsigned long *)((char *)IPC_MSG_DATA(msg) + f->id_offset) ==
+		       f->id;
+	}
+	return 1;
+}
+
+/**
+ * ipc_take_match - Take the first queued message matching a filter
+ * @port: Source port
+ * @f: Filter
+ * 
+ * Messages ahead of the match keep their place. A handed-off message
+ * belongs to the plain receiver it was handed to and is not looked at.
+ * Returns message, or NULL if none matches.
+ */
+static struct ipc_message *ipc_take_match(struct ipc_port *port,
+                                          struct mk_msg_filter *f)
+{
+	struct ipc_message *msg, *prev = NULL;
+	
+	for (msg = port->queue_head; msg; prev = msg, msg = msg->next)
+		if (ipc_match(msg, f))
+			break;
+	
+	if (!msg)
+		return NULL;
+	
+	ipc_unlink_message(port, msg, prev);
+	ipc_stats_recv(port, msg);
+	
+	ipc_set_mark(port);
+	return msg;
+}
+
+/**
+ * ipc_map_ool - Map out-of-line pages into the receiver's window
+ * @msg: Message carrying an out-of-line payload
+ * 
+ * The pages are moved or shared by the memory server, so the payload is
+ * never copied. The descriptor in the message is rewritten to point at
+ * the window; it is left empty if the port has no window or the remap
+ * fails, and the message is still delivered.
+ */
+static void ipc_map_ool(struct ipc_message *msg)
+{
+	struct ipc_port *port = ipc_port_lookup(msg->receiver);
+	struct mk_msg_ool *ool = IPC_MSG_OOL(msg);
+	
+	ool->address = 0;
+	
+	/* MK_OOL_MOVE/SHARE are MEM_COPY_NONE/ON_WRITE */
+	if (port && port->ool_window &&
+	    !remap_pages(msg->ool_addr, port->ool_linear,
+	                 msg->ool_size, msg->ool_copy))
+		ool->address = port->ool_window;
+	else
+		ool->size = 0;
+	
+	msg->ool_size = 0;
+}
+
+/**
+ * ipc_get_iov - Fetch a user segment vector
+ * @iov: Kernel copy, room for MK_IOV_MAX segments
+ * @uiov: Vector (user space)
+ * @count: Number of segments
+ * 
+ * Returns total length of the segments, or -EINVAL.
+ */
+static int ipc_get_iov(struct mk_iovec *iov, struct mk_iovec *uiov,
+                       unsigned int count)
+{
+	unsigned int total = 0;
+	unsigned int i;
+	
+	if (!count || count > MK_IOV_MAX)
+		return -EINVAL;
+	
+	memcpy_from_fs(iov, uiov, count * sizeof(struct mk_iovec));
+	
+	for (i = 0; i < count; i++) {
+		if (iov[i].len > MAX_MSG_SIZE)
+			return -EINVAL;
+		total += iov[i].len;
+	}
+	
+	return total;
+}
+
+/**
+ * ipc_gather - Copy user segments into a message body
+ * @to: Message body, as large as the segments together
+ * @iov: Segments
+ * @count: Number of segments
+ */
+static void ipc_gather(char *to, struct mk_iovec *iov, unsigned int count)
+{
+	for (; count; iov++, count--) {
+		memcpy_from_fs(to, iov->base, iov->len);
+		to += iov->len;
+	}
+}
+
+/**
+ * ipc_scatter - Copy a message body out over user segments
+ * @iov: Segments
+ * @count: Number of segments
+ * @data: Message body
+ * @size: Its size, no more than the segments hold
+ */
+static void ipc_scatter(struct mk_iovec *iov, unsigned int count,
+                        char *data, unsigned int size)
+{
+	unsigned int n;
+	
+	for (; size && count; iov++, count--) {
+		n = iov->len < size ? iov->len : size;
+		memcpy_to_fs(iov->base, data, n);
+		data += n;
+		size -= n;
+	}
+}
+
+/**
+ * ipc_copy_outv - Copy a kernel message out over user segments
+ * @msg: Kernel message
+ * @iov: Segments
+ * @count: Number of segments
+ * @size_ptr: User pointer to size (receives actual size), or NULL
+ * @max_size: Total size of the segments
+ * 
+ * Returns number of bytes copied, or -ENOSPC if the segments are too small.
+ */
+static int ipc_copy_outv(struct ipc_message *msg, struct mk_iovec *iov,
+                         unsigned int count, unsigned int *size_ptr,
+                         unsigned int max_size)
+{
+	if (size_ptr)
+		put_fs_long(msg->size, (unsigned long *)size_ptr);
+	
+	if (msg->size > max_size)
+		return -ENOSPC;
+	
+	if (msg->ool_size)
+		ipc_map_ool(msg);
+	
+	ipc_scatter(iov, count, IPC_MSG_DATA(msg), msg->size);
+	
+	return msg->size;
+}
+
+/**
+ * ipc_copy_out - Copy a kernel message to a user buffer
+ * @msg: Kernel message
+ * @buf: User buffer
+ * @size_ptr: User pointer to size (receives actual size)
+ * @max_size: Size of user buffer
+ * 
+ * Returns number of bytes copied, or -ENOSPC if buffer is too small.
+ */
+static int ipc_copy_out(struct ipc_message *msg, void *buf,
+                        unsigned int *size_ptr, unsigned int max_size)
+{
+	struct mk_iovec iov;
+	
+	iov.base = buf;
+	iov.len = max_size;
+	return ipc_copy_outv(msg, &iov, 1, size_ptr, max_size);
+}
+
+/*=============================================================================
+ * WAIT QUEUE MANAGEMENT
+ *============================================================================*/
+
+/*
+ * Blocked senders and receivers queue up in FIFO order and every wakeup
+ * is for exactly one of them: a dequeued message frees room for one
+ * sender, a delivered message is work for one receiver. A woken task that
+ * finds the condition gone again (another task got there first) goes back
+ * to the head of the queue; one that gives up after being woken passes the
+ * wakeup on, so none is ever lost.
+ * All of these must be called with interrupts disabled.
+ */
+
+/**
+ * ipc_wait_init - Initialize an empty wait queue
+ * @q: Wait queue
+ */
+static void ipc_wait_init(struct ipc_wait_queue *q)
+{
+	q->head = NULL;
+	q->tail = NULL;
+}
+
+/**
+ * ipc_waiter_init - Prepare a waiter for the current task
+ * @w: Waiter on the caller's stack
+ */
+static inline void ipc_waiter_init(struct ipc_waiter *w)
+{
+	w->task = current;
+	w->next = NULL;
+	w->queued = 0;
+	w->woken = 0;
+}
+
+/**
+ * ipc_wait_add - Queue a waiter
+ * @q: Wait queue
+ * @w: Waiter not on any queue
+ * 
+ * A waiter that was already woken once keeps its turn at the head.
+ */
+static void ipc_wait_add(struct ipc_wait_queue *q, struct ipc_waiter *w)
+{
+	if (w->woken) {
+		w->next = q->head;
+		q->head = w;
+		if (!q->tail)
+			q->tail = w;
+	} else {
+		w->next = NULL;
+		if (q->tail)
+			q->tail->next = w;
+		else
+			q->head = w;
+		q->tail = w;
+	}
+	
+	w->queued = 1;
+}
+
+/**
+ * ipc_wait_del - Take a waiter off its queue
+ * @q: Wait queue
+ * @w: Waiter, queued or not
+ */
+static void ipc_wait_del(struct ipc_wait_queue *q, struct ipc_waiter *w)
+{
+	struct ipc_waiter **pp, *prev = NULL;
+	
+	if (!w->queued)
+		return;
+	
+	for (pp = &q->head; *pp; prev = *pp, pp = &(*pp)->next) {
+		if (*pp == w) {
+			*pp = w->next;
+			if (q->tail == w)
+				q->tail = prev;
+			break;
+		}
+	}
+	
+	w->queued = 0;
+}
+
+/**
+ * ipc_wake_one - Wake the first waiter of a queue
+ * @q: Wait queue
+ * 
+ * Returns 1 if a task was woken, 0 if the queue was empty.
+ */
+static int ipc_wake_one(struct ipc_wait_queue *q)
+{
+	struct ipc_waiter *w = q->head;
+	
+	if (!w)
+		return 0;
+	
+	q->head = w->next;
+	if (!q->head)
+		q->tail = NULL;
+	
+	w->queued = 0;
+	w->woken = 1;
+	wake_up_process(w->task);
+	return 1;
+}
+
+/**
+ * ipc_wake_all - Wake every waiter of a queue
+ * @q: Wait queue
+ */
+static void ipc_wake_all(struct ipc_wait_queue *q)
+{
+	while (ipc_wake_one(q))
+		;
+}
+
+/**
+ * ipc_block - Sleep on a wait queue once
+ * @q: Wait queue
+ * @w: Waiter of the current task
+ * @d: Deadline
+ * 
+ * The caller re-checks its condition after every return of 0.
+ * Returns 0 when woken, -EAGAIN once @d has run out; the waiter is off
+ * the queue in the latter case.
+ */
+static int ipc_block(struct ipc_wait_queue *q, struct ipc_waiter *w,
+                     struct ipc_deadline *d)
+{
+	if (!d->expired) {
+		if (!w->queued)
+			ipc_wait_add(q, w);
+		
+		current->state = TASK_INTERRUPTIBLE;
+		if (d->partner) {
+			struct task_struct *p = d->partner;
+			
+			d->partner = NULL;
+			schedule_to(p, d->partner_how);
+		} else {
+			schedule();
+		}
+		cli();
+		
+		if (!d->expired)
+			return 0;
+	}
+	
+	/* Giving up: a wakeup meant for us goes to the next in line */
+	if (w->queued)
+		ipc_wait_del(q, w);
+	else if (w->woken)
+		ipc_wake_one(q);
+	
+	return -EAGAIN;
+}
+
+/**
+ * ipc_wait_space - Wait until a port can take another message
+ * @port: Destination port
+ * @flags: MSG_FLAG_NONBLOCK to fail rather than wait
+ * @d: Deadline
+ * 
+ * A sender at its share of the port waits even if the queue has room,
+ * so the rest of the queue stays free for other senders.
+ * 
+ * Returns 0 when the message can be delivered, negative error code.
+ */
+static int ipc_wait_space(struct ipc_port *port, unsigned int flags,
+                          struct ipc_deadline *d)
+{
+	struct ipc_waiter w;
+	int result = 0;
+	
+	ipc_waiter_init(&w);
+	
+	for (;;) {
+		if (port->flags == PORT_FLAG_FREE) {
+			result = -EINVAL;
+			break;
+		}
+		if (ipc_throttled(port)) {
+			port->throttled++;
+			ipc_flow_stats.throttled++;
+		} else if (!ipc_port_full(port)) {
+			break;
+		}
+		if (flags & MSG_FLAG_NONBLOCK) {
+			IPC_STAT(port, eagains);
+			result = -EAGAIN;
+			break;
+		}
+		
+		IPC_STAT(port, blocks);
+		result = ipc_block(&port->send_q, &w, d);
+		if (result < 0) {
+			IPC_STAT(port, eagains);
+			return result;
+		}
+	}
+	
+	ipc_wait_del(&port->send_q, &w);
+	return result;
+}
+
+/**
+ * ipc_wait_message - Wait until a port has a message
+ * @port: Source port
+ * @flags: MSG_FLAG_NONBLOCK to fail rather than wait, MSG_FLAG_NOTIFY
+ *         to also return on pending notification bits
+ * @d: Deadline
+ * 
+ * Returns 0 when a message is pending, negative error code.
+ */
+static int ipc_wait_message(struct ipc_port *port, unsigned int flags,
+                            struct ipc_deadline *d)
+{
+	struct ipc_waiter w;
+	int result = 0;
+	
+	ipc_waiter_init(&w);
+	
+	for (;;) {
+		if (port->flags == PORT_FLAG_FREE) {
+			result = -EINVAL;
+			break;
+		}
+		if (port->handoff || port->queue_head)
+			break;
+		if ((flags & MSG_FLAG_NOTIFY) && port->notify_bits)
+			break;
+		if (flags & MSG_FLAG_NONBLOCK) {
+			IPC_STAT(port, eagains);
+			result = -EAGAIN;
+			break;
+		}
+		
+		IPC_STAT(port, blocks);
+		result = ipc_block(&port->recv_q, &w, d);
+		if (result < 0) {
+			IPC_STAT(port, eagains);
+			return result;
+		}
+	}
+	
+	ipc_wait_del(&port->recv_q, &w);
+	return result;
+}
+
+/**
+ * ipc_wait_match - Wait for a message matching a filter and take it
+ * @port: Source port
+ * @f: Filter
+ * @flags: MSG_FLAG_NONBLOCK to fail rather than wait
+ * @d: Deadline
+ * @msgp: Set to the message taken
+ * 
+ * Selective receivers sleep on match_q, apart from plain receivers, and
+ * every delivery wakes all of them to rescan. Handoff only goes to
+ * recv_q, so a message never gets stuck with a receiver that does not
+ * want it.
+ * Returns 0 with *msgp set, negative error code.
+ */
+static int ipc_wait_match(struct ipc_port *port, struct mk_msg_filter *f,
+                          unsigned int flags, struct ipc_deadline *d,
+                          struct ipc_message **msgp)
+{
+	struct ipc_waiter w;
+	int result = 0;
+	
+	ipc_waiter_init(&w);
+	
+	for (;;) {
+		if (port->flags == PORT_FLAG_FREE) {
+			result = -EINVAL;
+			break;
+		}
+		if ((*msgp = ipc_take_match(port, f)) != NULL)
+			break;
+		if (flags & MSG_FLAG_NONBLOCK) {
+			IPC_STAT(port, eagains);
+			result = -EAGAIN;
+			break;
+		}
+		
+		IPC_STAT(port, blocks);
+		result = ipc_block(&port->match_q, &w, d);
+		if (result < 0) {
+			IPC_STAT(port, eagains);
+			return result;
+		}
+	}
+	
+	ipc_wait_del(&port->match_q, &w);
+	return result;
+}
+
+/**
+ * ipc_wakeup_sender - Wake up task waiting to send
+ * @port: Port with available queue space
+ * 
+ * With per-sender shares the first waiter may be one still over its
+ * share, so they all get to check.
+ */
+static void ipc_wakeup_sender(struct ipc_port *port)
+{
+	if (port->share)
+		ipc_wake_all(&port->send_q);
+	else
+		ipc_wake_one(&port->send_q);
+}
+
+/**
+ * ipc_wakeup_receiver - Wake up task waiting to receive
+ * @port: Port with available message
+ * 
+ * A task blocked on the port itself comes first; only if there is none
+ * does one blocked on the port's set get the message. Selective
+ * receivers are all woken to check it against their filters.
+ */
+static void ipc_wakeup_receiver(struct ipc_port *port)
+{
+	ipc_wake_all(&port->match_q);
+	
+	if (ipc_wake_one(&port->recv_q))
+		return;
+	
+	if (port->set >= 0)
+		ipc_wake_one(&ipc_port_sets[port->set].recv_q);
+}
+
+/*=============================================================================
+ * REPLY TRACKING
+ *============================================================================*/
+
+/**
+ * ipc_reply_hash - Home slot of a (request, reply port) pair
+ */
+static inline unsigned int ipc_reply_hash(unsigned int request_id,
+                                          unsigned int reply_port)
+{
+	return ((request_id ^ (reply_port << 16)) * 2654435761U) >>
+	       (32 - IPC_REPLY_HASH_BITS);
+}
+
+/**
+ * ipc_reply_probed - Account for one insert or removal
+ * @probes: Slots examined
+ */
+static inline void ipc_reply_probed(unsigned int probes)
+{
+	ipc_reply_stats.lookups++;
+	ipc_reply_stats.probes += probes;
+	if (probes > ipc_reply_stats.max_probe)
+		ipc_reply_stats.max_probe = probes;
+}
+
+/**
+ * ipc_reply_remove - Empty a slot of the reply table
+ * @slot: Occupied slot
+ * 
+ * Entries further along the same probe run are shifted back into the
+ * hole, so lookups never need tombstones.
+ * Must be called with interrupts disabled.
+ */
+static void ipc_reply_remove(unsigned int slot)
+{
+	unsigned int next, home;
+	
+	for (;;) {
+		ipc_reply_table[slot].reply_port = 0;
+		next = slot;
+		
+		for (;;) {
+			next = (next + 1) & (IPC_REPLY_HASH - 1);
+			if (!ipc_reply_table[next].reply_port) {
+				ipc_reply_stats.used--;
+				return;
+			}
+			
+			/* Move it back unless its home lies in (slot, next] */
+			home = ipc_reply_hash(ipc_reply_table[next].request_id,
+			                      ipc_reply_table[next].reply_port);
+			if (((next - home) & (IPC_REPLY_HASH - 1)) >=
+			    ((next - slot) & (IPC_REPLY_HASH - 1)))
+				break;
+		}
+		
+		ipc_reply_table[slot] = ipc_reply_table[next];
+		slot = next;
+	}
+}
+
+/**
+ * ipc_add_reply - Track pending reply
+ * @request_id: Request message ID
+ * @reply_port: Port to send reply to
+ * @task: Task waiting for reply
+ * @seq: Call the request belongs to, 0 for a plain request
+ * 
+ * Returns 0 on success, -1 on error.
+ */
+static int ipc_add_reply(unsigned int request_id, unsigned int reply_port,
+                          struct task_struct *task, unsigned int seq)
+{
+	struct ipc_reply *reply;
+	unsigned long flags;
+	unsigned int slot, probes = 1;
+	
+	if (!reply_port)
+		return -1;
+	
+	save_flags(flags);
+	cli();
+	
+	slot = ipc_reply_hash(request_id, reply_port);
+	while (ipc_reply_table[slot].reply_port &&
+	       (ipc_reply_table[slot].request_id != request_id ||
+	        ipc_reply_table[slot].reply_port != reply_port ||
+	        ipc_reply_table[slot].seq != seq)) {
+		slot = (slot + 1) & (IPC_REPLY_HASH - 1);
+		probes++;
+	}
+	
+	reply = &ipc_reply_table[slot];
+	if (!reply->reply_port) {
+		if (ipc_reply_stats.used >= IPC_REPLY_MAX) {
+			ipc_reply_stats.overflows++;
+			restore_flags(flags);
+			return -1;
+		}
+		if (++ipc_reply_stats.used > ipc_reply_stats.high_water)
+			ipc_reply_stats.high_water = ipc_reply_stats.used;
+	}
+	
+	/*
+	 * A repeated plain request just refreshes its entry. Every call has
+	 * its own, behind any older one of the same type on the probe run.
+	 */
+	reply->request_id = request_id;
+	reply->reply_port = reply_port;
+	reply->seq = seq;
+	reply->waiting_task = task;
+	
+	ipc_reply_probed(probes);
+	restore_flags(flags);
+	return 0;
+}
+
+/**
+ * ipc_find_reply - Find and remove a pending reply
+ * @request_id: Request ID to find
+ * @reply_port: Port the reply goes to
+ * @out: Receives the entry, seq 0 if there is none
+ * 
+ * Takes the oldest entry, the request the server received first.
+ * Returns 0 if found, -1 otherwise.
+ */
+static int ipc_find_reply(unsigned int request_id, unsigned int reply_port,
+                          struct ipc_reply *out)
+{
+	unsigned long flags;
+	unsigned int slot, probes = 1;
+	int result = -1;
+	
+	out->seq = 0;
+	
+	save_flags(flags);
+	cli();
+	
+	slot = ipc_reply_hash(request_id, reply_port);
+	while (ipc_reply_table[slot].reply_port) {
+		if (ipc_reply_table[slot].request_id == request_id &&
+		    ipc_reply_table[slot].reply_port == reply_port) {
+			*out = ipc_reply_table[slot];
+			ipc_reply_remove(slot);
+			result = 0;
+			break;
+		}
+		slot = (slot + 1) & (IPC_REPLY_HASH - 1);
+		probes++;
+	}
+	
+	ipc_reply_probed(probes);
+	restore_flags(flags);
+	return result;
+}
+
+/*=============================================================================
+ * FLOW CONTROL
+ *============================================================================*/
+
+/**
+ * ipc_credit_hash - Home slot of a (port, sender) pair
+ */
+static inline unsigned int ipc_credit_hash(struct ipc_port *port,
+                                           struct task_struct *task)
+{
+	return ((port->port_id ^ ((unsigned long) task >> 12 << 8)) *
+	        2654435761U) >> (32 - IPC_CREDIT_HASH_BITS);
+}
+
+/**
+ * ipc_credit_slot - Find the slot of a (port, sender) pair
+ * @port: Port
+ * @task: Sender
+ * 
+ * Returns the pair's slot, or the free slot that ends its probe run.
+ */
+static unsigned int ipc_credit_slot(struct ipc_port *port,
+                                    struct task_struct *task)
+{
+	unsigned int slot = ipc_credit_hash(port, task);
+	
+	while (ipc_credit_table[slot].port &&
+	       (ipc_credit_table[slot].port != port->port_id ||
+	        ipc_credit_table[slot].task != task))
+		slot = (slot + 1) & (IPC_CREDIT_HASH - 1);
+	
+	return slot;
+}
+
+/**
+ * ipc_credit_remove - Empty a slot of the credit table
+ * @slot: Occupied slot
+ * 
+ * Same backward shift as ipc_reply_remove().
+ */
+static void ipc_credit_remove(unsigned int slot)
+{
+	struct ipc_credit *c;
+	unsigned int next, home;
+	
+	for (;;) {
+		ipc_credit_table[slot].port = 0;
+		next = slot;
+		
+		for (;;) {
+			next = (next + 1) & (IPC_CREDIT_HASH - 1);
+			c = &ipc_credit_table[next];
+			if (!c->port) {
+				ipc_flow_stats.used--;
+				return;
+			}
+			
+			home = ipc_credit_hash(ipc_port_lookup(c->port), c->task);
+			if (((next - home) & (IPC_CREDIT_HASH - 1)) >=
+			    ((next - slot) & (IPC_CREDIT_HASH - 1)))
+				break;
+		}
+		
+		ipc_credit_table[slot] = *c;
+		slot = next;
+	}
+}
+
+/**
+ * ipc_credit_get - Charge a queued message to its sender
+ * @port: Port it was queued on
+ * @task: Sender
+ * 
+ * Returns 0, or -1 if the table is full and the message goes uncharged.
+ * Must be called with interrupts disabled.
+ */
+static int ipc_credit_get(struct ipc_port *port, struct task_struct *task)
+{
+	struct ipc_credit *c = &ipc_credit_table[ipc_credit_slot(port, task)];
+	
+	if (!c->port) {
+		if (ipc_flow_stats.used >= IPC_CREDIT_MAX) {
+			ipc_flow_stats.overflows++;
+			return -1;
+		}
+		if (++ipc_flow_stats.used > ipc_flow_stats.high_water)
+			ipc_flow_stats.high_water = ipc_flow_stats.used;
+		c->port = port->port_id;
+		c->task = task;
+		c->queued = 0;
+	}
+	
+	c->queued++;
+	return 0;
+}
+
+/**
+ * ipc_credit_put - Give back the credit of a message leaving the queue
+ * @port: Port
+ * @task: Sender it was charged to
+ * 
+ * Must be called with interrupts disabled.
+ */
+static void ipc_credit_put(struct ipc_port *port, struct task_struct *task)
+{
+	unsigned int slot = ipc_credit_slot(port, task);
+	
+	if (ipc_credit_table[slot].port && !--ipc_credit_table[slot].queued)
+		ipc_credit_remove(slot);
+}
+
+/**
+ * ipc_throttled - Check whether the current task is at its share of a port
+ * @port: Destination port
+ * 
+ * Must be called with interrupts disabled.
+ */
+static int ipc_throttled(struct ipc_port *port)
+{
+	struct ipc_credit *c;
+	
+	if (!port->share)
+		return 0;
+	
+	c = &ipc_credit_table[ipc_credit_slot(port, current)];
+	return c->port && c->queued >= port->share;
+}
+
+/*=============================================================================
+ * NOTIFICATIONS
+ *============================================================================*/
+
+/**
+ * ipc_notify - Raise notification bits on a port
+ * @port_id: Port
+ * @bits: Bits to set
+ * 
+ * Bits are ORed into the port and stay there until a receiver takes
+ * them as one MK_MSG_NOTIFY, so repeated events coalesce and nothing
+ * is allocated or queued. Safe to call from interrupt handlers.
+ * Returns 0 on success, negative error code.
+ */
+int ipc_notify(unsigned int port_id, unsigned long bits)
+{
+	struct ipc_port *port;
+	unsigned long flags;
+	
+	if (!port_id || !bits)
+		return -EINVAL;
+	
+	save_flags(flags);
+	cli();
+	
+	port = ipc_port_lookup(port_id);
+	if (!port || port->flags == PORT_FLAG_FREE) {
+		restore_flags(flags);
+		return -EINVAL;
+	}
+	
+	port->notify_bits |= bits;
+	ipc_set_mark(port);
+	ipc_wakeup_receiver(port);
+	
+	restore_flags(flags);
+	return 0;
+}
+
+/**
+ * ipc_take_notify - Take a port's pending notification bits
+ * @port: Port
+ * 
+ * If a message is still waiting behind the bits, the next receiver is
+ * woken for it, since the one taking the bits may have used up its
+ * wakeup. Must be called with interrupts disabled.
+ * Returns the bits.
+ */
+static unsigned long ipc_take_notify(struct ipc_port *port)
+{
+	unsigned long bits = port->notify_bits;
+	
+	port->notify_bits = 0;
+	ipc_set_mark(port);
+	
+	if (port->handoff || port->queue_head)
+		ipc_wakeup_receiver(port);
+	
+	return bits;
+}
+
+/**
+ * ipc_copy_notify - Copy out notification bits as a message
+ * @port: Port the bits were raised on
+ * @bits: Bits, from ipc_take_notify
+ * @iov: User segments
+ * @count: Number of segments
+ * @size_ptr: User pointer to size (receives actual size), or NULL
+ * @max_size: Total size of the segments
+ * 
+ * Returns number of bytes copied, or -ENOSPC if the segments are too small.
+ */
+static int ipc_copy_notify(struct ipc_port *port, unsigned long bits,
+                           struct mk_iovec *iov, unsigned int count,
+                           unsigned int *size_ptr, unsigned int max_size)
+{
+	struct mk_msg_notify notify;
+	
+	if (size_ptr)
+		put_fs_long(sizeof(notify), (unsigned long *)size_ptr);
+	
+	if (sizeof(notify) > max_size)
+		return -ENOSPC;
+	
+	notify.header.msg_id = MK_MSG_NOTIFY;
+	notify.header.sender_port = 0;
+	notify.header.reply_port = 0;
+	notify.header.size = sizeof(notify);
+	notify.port = port->port_id;
+	notify.bits = bits;
+	ipc_scatter(iov, count, (char *) &notify, sizeof(notify));
+	
+	return sizeof(notify);
+}
+
+/*=============================================================================
+ * DEADLINES
+ *============================================================================*/
+
+/**
+ * ipc_deadline_expired - Timer handler of an ipc_deadline
+ * @data: The deadline
+ */
+static void ipc_deadline_expired(unsigned long data)
+{
+	struct ipc_deadline *d = (struct ipc_deadline *) data;
+	
+	d->expired = 1;
+	if (d->task)
+		wake_up_process(d->task);
+}
+
+/**
+ * ipc_deadline_start - Arm the current task's IPC timeout
+ * @d: Deadline on the caller's stack
+ * 
+ * current->ipc_timeout is in jiffies; 0 waits forever and arms nothing.
+ */
+static void ipc_deadline_start(struct ipc_deadline *d)
+{
+	d->task = current;
+	d->expired = 0;
+	d->partner = NULL;
+	init_timer(&d->timer, ipc_deadline_expired, (unsigned long) d);
+	if (current->ipc_timeout)
+		mod_timer(&d->timer, jiffies + current->ipc_timeout);
+}
+
+/**
+ * ipc_deadline_stop - Disarm a deadline before it goes out of scope
+ * @d: Deadline
+ */
+static inline void ipc_deadline_stop(struct ipc_deadline *d)
+{
+	del_timer(&d->timer);
+}
+
+/*=============================================================================
+ * CORE IPC OPERATIONS
+ *============================================================================*/
+
+/*
+ * A reply ends the call it answers: the caller, which owns the reply
+ * port, gets back what is left of the timeslice it lent us.
+ */
+static inline void ipc_return_loan(struct ipc_port *reply_port)
+{
+	if (current->donor && current->donor->sched_nr == reply_port->owner)
+		sched_return_loan(current->donor);
+}
+
+/**
+ * ipc_send - Deliver a message, waiting for room
+ * @dest_port: Destination port
+ * @kernel_msg: Message, freed here if it cannot be delivered
+ * @flags: Send flags (blocking/non-blocking)
+ * 
+ * Returns 0 on success, negative error code on failure.
+ */
+static int ipc_send(struct ipc_port *dest_port, struct ipc_message *kernel_msg,
+                    unsigned int flags)
+{
+	struct ipc_deadline deadline;
+	struct ipc_reply pending;
+	int result;
+	
+	/* A reply sent as a plain message answers its request all the same */
+	if (flags & MSG_FLAG_REPLY) {
+		ipc_find_reply(kernel_msg->msg_id, kernel_msg->receiver, &pending);
+		kernel_msg->seq = pending.seq;
+	}
+	
+	ipc_deadline_start(&deadline);
+	
+	cli();
+	
+	/* Block until space available */
+	result = ipc_wait_space(dest_port, flags, &deadline);
+	if (result < 0) {
+		sti();
+		ipc_deadline_stop(&deadline);
+		ipc_free_message(kernel_msg);
+		return result;
+	}
+	
+	/* Queue the message (or hand it to a blocked receiver) */
+	ipc_deliver_message(dest_port, kernel_msg);
+	if (flags & MSG_FLAG_REPLY)
+		ipc_return_loan(dest_port);
+	
+	sti();
+	ipc_deadline_stop(&deadline);
+	
+	return 0;
+}
+
+/**
+ * sys_ipc_send - Send an IPC message
+ * @port: Destination port
+ * @msg: Message pointer (in user space)
+ * @size: Message size
+ * @flags: Send flags (blocking/non-blocking)
+ * 
+ * A full port blocks the sender in FIFO order behind earlier senders,
+ * for at most current->ipc_timeout jiffies if that is set (-EAGAIN).
+ * 
+ * Returns 0 on success, negative error code on failure.
+ */
+int sys_ipc_send(unsigned int port, void *msg, unsigned int size, unsigned int flags)
+{
+	struct ipc_port *dest_port;
+	struct ipc_message *kernel_msg;
+	struct mk_msg_header user_header;
+	unsigned int msg_size;
+	
+	/* Validate port */
+	dest_port = ipc_port_lookup(port);
+	if (!dest_port)
+		return -EINVAL;
+	
+	/* Validate access; a reply may use the send-once right */
+	if ((flags & MSG_FLAG_REPLY) ?
+	    !ipc_space_reply(current, port) :
+	    !port_validate_access(port, current, IPC_RIGHT_SEND))
+		return -EPERM;
+	
+	/* Copy message header from user space */
+	memcpy_from_fs(&user_header, msg, sizeof(struct mk_msg_header));
+	
+	msg_size = user_header.size;
+	
+	if (msg_size > MAX_MSG_SIZE)
+		return -EINVAL;
+	
+	/* Create kernel message */
+	kernel_msg = ipc_create_message(user_header.msg_id,
+	                                 user_header.sender_port,
+	                                 port,
+	                                 0,
+	                                 msg_size,
+	                                 msg,
+	                                 flags);
+	
+	if (!kernel_msg)
+		return -EAGAIN;
+	
+	return ipc_send(dest_port, kernel_msg, flags);
+}
+
+/**
+ * sys_ipc_sendv - Send an IPC message gathered from segments
+ * @port: Destination port
+ * @iov: Segment vector (user space); the header opens the first segment
+ * @count: Number of segments, at most MK_IOV_MAX
+ * @flags: Send flags (blocking/non-blocking)
+ * 
+ * Like sys_ipc_send, but each segment is copied straight into the
+ * message body, so a header and a payload kept apart by the caller need
+ * no assembly first. The header's size is set to the total.
+ * 
+ * Returns 0 on success, negative error code on failure.
+ */
+int sys_ipc_sendv(unsigned int port, struct mk_iovec *iov, unsigned int count,
+                  unsigned int flags)
+{
+	struct ipc_port *dest_port;
+	struct ipc_message *kernel_msg;
+	struct mk_msg_header *header;
+	struct mk_iovec segs[MK_IOV_MAX];
+	int size;
+	
+	dest_port = ipc_port_lookup(port);
+	if (!dest_port)
+		return -EINVAL;
+	
+	if ((flags & MSG_FLAG_REPLY) ?
+	    !ipc_space_reply(current, port) :
+	    !port_validate_access(port, current, IPC_RIGHT_SEND))
+		return -EPERM;
+	
+	size = ipc_get_iov(segs, iov, count);
+	if (size < 0)
+		return size;
+	if (size > MAX_MSG_SIZE || segs[0].len < sizeof(struct mk_msg_header))
+		return -EINVAL;
+	
+	kernel_msg = ipc_alloc_message(0, 0, port, 0, size, flags);
+	if (!kernel_msg)
+		return -EAGAIN;
+	
+	header = (struct mk_msg_header *) IPC_MSG_DATA(kernel_msg);
+	ipc_gather((char *) header, segs, count);
+	header->size = size;
+	kernel_msg->msg_id = header->msg_id;
+	kernel_msg->sender = header->sender_port;
+	
+	return ipc_send(dest_port, kernel_msg, flags);
+}
+
+/**
+ * ipc_receive - Wait for a message and copy it out over user segments
+ * @port: Source port, port set, or 0 for any
+ * @iov: Segments (kernel copy)
+ * @count: Number of segments
+ * @size_ptr: User pointer to size (receives actual size), or NULL
+ * @max_size: Total size of the segments
+ * @flags: Receive flags (blocking/non-blocking)
+ * @partner: Client just replied to, switched to if we block, or NULL
+ * 
+ * Returns number of bytes received, or negative error code.
+ */
+static int ipc_receive(unsigned int port, struct mk_iovec *iov,
+                       unsigned int count, unsigned int *size_ptr,
+                       unsigned int max_size, unsigned int flags,
+                       struct task_struct *partner)
+{
+	struct ipc_port *src_port = NULL;
+	struct ipc_port_set *set = NULL;
+	struct ipc_message *kernel_msg;
+	struct ipc_deadline deadline;
+	struct ipc_waiter w;
+	unsigned long bits = 0;
+	int result = 0;
+	int i;
+	
+	/* Back to receive: whatever was inherited has been served */
+	ipc_unboost(current);
+	
+	if (port & MK_PORT_SET_FLAG) {
+		/* Receive from an explicit port set */
+		i = port & ~MK_PORT_SET_FLAG;
+		if (!i || i >= MAX_PORT_SETS)
+			return -EINVAL;
+		
+		set = &ipc_port_sets[i];
+		if (set->flags == PORT_FLAG_FREE)
+			return -EINVAL;
+		if (set->owner != kernel_state->current_task)
+			return -EPERM;
+		port = 0;
+	} else if (port) {
+		/* Receive from specific port */
+		src_port = ipc_port_lookup(port);
+		if (!src_port)
+			return -EINVAL;
+		
+		if (!port_validate_access(port, current, IPC_RIGHT_RECEIVE))
+			return -EPERM;
+	}
+	
+	ipc_deadline_start(&deadline);
+	deadline.partner = partner;
+	deadline.partner_how = SCHED_TO_REPLY;
+	
+	cli();
+	
+	if (port) {
+		/* Block until message arrives */
+		result = ipc_wait_message(src_port, flags | MSG_FLAG_NOTIFY,
+		                          &deadline);
+		if (result < 0)
+			goto out;
+	} else {
+		/* Receive from a port set; port 0 means all ports we own */
+		if (!set) {
+			i = ipc_default_set(kernel_state->current_task, 0);
+			if (i < 0) {
+				result = -EINVAL;
+				goto out;
+			}
+			set = &ipc_port_sets[i];
+		}
+		
+		ipc_waiter_init(&w);
+		
+		/* Block until a member port gets a message */
+		while (!(src_port = ipc_set_first(set))) {
+			if (set->flags == PORT_FLAG_FREE)
+				result = -EINVAL;
+			else if (flags & MSG_FLAG_NONBLOCK)
+				result = -EAGAIN;
+			else
+				result = ipc_block(&set->recv_q, &w, &deadline);
+			
+			if (result < 0) {
+				ipc_wait_del(&set->recv_q, &w);
+				goto out;
+			}
+		}
+		
+		ipc_wait_del(&set->recv_q, &w);
+	}
+	
+	/* A partner we did not sleep for just waits its turn */
+	if (src_port->notify_bits) {
+		/* Bits go first; a buffer too small for them leaves them set */
+		if (max_size >= sizeof(struct mk_msg_notify))
+			bits = ipc_take_notify(src_port);
+		sti();
+		ipc_deadline_stop(&deadline);
+		return ipc_copy_notify(src_port, bits, iov, count, size_ptr,
+		                       max_size);
+	}
+	
+	kernel_msg = ipc_take_message(src_port);
+	ipc_inherit(src_port, kernel_msg);
+	
+	/* Wake up any waiting sender */
+	ipc_wakeup_sender(src_port);
+	
+	sti();
+	ipc_deadline_stop(&deadline);
+	
+	/* Copy message to user space */
+	result = ipc_copy_outv(kernel_msg, iov, count, size_ptr, max_size);
+	
+	/* Handle replies */
+	if (kernel_msg->flags & MSG_FLAG_REQUEST) {
+		ipc_add_reply(kernel_msg->msg_id, kernel_msg->sender, NULL,
+		              kernel_msg->seq);
+		ipc_space_grant(current, kernel_msg->sender);
+	}
+	
+	ipc_free_message(kernel_msg);
+	
+	return result;
+
+out:
+	sti();
+	ipc_deadline_stop(&deadline);
+	return result;
+}
+
+/**
+ * sys_ipc_receive - Receive an IPC message
+ * @port: Source port (0 for any)
+ * @msg: Buffer for message (user space)
+ * @size_ptr: Pointer to message size (input/output)
+ * @flags: Receive flags (blocking/non-blocking)
+ * 
+ * Receivers wait in FIFO order and each message wakes one of them. The
+ * wait is bounded by current->ipc_timeout like in sys_ipc_send.
+ * Notification bits pending on the port are returned first, as a
+ * struct mk_msg_notify built on the spot.
+ * 
+ * Returns number of bytes received, or negative error code.
+ */
+int sys_ipc_receive(unsigned int port, void *msg, unsigned int *size_ptr, unsigned int flags)
+{
+	struct mk_iovec iov;
+	
+	/* Get maximum buffer size from user */
+	iov.base = msg;
+	iov.len = get_fs_long((unsigned long *)size_ptr);
+	
+	return ipc_receive(port, &iov, 1, size_ptr, iov.len, flags, NULL);
+}
+
+/**
+ * sys_ipc_receivev - Receive an IPC message into segments
+ * @port: Source port (0 for any)
+ * @iov: Segment vector (user space)
+ * @count: Number of segments, at most MK_IOV_MAX
+ * @flags: Receive flags (blocking/non-blocking)
+ * 
+ * Like sys_ipc_receive, but the message is scattered over the segments
+ * in order, e.g. the header into one buffer and the body into another.
+ * 
+ * Returns number of bytes received, or negative error code (-ENOSPC if
+ * the message is larger than the segments together).
+ */
+int sys_ipc_receivev(unsigned int port, struct mk_iovec *iov,
+                     unsigned int count, unsigned int flags)
+{
+	struct mk_iovec segs[MK_IOV_MAX];
+	int size;
+	
+	size = ipc_get_iov(segs, iov, count);
+	if (size < 0)
+		return size;
+	
+	return ipc_receive(port, segs, count, NULL, size, flags, NULL);
+}
+
+/**
+ * sys_ipc_receive_match - Receive the first message matching a filter
+ * @port: Source port (a single port, not a set)
+ * @msg: Buffer for message (user space)
+ * @size_ptr: Pointer to message size (input/output)
+ * @filter: struct mk_msg_filter (user space)
+ * @flags: Receive flags (blocking/non-blocking)
+ * 
+ * Like sys_ipc_receive, but messages that do not match stay queued in
+ * their order for later receives. Lets a task wait for one particular
+ * reply while others arrive out of order.
+ * 
+ * Returns number of bytes received, or negative error code.
+ */
+int sys_ipc_receive_match(unsigned int port, void *msg, unsigned int *size_ptr,
+                          struct mk_msg_filter *filter, unsigned int flags)
+{
+	struct ipc_port *src_port;
+	struct ipc_message *kernel_msg;
+	struct mk_msg_filter f;
+	struct ipc_deadline deadline;
+	unsigned int max_size;
+	int result;
+	
+	src_port = ipc_port_lookup(port);
+	if (!port || !src_port)
+		return -EINVAL;
+	
+	if (!port_validate_access(port, current, IPC_RIGHT_RECEIVE))
+		return -EPERM;
+	
+	memcpy_from_fs(&f, filter, sizeof(f));
+	
+	/* The id must be a whole word past the header */
+	if (f.id_offset && (f.id_offset < sizeof(struct mk_msg_header) ||
+	                    (f.id_offset & 3) ||
+	                    f.id_offset > MAX_MSG_SIZE - sizeof(unsigned long)))
+		return -EINVAL;
+	
+	max_size = get_fs_long((unsigned long *)size_ptr);
+	
+	ipc_deadline_start(&deadline);
+	
+	cli();
+	
+	result = ipc_wait_match(src_port, &f, flags, &deadline, &kernel_msg);
+	if (result < 0) {
+		sti();
+		ipc_deadline_stop(&deadline);
+		return result;
+	}
+	
+	ipc_wakeup_sender(src_port);
+	
+	sti();
+	ipc_deadline_stop(&deadline);
+	
+	result = ipc_copy_out(kernel_msg, msg, size_ptr, max_size);
+	
+	if (kernel_msg->flags & MSG_FLAG_REQUEST) {
+		ipc_add_reply(kernel_msg->msg_id, kernel_msg->sender, NULL,
+		              kernel_msg->seq);
+		ipc_space_grant(current, kernel_msg->sender);
+	}
+	
+	ipc_free_message(kernel_msg);
+	
+	return result;
+}
+
+/**
+ * sys_ipc_notify - Raise notification bits on a port
+ * @port: Destination port
+ * @bits: Bits to set
+ * 
+ * Never blocks and never fails for lack of queue space: bits already
+ * pending simply absorb the new ones.
+ * Returns 0 on success, negative error code.
+ */
+int sys_ipc_notify(unsigned int port, unsigned long bits)
+{
+	if (!port_validate_access(port, current, IPC_RIGHT_SEND))
+		return -EPERM;
+	
+	return ipc_notify(port, bits);
+}
+
+/**
+ * sys_ipc_reply - Send a reply to a request
+ * @request_id: Request ID to reply to
+ * @reply_port: Reply port named in the request
+ * @msg: Reply message
+ * @size: Message size
+ * 
+ * The pending entry is taken by ipc_send(), which stamps the reply with
+ * the call it answers; taking it here too would answer a second request.
+ * 
+ * Returns 0 on success, negative error code on failure.
+ */
+int sys_ipc_reply(unsigned int request_id, unsigned int reply_port,
+                  void *msg, unsigned int size)
+{
+	return sys_ipc_send(reply_port, msg, size, MSG_FLAG_REPLY);
+}
+
+/**
+ * sys_ipc_call - Send a request and wait for its reply in one trap
+ * @port: Destination (server) port
+ * @msg: Request message (in user space)
+ * @size: Request size
+ * @reply: Buffer for reply (user space)
+ * @reply_size: Pointer to reply buffer size (input/output)
+ * 
+ * Combines sys_ipc_send and sys_ipc_receive on the reply port named in
+ * the request header. The caller registers as the reply port's receiver
+ * before the request is delivered, so a server that is already blocked
+ * in receive gets the request handed to it directly and its reply is
+ * handed straight back the same way, with no queueing on either side.
+ * In that case the caller also switches straight to the server and lends
+ * it the rest of its timeslice, rather than waiting for the scheduler to
+ * pick it.
+ * A non-zero current->ipc_timeout bounds the whole call; -EAGAIN is
+ * returned when it runs out.
+ * 
+ * Returns number of reply bytes received, or negative error code.
+ */
+int sys_ipc_call(unsigned int port, void *msg, unsigned int size,
+                 void *reply, unsigned int *reply_size)
+{
+	struct ipc_port *dest_port, *reply_p;
+	struct ipc_message *kernel_msg, *reply_msg;
+	struct mk_msg_header header;
+	struct ipc_deadline deadline;
+	struct task_struct *server;
+	unsigned int max_size, seq;
+	unsigned long start;
+	int result;
+	
+	dest_port = ipc_port_lookup(port);
+	if (!dest_port)
+		return -EINVAL;
+	
+	if (!port_validate_access(port, current, IPC_RIGHT_SEND))
+		return -EPERM;
+	
+	memcpy_from_fs(&header, msg, sizeof(struct mk_msg_header));
+	
+	if (header.size > MAX_MSG_SIZE)
+		return -EINVAL;
+	
+	/* A call needs somewhere for the reply to land */
+	reply_p = ipc_port_lookup(header.reply_port);
+	if (!header.reply_port || !reply_p)
+		return -EINVAL;
+	
+	if (!port_validate_access(header.reply_port, current, IPC_RIGHT_RECEIVE))
+		return -EPERM;
+	
+	max_size = get_fs_long((unsigned long *)reply_size);
+	
+	kernel_msg = ipc_create_message(header.msg_id,
+	                                header.reply_port,
+	                                port,
+	                                0,
+	                                header.size,
+	                                msg,
+	                                MSG_FLAG_REQUEST);
+	if (!kernel_msg)
+		return -EAGAIN;
+	
+	/* Servers echo msg_id, so only seq tells this call's reply apart */
+	if (!++ipc_call_seq)
+		ipc_call_seq = 1;
+	seq = kernel_msg->seq = ipc_call_seq;
+	
+	/* One deadline covers both the send and the wait for the reply */
+	ipc_deadline_start(&deadline);
+	
+	cli();
+	
+	/* Wait for queue space; a blocked receiver never needs any */
+	result = ipc_wait_space(dest_port, 0, &deadline);
+	if (result < 0) {
+		sti();
+		ipc_deadline_stop(&deadline);
+		ipc_free_message(kernel_msg);
+		return result;
+	}
+	
+	current->wait_port = header.reply_port;
+	
+	start = ipc_tsc();
+	server = ipc_deliver_message(dest_port, kernel_msg);
+	
+	/*
+	 * Block until the reply is handed off or queued. Interrupts stay off
+	 * until we are on the reply port's queue, so the server cannot reply
+	 * before there is a receiver to hand off to.
+	 */
+	deadline.partner = server;
+	deadline.partner_how = SCHED_TO_CALL;
+	for (;;) {
+		result = ipc_wait_message(reply_p, 0, &deadline);
+		if (result < 0)
+			break;
+		
+		reply_msg = ipc_take_message(reply_p);
+		if (reply_msg->seq == seq)
+			break;
+		
+		/*
+		 * A late reply to an earlier call that timed out or was
+		 * interrupted. Nobody is waiting for it any more.
+		 */
+		ipc_free_message(reply_msg);
+		ipc_wakeup_sender(reply_p);
+	}
+	current->wait_port = 0;
+	if (result < 0) {
+		ipc_cancel_request(dest_port, kernel_msg, seq);
+		sti();
+		ipc_deadline_stop(&deadline);
+		return result;
+	}
+	
+	ipc_stats_reply(dest_port, start);
+	
+	ipc_wakeup_sender(reply_p);
+	
+	sti();
+	ipc_deadline_stop(&deadline);
+	
+	result = ipc_copy_out(reply_msg, reply, reply_size, max_size);
+	ipc_free_message(reply_msg);
+	
+	return result;
+}
+
+/**
+ * sys_ipc_reply_wait - Reply to a client and wait for the next request
+ * @reply_port: Port to deliver the reply to (0 for no reply)
+ * @reply: Reply message (user space), size taken from its header
+ * @port: Port to receive the next request on
+ * @msg: Buffer for next request (user space)
+ * @size_ptr: Pointer to buffer size (input/output)
+ * 
+ * Server-side counterpart of sys_ipc_call. The reply is delivered and the
+ * server is blocked on @port without re-enabling interrupts in between,
+ * so a client waiting in sys_ipc_call receives the reply by handoff and
+ * the server never misses a request. If no request is waiting, the server
+ * then switches straight back to that client and returns what is left of
+ * the timeslice it was lent. A reply port that is full is not waited on:
+ * the reply is dropped rather than stalling the server.
+ * 
+ * Returns number of bytes received, or negative error code.
+ */
+int sys_ipc_reply_wait(unsigned int reply_port, void *reply,
+                       unsigned int port, void *msg, unsigned int *size_ptr)
+{
+	struct ipc_port *dest_port;
+	struct ipc_message *kernel_msg;
+	struct mk_msg_header header;
+	struct ipc_reply pending;
+	struct task_struct *client = NULL;
+	struct mk_iovec iov;
+	
+	iov.base = msg;
+	iov.len = get_fs_long((unsigned long *)size_ptr);
+	
+	if (reply_port) {
+		dest_port = ipc_port_lookup(reply_port);
+		if (!dest_port)
+			return -EINVAL;
+		
+		if (!ipc_space_reply(current, reply_port))
+			return -EPERM;
+		
+		memcpy_from_fs(&header, reply, sizeof(struct mk_msg_header));
+		
+		if (header.size > MAX_MSG_SIZE)
+			return -EINVAL;
+		
+		/* The request is answered, whether or not the reply fits */
+		ipc_find_reply(header.msg_id, reply_port, &pending);
+		
+		kernel_msg = ipc_create_message(header.msg_id,
+		                                header.sender_port,
+		                                reply_port,
+		                                0,
+		                                header.size,
+		                                reply,
+		                                MSG_FLAG_REPLY);
+		if (!kernel_msg)
+			return -EAGAIN;
+		kernel_msg->seq = pending.seq;
+		
+		cli();
+		
+		if (ipc_port_full(dest_port))
+			ipc_free_message(kernel_msg);
+		else
+			client = ipc_deliver_message(dest_port, kernel_msg);
+		ipc_return_loan(dest_port);
+		
+		/* Interrupts stay off until the receive below blocks */
+	}
+	
+	return ipc_receive(port, &iov, 1, size_ptr, iov.len, MSG_FLAG_BLOCK,
+	                   client);
+}
+
+/**
+ * sys_ipc_send_short - Send a short message passed in registers
+ * @port: Destination port
+ * @tag: MK_SHORT_TAG(msg_id, reply_port)
+ * @w0: First data word
+ * @w1: Second data word
+ * @w2: Third data word
+ * 
+ * The message is built directly in the inline area of the kernel message,
+ * laid out as a header followed by the three words, so ordinary receivers
+ * see the same bytes as if it had been sent with sys_ipc_send.
+ * 
+ * Returns 0 on success, negative error code.
+ */
+int sys_ipc_send_short(unsigned int port, unsigned long tag,
+                       unsigned long w0, unsigned long w1, unsigned long w2)
+{
+	struct ipc_port *dest_port;
+	struct ipc_message *kernel_msg;
+	struct mk_msg_header *header;
+	unsigned long *words;
+	struct ipc_deadline deadline;
+	int result;
+	
+	dest_port = ipc_port_lookup(port);
+	if (!port || !dest_port)
+		return -EINVAL;
+	
+	if (!port_validate_access(port, current, IPC_RIGHT_SEND))
+		return -EPERM;
+	
+	kernel_msg = ipc_alloc_message(MK_TAG_MSG_ID(tag),
+	                               ipc_port_widen(MK_TAG_REPLY_PORT(tag)),
+	                               port, 0, IPC_SHORT_SIZE, MSG_FLAG_NONE);
+	if (!kernel_msg)
+		return -EAGAIN;
+	
+	header = (struct mk_msg_header *) IPC_MSG_DATA(kernel_msg);
+	header->msg_id = kernel_msg->msg_id;
+	header->sender_port = kernel_msg->sender;
+	header->reply_port = kernel_msg->sender;
+	header->size = IPC_SHORT_SIZE;
+	
+	words = (unsigned long *)(header + 1);
+	words[0] = w0;
+	words[1] = w1;
+	words[2] = w2;
+	
+	ipc_deadline_start(&deadline);
+	
+	cli();
+	
+	/* Block until space available */
+	result = ipc_wait_space(dest_port, 0, &deadline);
+	if (result < 0) {
+		sti();
+		ipc_deadline_stop(&deadline);
+		ipc_free_message(kernel_msg);
+		return result;
+	}
+	
+	ipc_deliver_message(dest_port, kernel_msg);
+	
+	sti();
+	ipc_deadline_stop(&deadline);
+	
+	return 0;
+}
+
+/**
+ * sys_ipc_recv_short - Receive a short message into registers
+ * @port: Port to receive from
+ * @mr: Message registers on the kernel stack (tag, sender, w0-w2)
+ * 
+ * Called from ipc_recv_short in system_call.s, which loads @mr into the
+ * caller's ebx, ecx, edx, esi and edi on the way out. Any message of at
+ * most a header and MK_SHORT_WORDS words is accepted; larger ones stay
+ * queued and -E2BIG is returned so the caller can use sys_ipc_receive.
+ * Pending notification bits come back as MK_MSG_NOTIFY with the port
+ * and the bits in the first two words.
+ * 
+ * Returns 0 on success, negative error code.
+ */
+int sys_ipc_recv_short(unsigned int port, unsigned long *mr)
+{
+	struct ipc_port *src_port;
+	struct ipc_message *kernel_msg;
+	struct mk_msg_header *header;
+	unsigned long *words;
+	unsigned int i, nr_words = 0;
+	struct ipc_deadline deadline;
+	int result;
+	
+	src_port = ipc_port_lookup(port);
+	if (!port || !src_port)
+		return -EINVAL;
+	
+	if (!port_validate_access(port, current, IPC_RIGHT_RECEIVE))
+		return -EPERM;
+	
+	ipc_unboost(current);
+	ipc_deadline_start(&deadline);
+	
+	cli();
+	
+	/* Block until message arrives */
+	result = ipc_wait_message(src_port, MSG_FLAG_NOTIFY, &deadline);
+	if (result < 0) {
+		sti();
+		ipc_deadline_stop(&deadline);
+		return result;
+	}
+	
+	if (src_port->notify_bits) {
+		mr[0] = MK_SHORT_TAG(MK_MSG_NOTIFY, 0);
+		mr[1] = 0;
+		mr[2] = port;
+		mr[3] = ipc_take_notify(src_port);
+		mr[4] = 0;
+		sti();
+		ipc_deadline_stop(&deadline);
+		return 0;
+	}
+	
+	kernel_msg = src_port->handoff ? src_port->handoff : src_port->queue_head;
+	if (kernel_msg->size > IPC_SHORT_SIZE) {
+		/* Leave it for sys_ipc_receive; let another receiver try */
+		ipc_wakeup_receiver(src_port);
+		sti();
+		ipc_deadline_stop(&deadline);
+		return -E2BIG;
+	}
+	
+	kernel_msg = ipc_take_message(src_port);
+	ipc_inherit(src_port, kernel_msg);
+	ipc_wakeup_sender(src_port);
+	
+	sti();
+	ipc_deadline_stop(&deadline);
+	
+	if (kernel_msg->ool_size)
+		ipc_map_ool(kernel_msg);
+	
+	header = (struct mk_msg_header *) kernel_msg->data;
+	if (kernel_msg->size >= sizeof(struct mk_msg_header)) {
+		mr[0] = MK_SHORT_TAG(header->msg_id, header->reply_port);
+		nr_words = (kernel_msg->size - sizeof(struct mk_msg_header)) /
+		           sizeof(unsigned long);
+	} else {
+		mr[0] = MK_SHORT_TAG(kernel_msg->msg_id, 0);
+	}
+	mr[1] = kernel_msg->sender;
+	
+	words = (unsigned long *)(header + 1);
+	for (i = 0; i < MK_SHORT_WORDS; i++)
+		mr[2 + i] = (i < nr_words) ? words[i] : 0;
+	
+	if (kernel_msg->flags & MSG_FLAG_REQUEST) {
+		ipc_add_reply(kernel_msg->msg_id, kernel_msg->sender, NULL,
+		              kernel_msg->seq);
+		ipc_space_grant(current, kernel_msg->sender);
+	}
+	
+	ipc_free_message(kernel_msg);
+	
+	return 0;
+}
+
+/**
+ * sys_ipc_send_ool - Send a message with an out-of-line page payload
+ * @port: Destination port
+ * @msg: Message, ending with a struct mk_msg_ool
+ * @size: Message size
+ * 
+ * Only the message itself is copied. The pages the descriptor names are
+ * moved or shared into the receiver's window when the message is
+ * received (see ipc_map_ool), so the sender must leave them alone until
+ * then; mk_msg_call gives that naturally.
+ * 
+ * Returns 0 on success, negative error code.
+ */
+int sys_ipc_send_ool(unsigned int port, void *msg, unsigned int size)
+{
+	struct ipc_port *dest_port;
+	struct ipc_message *kernel_msg;
+	struct mk_msg_header header;
+	struct mk_msg_ool *ool;
+	struct ipc_deadline deadline;
+	int result;
+	
+	dest_port = ipc_port_lookup(port);
+	if (!port || !dest_port)
+		return -EINVAL;
+	
+	if (!port_validate_access(port, current, IPC_RIGHT_SEND))
+		return -EPERM;
+	
+	memcpy_from_fs(&header, msg, sizeof(struct mk_msg_header));
+	
+	if (header.size > MAX_MSG_SIZE ||
+	    header.size < sizeof(struct mk_msg_header) + sizeof(struct mk_msg_ool))
+		return -EINVAL;
+	
+	kernel_msg = ipc_create_message(header.msg_id,
+	                                header.sender_port,
+	                                port,
+	                                0,
+	                                header.size,
+	                                msg,
+	                                MSG_FLAG_NONE);
+	if (!kernel_msg)
+		return -EAGAIN;
+	
+	ool = IPC_MSG_OOL(kernel_msg);
+	if ((ool->address & 0xfff) || !ool->size ||
+	    ool->size > MK_OOL_MAX_PAGES * PAGE_SIZE ||
+	    (ool->copy != MK_OOL_MOVE && ool->copy != MK_OOL_SHARE)) {
+		ipc_free_message(kernel_msg);
+		return -EINVAL;
+	}
+	
+	kernel_msg->ool_addr = get_base(current->ldt[2]) + ool->address;
+	kernel_msg->ool_size = ool->size;
+	kernel_msg->ool_copy = ool->copy;
+	
+	ipc_deadline_start(&deadline);
+	
+	cli();
+	
+	/* Block until space available */
+	result = ipc_wait_space(dest_port, 0, &deadline);
+	if (result < 0) {
+		sti();
+		ipc_deadline_stop(&deadline);
+		ipc_free_message(kernel_msg);
+		return result;
+	}
+	
+	ipc_deliver_message(dest_port, kernel_msg);
+	
+	sti();
+	ipc_deadline_stop(&deadline);
+	
+	return 0;
+}
+
+/**
+ * sys_ipc_send_batch - Send several messages in one trap
+ * @desc: Array of mk_msg_desc (user space)
+ * @count: Number of descriptors, at most MK_BATCH_MAX
+ * 
+ * Meant for bursts of fire-and-forget messages. Access to each distinct
+ * port is checked once, all messages are copied in up front, and they are
+ * then delivered in array order in a single interrupt-disabled section.
+ * A full port blocks like sys_ipc_send. The batch stops at the first
+ * descriptor that is invalid or cannot be delivered.
+ * 
+ * Returns number of messages sent, or negative error code if none was.
+ */
+int sys_ipc_send_batch(struct mk_msg_desc *desc, unsigned int count)
+{
+	struct mk_msg_desc d[MK_BATCH_MAX];
+	struct ipc_message *msgs[MK_BATCH_MAX];
+	struct ipc_port *dest_port;
+	struct mk_msg_header header;
+	struct ipc_deadline deadline;
+	unsigned int i, j, n, port;
+	int result = 0;
+	
+	if (!count || count > MK_BATCH_MAX)
+		return -EINVAL;
+	
+	memcpy_from_fs(d, desc, count * sizeof(struct mk_msg_desc));
+	
+	/* Validate and copy in everything before touching any queue */
+	for (n = 0; n < count; n++) {
+		port = d[n].port;
+		if (!port || !ipc_port_lookup(port)) {
+			result = -EINVAL;
+			break;
+		}
+		
+		/* Ports of earlier descriptors have already passed */
+		for (j = 0; j < n && d[j].port != port; j++)
+			;
+		if (j == n && !port_validate_access(port, current, IPC_RIGHT_SEND)) {
+			result = -EPERM;
+			break;
+		}
+		
+		memcpy_from_fs(&header, d[n].msg, sizeof(struct mk_msg_header));
+		if (header.size > MAX_MSG_SIZE) {
+			result = -EINVAL;
+			break;
+		}
+		
+		msgs[n] = ipc_create_message(header.msg_id,
+		                             header.sender_port,
+		                             port,
+		                             0,
+		                             header.size,
+		                             d[n].msg,
+		                             MSG_FLAG_NONE);
+		if (!msgs[n]) {
+			result = -EAGAIN;
+			break;
+		}
+	}
+	
+	ipc_deadline_start(&deadline);
+	
+	cli();
+	
+	for (i = 0; i < n; i++) {
+		/* The name goes stale if the port was freed since */
+		dest_port = ipc_port_lookup(msgs[i]->receiver);
+		if (!dest_port) {
+			result = -EINVAL;
+			break;
+		}
+		result = ipc_wait_space(dest_port, 0, &deadline);
+		if (result < 0)
+			break;
+		ipc_deliver_message(dest_port, msgs[i]);
+	}
+	
+	sti();
+	ipc_deadline_stop(&deadline);
+	
+	/* Drop whatever could not be delivered */
+	for (j = i; j < n; j++)
+		ipc_free_message(msgs[j]);
+	
+	return i ? i : result;
 }
 
-/*=============================================================================
- * WAIT QUEUE MANAGEMENT
- *============================================================================*/
-
 /**
- * ipc_wakeup_sender - Wake up task waiting to send
- * @port: Port with available queue space
+ * ipc_ring_init - Set up an empty ring in a fresh page
+ * @page: Page from get_free_page
  */
-static void ipc_wakeup_sender(struct ipc_port *port)
+static struct mk_ring *ipc_ring_init(unsigned long page)
 {
-	if (port->send_wait) {
-		wake_up(&port->send_wait);
-		port->send_wait = NULL;
-	}
+	struct mk_ring *ring = (struct mk_ring *) page;
+	
+	ring->head = 0;
+	ring->tail = 0;
+	ring->sleeping = 1;	/* The consumer has not looked yet */
+	ring->kicks = 0;
+	return ring;
 }
 
 /**
- * ipc_wakeup_receiver - Wake up task waiting to receive
- * @port: Port with available message
+ * ipc_channel_party - Check that a task may kick a channel
+ * @c: Channel
+ * @task: Task slot
+ * 
+ * The client that opened the channel and the owners of its two ports
+ * may; anybody may kick a MK_CHANNEL_KERNEL channel.
  */
-static void ipc_wakeup_receiver(struct ipc_port *port)
+static int ipc_channel_party(struct ipc_channel *c, unsigned int task)
 {
-	if (port->recv_wait) {
-		wake_up(&port->recv_wait);
-		port->recv_wait = NULL;
-	}
+	struct ipc_port *p;
+	
+	if (c->owner == TASK_ID_KERNEL || c->owner == task)
+		return 1;
+	
+	p = ipc_port_lookup(c->port);
+	if (p && p->owner == task)
+		return 1;
+	
+	p = c->reply_port ? ipc_port_lookup(c->reply_port) : NULL;
+	return p && p->owner == task;
 }
 
-/*=============================================================================
- * REPLY TRACKING
- *============================================================================*/
-
 /**
- * ipc_add_reply - Track pending reply
- * @request_id: Request message ID
- * @reply_port: Port to send reply to
- * @task: Task waiting for reply
- * @timeout: Timeout in jiffies
+ * ipc_channel_unkick - Drop queued kicks for a channel
+ * @port_id: Consumer port
+ * @id: Channel id
  * 
- * Returns 0 on success, -1 on error.
+ * Must be called with interrupts disabled.
  */
-static int ipc_add_reply(unsigned int request_id, unsigned int reply_port,
-                          struct task_struct *task, unsigned long timeout)
+static void ipc_channel_unkick(unsigned int port_id, unsigned int id)
 {
-	struct ipc_reply *reply;
+	struct ipc_port *port = port_id ? ipc_port_lookup(port_id) : NULL;
+	struct ipc_message *m, *prev = NULL, *next;
 	
-	reply = (struct ipc_reply *) kmalloc(sizeof(struct ipc_reply));
-	if (!reply)
-		return -1;
+	if (!port || port->flags == PORT_FLAG_FREE)
+		return;
 	
-	reply->request_id = request_id;
-	reply->reply_port = reply_port;
-	reply->waiting_task = task;
-	reply->timeout = timeout ? jiffies + timeout : 0;
-	reply->next = pending_replies;
+#define IPC_KICK_FOR(m) ((m)->msg_id == MK_MSG_CHANNEL_KICK && \
+	((struct mk_channel_kick *) IPC_MSG_DATA(m))->channel == id)
 	
-	pending_replies = reply;
-	return 0;
+	if (port->handoff && IPC_KICK_FOR(port->handoff)) {
+		ipc_free_message(port->handoff);
+		port->handoff = NULL;
+	}
+	
+	for (m = port->queue_head; m; m = next) {
+		next = m->next;
+		if (IPC_KICK_FOR(m)) {
+			ipc_unlink_message(port, m, prev);
+			ipc_free_message(m);
+		} else {
+			prev = m;
+		}
+	}
+	
+#undef IPC_KICK_FOR
+	
+	ipc_set_mark(port);
 }
 
 /**
- * ipc_find_reply - Find pending reply by request ID
- * @request_id: Request ID to find
+ * ipc_channel_close - Free a channel's rings and slot
+ * @id: Channel id
  * 
- * Returns reply structure, or NULL if not found.
+ * Kicks still queued would point the consumer at a freed ring, so they
+ * go with the slot. The pages are freed last, with interrupts on, since
+ * free_page() talks to the memory server.
  */
-static struct ipc_reply *ipc_find_reply(unsigned int request_id)
+static void ipc_channel_close(unsigned int id)
 {
-	struct ipc_reply *reply, *prev = NULL;
+	struct ipc_channel *c = &ipc_channels[id];
+	struct mk_ring *req, *rep;
+	unsigned long flags;
 	
-	for (reply = pending_replies; reply; prev = reply, reply = reply->next) {
-		if (reply->request_id == request_id) {
-			/* Remove from list */
-			if (prev)
-				prev->next = reply->next;
-			else
-				pending_replies = reply->next;
-			return reply;
-		}
-	}
+	save_flags(flags);
+	cli();
+	
+	ipc_channel_unkick(c->port, id);
+	ipc_channel_unkick(c->reply_port, id);
+	
+	req = c->ring[MK_RING_REQ];
+	rep = c->ring[MK_RING_REP];
+	c->ring[MK_RING_REQ] = NULL;
+	c->ring[MK_RING_REP] = NULL;
+	c->flags = PORT_FLAG_FREE;
+	
+	restore_flags(flags);
 	
-	return NULL;
+	free_page((unsigned long) req);
+	free_page((unsigned long) rep);
 }
 
 /**
- * ipc_check_reply_timeouts - Check for timed-out replies
+ * sys_ipc_channel_open - Create a ring channel to a server port
+ * @port: Server port; consumes the request ring
+ * @reply_port: Client port for reply ring kicks (0 if unused)
+ * @ch: Receives channel id and ring addresses (struct mk_channel)
+ * @flags: MK_CHANNEL_KERNEL for a channel shared by all kernel code
+ * @edi,nr,ebx,ecx,edx: Unused argument slot and saved registers
+ * @fs,es,ds: Segment registers
+ * @eip,cs: Caller's return address
+ * 
+ * The rings are kernel pages used in place, so only code running in the
+ * kernel address space (printk, the mm stubs, the servers) can use them.
+ * The caller's saved cs is checked to enforce that: handing kernel page
+ * addresses to a user-mode task would let it probe for them.
+ * A channel is closed when the task that opened it is released, unless
+ * it was opened with MK_CHANNEL_KERNEL.
+ * 
+ * Returns channel id, or negative error code.
  */
-static void ipc_check_reply_timeouts(void)
+int sys_ipc_channel_open(unsigned int port, unsigned int reply_port,
+                         struct mk_channel *ch, unsigned int flags,
+                         long edi, long nr, long ebx, long ecx, long edx,
+                         long fs, long es, long ds,
+                         long eip, long cs)
 {
-	struct ipc_reply *reply, *prev = NULL, *next;
-	unsigned long now = jiffies;
+	struct ipc_channel *c = NULL;
+	unsigned long req, rep;
+	int i;
 	
-	for (reply = pending_replies; reply; reply = next) {
-		next = reply->next;
-		
-		if (reply->timeout && reply->timeout < now) {
-			/* Timeout - wake up task with error */
-			if (reply->waiting_task) {
-				reply->waiting_task->signal |= (1 << (SIGALRM-1));
-				wake_up(&reply->waiting_task);
-			}
-			
-			/* Remove from list */
-			if (prev)
-				prev->next = next;
-			else
-				pending_replies = next;
-			
-			kfree(reply);
-		} else {
-			prev = reply;
+	if (cs & 3)
+		return -EPERM;
+	
+	if (!port || !ipc_port_lookup(port) ||
+	    (reply_port && !ipc_port_lookup(reply_port)))
+		return -EINVAL;
+	
+	if (!port_validate_access(port, current, IPC_RIGHT_SEND))
+		return -EPERM;
+	if (reply_port && !port_validate_access(reply_port, current, IPC_RIGHT_SEND))
+		return -EPERM;
+	
+	req = get_free_page();
+	if (!req)
+		return -ENOMEM;
+	rep = get_free_page();
+	if (!rep) {
+		free_page(req);
+		return -ENOMEM;
+	}
+	
+	cli();
+	
+	for (i = 0; i < MAX_CHANNELS; i++) {
+		if (ipc_channels[i].flags == PORT_FLAG_FREE) {
+			c = &ipc_channels[i];
+			c->flags = PORT_FLAG_USED;
+			break;
 		}
 	}
+	
+	sti();
+	
+	if (!c) {
+		free_page(req);
+		free_page(rep);
+		return -ENOSPC;
+	}
+	
+	c->owner = (flags & MK_CHANNEL_KERNEL) ? TASK_ID_KERNEL :
+	                                         kernel_state->current_task;
+	c->port = port;
+	c->reply_port = reply_port;
+	c->ring[MK_RING_REQ] = ipc_ring_init(req);
+	c->ring[MK_RING_REP] = ipc_ring_init(rep);
+	
+	put_fs_long(i, (unsigned long *) &ch->id);
+	put_fs_long(req, (unsigned long *) &ch->req);
+	put_fs_long(rep, (unsigned long *) &ch->rep);
+	
+	return i;
 }
 
-/*=============================================================================
- * CORE IPC OPERATIONS
- *============================================================================*/
-
 /**
- * sys_ipc_send - Send an IPC message
- * @port: Destination port
- * @msg: Message pointer (in user space)
- * @size: Message size
- * @flags: Send flags (blocking/non-blocking)
+ * sys_ipc_channel_kick - Wake the consumer of a ring
+ * @id: Channel id
+ * @which: MK_RING_REQ or MK_RING_REP
  * 
- * Returns 0 on success, negative error code on failure.
+ * Called by a producer that saw the ring's sleeping mark. The mark is
+ * cleared here, so one MK_MSG_CHANNEL_KICK is outstanding per ring at
+ * most; the notification ignores the port's queue limit for that reason.
+ * Only a party to the channel may kick it (see ipc_channel_party()).
+ * 
+ * Returns 0 on success, negative error code.
  */
-int sys_ipc_send(unsigned int port, void *msg, unsigned int size, unsigned int flags)
+int sys_ipc_channel_kick(unsigned int id, unsigned int which)
 {
+	struct ipc_channel *c;
 	struct ipc_port *dest_port;
 	struct ipc_message *kernel_msg;
-	struct mk_msg_header *user_header;
-	unsigned int msg_size;
-	int result = 0;
+	struct mk_channel_kick kick;
+	struct mk_ring *ring;
+	unsigned int port;
 	
-	/* Validate port */
-	if (port >= MAX_PORTS)
+	if (id >= MAX_CHANNELS || which > MK_RING_REP)
 		return -EINVAL;
 	
-	dest_port = &ipc_ports[port];
+	c = &ipc_channels[id];
+	if (c->flags == PORT_FLAG_FREE)
+		return -EINVAL;
 	
-	/* Validate access */
-	if (!port_validate_access(port, current))
+	if (!ipc_channel_party(c, kernel_state->current_task))
 		return -EPERM;
 	
-	/* Copy message header from user space */
-	user_header = (struct mk_msg_header *) kmalloc(sizeof(struct mk_msg_header));
-	if (!user_header)
-		return -ENOMEM;
-	
-	memcpy_from_fs(user_header, msg, sizeof(struct mk_msg_header));
-	
-	msg_size = user_header->size;
-	
-	if (msg_size > MAX_MSG_SIZE) {
-		kfree(user_header);
+	ring = c->ring[which];
+	port = (which == MK_RING_REQ) ? c->port : c->reply_port;
+	if (!port)
 		return -EINVAL;
-	}
-	
-	/* Create kernel message */
-	kernel_msg = ipc_create_message(user_header->msg_id,
-	                                 user_header->sender_port,
-	                                 port,
-	                                 0,
-	                                 msg_size,
-	                                 msg,
-	                                 flags);
 	
-	kfree(user_header);
+	kick.header.msg_id = MK_MSG_CHANNEL_KICK;
+	kick.header.sender_port = 0;
+	kick.header.reply_port = 0;
+	kick.header.size = sizeof(kick);
+	kick.channel = id;
+	kick.ring = ring;
 	
+	kernel_msg = ipc_create_message(MK_MSG_CHANNEL_KICK, 0, port, 0,
+	                                sizeof(kick), &kick, MSG_FLAG_NONE);
 	if (!kernel_msg)
-		return -ENOMEM;
+		return -EAGAIN;
 	
 	cli();
 	
-	/* Check if queue is full */
-	if (dest_port->queue_count >= dest_port->max_messages) {
-		if (flags & MSG_FLAG_NONBLOCK) {
-			sti();
-			ipc_free_message(kernel_msg);
-			return -EAGAIN;
-		}
-		
-		/* Block until space available */
-		dest_port->send_wait = current;
-		current->state = TASK_INTERRUPTIBLE;
+	/*
+	 * Somebody else kicked first, the consumer woke up by itself, or
+	 * the channel was closed while the message was being built
+	 */
+	dest_port = ipc_port_lookup(port);
+	if (c->flags == PORT_FLAG_FREE || c->ring[which] != ring ||
+	    !ring->sleeping || !dest_port || dest_port->flags == PORT_FLAG_FREE) {
 		sti();
-		schedule();
-		
-		/* Try again */
-		return sys_ipc_send(port, msg, size, flags);
+		ipc_free_message(kernel_msg);
+		return 0;
 	}
 	
-	/* Queue the message */
-	ipc_queue_message(dest_port, kernel_msg);
-	
-	/* Wake up any waiting receiver */
-	ipc_wakeup_receiver(dest_port);
+	ring->sleeping = 0;
+	ring->kicks++;
+	ipc_deliver_message(dest_port, kernel_msg);
 	
 	sti();
-	
 	return 0;
 }
 
 /**
- * sys_ipc_receive - Receive an IPC message
- * @port: Source port (0 for any)
- * @msg: Buffer for message (user space)
- * @size_ptr: Pointer to message size (input/output)
- * @flags: Receive flags (blocking/non-blocking)
+ * sys_ipc_portset_allocate - Create a port set
  * 
- * Returns number of bytes received, or negative error code.
+ * Ports are moved into it with sys_ipc_portset_move, and a receive on
+ * the returned name takes the next message from any of them.
+ * 
+ * Returns MK_PORT_SET() name, or negative error code.
  */
-int sys_ipc_receive(unsigned int port, void *msg, unsigned int *size_ptr, unsigned int flags)
+int sys_ipc_portset_allocate(void)
 {
-	struct ipc_port *src_port = NULL;
-	struct ipc_message *kernel_msg;
-	unsigned int max_size;
-	int result = 0;
+	int set;
 	
-	/* Get maximum buffer size from user */
-	max_size = get_fs_long((unsigned long *)size_ptr);
+	cli();
+	set = ipc_set_alloc(kernel_state->current_task, 0);
+	sti();
 	
-	if (port) {
-		/* Receive from specific port */
-		if (port >= MAX_PORTS)
-			return -EINVAL;
-		
-		src_port = &ipc_ports[port];
-		
-		if (!port_validate_access(port, current))
-			return -EPERM;
-	}
+	return (set < 0) ? -ENOSPC : MK_PORT_SET(set);
+}
+
+/**
+ * sys_ipc_portset_move - Move a port into a port set
+ * @port: Port owned by the caller
+ * @name: MK_PORT_SET() name, or 0 to return to the default set
+ * 
+ * Returns 0 on success, negative error code.
+ */
+int sys_ipc_portset_move(unsigned int port, unsigned int name)
+{
+	struct ipc_port *p;
+	int set;
+	
+	p = ipc_port_lookup(port);
+	if (!p)
+		return -EINVAL;
 	
 	cli();
 	
-	if (port) {
-		/* Check specific port */
-		if (!src_port->queue_head) {
-			if (flags & MSG_FLAG_NONBLOCK) {
-				sti();
-				return -EAGAIN;
-			}
-			
-			/* Block until message arrives */
-			src_port->recv_wait = current;
-			current->state = TASK_INTERRUPTIBLE;
+	if (p->flags == PORT_FLAG_FREE || p->owner != kernel_state->current_task) {
+		sti();
+		return -EPERM;
+	}
+	
+	if (name) {
+		set = name & ~MK_PORT_SET_FLAG;
+		if (!(name & MK_PORT_SET_FLAG) || !set || set >= MAX_PORT_SETS ||
+		    ipc_port_sets[set].flags == PORT_FLAG_FREE ||
+		    ipc_port_sets[set].owner != kernel_state->current_task) {
 			sti();
-			schedule();
-			
-			/* Try again */
-			return sys_ipc_receive(port, msg, size_ptr, flags);
+			return -EINVAL;
 		}
-		
-		kernel_msg = ipc_dequeue_message(src_port);
 	} else {
-		/* Receive from any port owned by this task */
-		int i;
-		
-		for (i = PORT_DYNAMIC_START; i < MAX_PORTS; i++) {
-			if (ipc_ports[i].owner == current->pid &&
-			    ipc_ports[i].queue_head) {
-				src_port = &ipc_ports[i];
-				kernel_msg = ipc_dequeue_message(src_port);
-				break;
-			}
-		}
-		
-		if (!kernel_msg) {
-			if (flags & MSG_FLAG_NONBLOCK) {
-				sti();
-				return -EAGAIN;
-			}
-			
-			/* Block on all owned ports (simplified) */
-			current->state = TASK_INTERRUPTIBLE;
-			sti();
-			schedule();
-			
-			/* Try again */
-			return sys_ipc_receive(port, msg, size_ptr, flags);
-		}
+		set = ipc_default_set(p->owner, 1);
 	}
 	
-	/* Wake up any waiting sender */
-	ipc_wakeup_sender(src_port);
+	ipc_set_join(p, set);
 	
 	sti();
-	
-	/* Copy message to user space */
-	if (kernel_msg->size <= max_size) {
-		memcpy_to_fs(msg, kernel_msg, kernel_msg->size);
-		put_fs_long(kernel_msg->size, (unsigned long *)size_ptr);
-		result = kernel_msg->size;
-	} else {
-		/* Buffer too small */
-		put_fs_long(kernel_msg->size, (unsigned long *)size_ptr);
-		result = -ENOSPC;
-	}
-	
-	/* Handle replies */
-	if (kernel_msg->flags & MSG_FLAG_REQUEST) {
-		ipc_add_reply(kernel_msg->msg_id, kernel_msg->sender,
-		              NULL, 0);  /* No timeout */
-	}
-	
-	ipc_free_message(kernel_msg);
-	
-	return result;
+	return 0;
 }
 
 /**
- * sys_ipc_reply - Send a reply to a request
- * @request_id: Request ID to reply to
- * @msg: Reply message
- * @size: Message size
+ * sys_ipc_portset_deallocate - Destroy a port set
+ * @name: MK_PORT_SET() name
  * 
- * Returns 0 on success, negative error code on failure.
+ * Member ports go back to their owner's default set.
+ * Returns 0 on success, negative error code.
  */
-int sys_ipc_reply(unsigned int request_id, void *msg, unsigned int size)
+int sys_ipc_portset_deallocate(unsigned int name)
 {
-	struct ipc_reply *reply;
-	int result;
+	struct ipc_port_set *set;
+	int i, id = name & ~MK_PORT_SET_FLAG;
 	
-	cli();
+	if (!(name & MK_PORT_SET_FLAG) || !id || id >= MAX_PORT_SETS)
+		return -EINVAL;
+	
+	set = &ipc_port_sets[id];
 	
-	reply = ipc_find_reply(request_id);
+	cli();
 	
-	if (!reply) {
+	if (set->flags == PORT_FLAG_FREE || (set->flags & SET_FLAG_DEFAULT) ||
+	    set->owner != kernel_state->current_task) {
 		sti();
 		return -EINVAL;
 	}
 	
-	/* Send reply to the stored reply port */
-	result = sys_ipc_send(reply->reply_port, msg, size, MSG_FLAG_REPLY);
+	for (i = 0; i < ipc_nr_ports && set->nr_ports; i++)
+		if (ipc_port_at(i)->set == id)
+			ipc_set_join(ipc_port_at(i),
+			             ipc_default_set(ipc_port_at(i)->owner, 1));
 	
-	/* Wake up waiting task if any */
-	if (reply->waiting_task) {
-		wake_up(&reply->waiting_task);
-	}
+	set->flags = PORT_FLAG_FREE;
+	ipc_wake_all(&set->recv_q);
 	
-	kfree(reply);
 	sti();
-	
-	return result;
+	return 0;
 }
 
 /**
@@ -785,11 +4246,10 @@ int sys_ipc_port_set(unsigned int port, unsigned int attr, unsigned long value)
 {
 	struct ipc_port *p;
 	
-	if (port >= MAX_PORTS)
+	p = ipc_port_lookup(port);
+	if (!p)
 		return -EINVAL;
 	
-	p = &ipc_ports[port];
-	
 	/* Check if caller is owner */
 	if (p->owner != kernel_state->current_task)
 		return -EPERM;
@@ -802,9 +4262,31 @@ int sys_ipc_port_set(unsigned int port, unsigned int attr, unsigned long value)
 			break;
 		case 2: /* Set required capabilities */
 			p->required_caps = (capability_t)value;
+			ipc_space_revoke(p->port_id);
 			break;
 		case 3: /* Set domain */
 			p->domain = value;
+			ipc_space_revoke(p->port_id);
+			break;
+		case MK_PORT_OOL_WINDOW:
+			if (value & 0xfff) {
+				sti();
+				return -EINVAL;
+			}
+			p->ool_window = value;
+			p->ool_linear = value ? get_base(current->ldt[2]) + value : 0;
+			break;
+		case MK_PORT_SHARE:
+			p->share = value;
+			/* Senders held back by the old share may fit now */
+			ipc_wake_all(&p->send_q);
+			break;
+		case MK_PORT_PRIO:
+			if (value >= IPC_NR_PRIO) {
+				sti();
+				return -EINVAL;
+			}
+			p->prio = value;
 			break;
 		default:
 			sti();
@@ -815,26 +4297,136 @@ int sys_ipc_port_set(unsigned int port, unsigned int attr, unsigned long value)
 	return 0;
 }
 
-/*=============================================================================
- * TIMER CALLBACK
- *============================================================================*/
-
 /**
- * ipc_timer - Called by timer interrupt to check timeouts
+ * sys_ipc_port_stats - Read a port's counters and latency histograms
+ * @port: Port ID
+ * @stats: Buffer (user space)
+ * 
+ * The snapshot is taken with interrupts off, so it is consistent, and
+ * carries the queue length and limit at that moment.
+ * Returns 0 on success, negative error code.
  */
-void ipc_timer(void)
+int sys_ipc_port_stats(unsigned int port, struct mk_port_stats *stats)
 {
-	ipc_check_reply_timeouts();
+#if CONFIG_IPC_STATS
+	struct mk_port_stats snap;
+	struct ipc_port *p;
+	
+	p = ipc_port_lookup(port);
+	if (!p)
+		return -EINVAL;
+	
+	if (!port_validate_access(port, current, IPC_RIGHT_SEND | IPC_RIGHT_RECEIVE))
+		return -EPERM;
+	
+	cli();
+	snap = *ipc_stats(p);
+	snap.queue_count = p->queue_count + (p->handoff != NULL);
+	snap.max_messages = p->max_messages;
+	sti();
+	
+	memcpy_to_fs(stats, &snap, sizeof(snap));
+	return 0;
+#else
+	return -ENOSYS;
+#endif
 }
 
 /*=============================================================================
  * INITIALIZATION
  *============================================================================*/
 
+#if CONFIG_IPC_SELFTEST
+
+/* Twice the reply table, each round with a msg_id of its own */
+#define IPC_SELFTEST_ROUNDS	(2 * IPC_REPLY_HASH)
+
+/**
+ * ipc_selftest_replies - Check that answered requests leave the reply table
+ * 
+ * This task plays both client and server over two ports of its own. Each
+ * request is queued before the previous one is answered, so
+ * sys_ipc_reply_wait() always finds the next request and never blocks.
+ * Every round uses a fresh msg_id, so a leaked entry would fill the
+ * table after IPC_REPLY_MAX rounds. Buffers are on this stack, so it
+ * must run while fs still addresses kernel data, before move_to_user_mode().
+ * Returns 0 if every reply arrived and the table is back where it was.
+ */
+static int ipc_selftest_replies(void)
+{
+	struct mk_msg_header req, rep, buf;
+	unsigned int size, used, overflows;
+	int client, server, i, result = -1;
+	
+	client = sys_ipc_port_allocate(CAP_NULL);
+	server = sys_ipc_port_allocate(CAP_NULL);
+	if (client <= 0 || server <= 0)
+		goto out;
+	
+	used = ipc_reply_stats.used;
+	overflows = ipc_reply_stats.overflows;
+	
+	req.sender_port = client;
+	req.reply_port = client;
+	req.size = sizeof(req);
+	rep.sender_port = server;
+	rep.reply_port = 0;
+	rep.size = sizeof(rep);
+	
+	req.msg_id = 0;
+	if (sys_ipc_send(server, &req, sizeof(req), MSG_FLAG_REQUEST) < 0)
+		goto out;
+	size = sizeof(buf);
+	if (sys_ipc_receive(server, &buf, &size, MSG_FLAG_NONBLOCK) < 0)
+		goto out;
+	
+	for (i = 0; i < IPC_SELFTEST_ROUNDS; i++) {
+		req.msg_id = i + 1;
+		if (sys_ipc_send(server, &req, sizeof(req), MSG_FLAG_REQUEST) < 0)
+			goto out;
+		
+		rep.msg_id = i;
+		size = sizeof(buf);
+		if (sys_ipc_reply_wait(client, &rep, server, &buf, &size) < 0 ||
+		    buf.msg_id != i + 1)
+			goto out;
+		
+		size = sizeof(buf);
+		if (sys_ipc_receive(client, &buf, &size, MSG_FLAG_NONBLOCK) < 0 ||
+		    buf.msg_id != i)
+			goto out;
+	}
+	
+	/* The last request is answered the other way */
+	rep.msg_id = i;
+	if (sys_ipc_reply(i, client, &rep, sizeof(rep)) < 0)
+		goto out;
+	size = sizeof(buf);
+	if (sys_ipc_receive(client, &buf, &size, MSG_FLAG_NONBLOCK) < 0)
+		goto out;
+	
+	if (ipc_reply_stats.used == used &&
+	    ipc_reply_stats.overflows == overflows)
+		result = 0;
+	
+out:
+	if (server > 0)
+		sys_ipc_port_deallocate(server);
+	if (client > 0)
+		sys_ipc_port_deallocate(client);
+	return result;
+}
+
+#endif /* CONFIG_IPC_SELFTEST */
+
 /**
  * ipc_late_init - Late initialization after scheduler is ready
  */
 void ipc_late_init(void)
 {
+#if CONFIG_IPC_SELFTEST
+	if (ipc_selftest_replies() < 0)
+		panic("ipc: call/reply_wait round trips leak reply entries");
+#endif
 	printk("IPC subsystem ready.\n");
 }
@@ -188,7 +188,7 @@ long kernel_mktime_validate(struct tm * tm, int timezone)
 	if (current_capability & CAP_TIME_READ) {
 		msg.header.msg_id = MSG_TIME_VALIDATE;
 		msg.header.sender_port = kernel_state->kernel_port;
-		msg.header.reply_port = kernel_state->kernel_port;
+		msg.header.reply_port = ipc_reply_port();
 		msg.header.size = sizeof(msg);
 		
 		msg.timestamp = local_time;
@@ -199,7 +199,7 @@ long kernel_mktime_validate(struct tm * tm, int timezone)
 
 		result = mk_msg_send(kernel_state->time_server, &msg, sizeof(msg));
 		if (result == 0) {
-			result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+			result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 			if (result == 0 && reply.result == 0) {
 				return reply.data.timestamp;
 			}
@@ -227,7 +227,7 @@ long kernel_mktime_domain(struct tm * tm, unsigned int domain_id)
 	/* Get timezone for domain */
 	msg.header.msg_id = MSG_TIME_ZONE;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.domain_id = domain_id;
@@ -238,7 +238,7 @@ long kernel_mktime_domain(struct tm * tm, unsigned int domain_id)
 	if (result < 0)
 		return kernel_mktime(tm);  /* Fallback to UTC */
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0 || reply.result < 0)
 		return kernel_mktime(tm);
 
@@ -334,7 +334,7 @@ long kernel_validate_time(long timestamp)
 
 	msg.header.msg_id = MSG_TIME_VALIDATE;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.timestamp = timestamp;
@@ -345,7 +345,7 @@ long kernel_validate_time(long timestamp)
 	if (result < 0)
 		return timestamp;
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0 || reply.result < 0)
 		return timestamp;
 
@@ -371,7 +371,7 @@ unsigned long kernel_get_epoch(unsigned int domain_id)
 
 	msg.header.msg_id = MSG_TIME_EPOCH;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.domain_id = domain_id;
@@ -382,7 +382,7 @@ unsigned long kernel_get_epoch(unsigned int domain_id)
 	if (result < 0)
 		return 0;
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0 || reply.result < 0)
 		return 0;
 
@@ -431,7 +431,7 @@ int kernel_get_timezone(struct timezone *tz)
 
 	msg.header.msg_id = MSG_TIME_ZONE;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.domain_id = current_capability & 0x0F;
@@ -442,7 +442,7 @@ int kernel_get_timezone(struct timezone *tz)
 	if (result < 0)
 		return -1;
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0 || reply.result < 0)
 		return -1;
 
@@ -166,7 +166,7 @@ static int panic_sync(unsigned int flags)
 	/* Try to notify file server */
 	msg.header.msg_id = MSG_PANIC_SYNC;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.task_id = kernel_state->current_task;
@@ -278,6 +278,10 @@ static void panic_dump(void)
 	/* Show task information */
 	show_stat();
 	
+	/* Show IPC message cache usage and per-port traffic */
+	ipc_show_caches();
+	ipc_show_port_stats();
+	
 	/* Show memory information */
 	printk("Jiffies: %ld\n", jiffies);
 	printk("Startup time: %ld\n", startup_time);
@@ -425,7 +429,7 @@ int panic_recoverable(const char *s)
 	/* Ask system server if recovery is possible */
 	msg.header.msg_id = MSG_PANIC_NOTIFY;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	strncpy(msg.reason, s, 63);
@@ -439,7 +443,7 @@ int panic_recoverable(const char *s)
 	if (result < 0)
 		return -1;
 	
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0)
 		return -1;
 	
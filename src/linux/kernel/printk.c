@@ -162,6 +162,36 @@ static void printk_store_log(const char *msg, int len, int level)
 	log_chars += len;
 }
 
+/*
+ * Ring channels to the log and console servers, opened on first use.
+ * While a server keeps up, printk never traps; the batch below only
+ * carries what the rings could not take.
+ */
+static struct mk_channel log_channel;
+static struct mk_channel console_channel;
+
+/**
+ * printk_channel_send - Put a message on a server's ring channel
+ * @ch: Channel, opened here on first use
+ * @port: Server port
+ * @msg: Message to send
+ * 
+ * Returns 0 if the ring took the message, -1 if it must go by IPC.
+ */
+static int printk_channel_send(struct mk_channel *ch, unsigned int port,
+                               void *msg)
+{
+	if (!ch->req) {
+		if (ch->id)
+			return -1;	/* Open failed before, don't retry */
+		if (mk_channel_open(port, 0, ch, MK_CHANNEL_KERNEL) < 0) {
+			ch->id = -1;
+			return -1;
+		}
+	}
+	return mk_channel_send(ch, msg);
+}
+
 /*=============================================================================
  * MAIN PRINTK FUNCTION
  *============================================================================*/
@@ -181,6 +211,8 @@ int printk(const char *fmt, ...)
 	int level;
 	struct msg_console_write msg_console;
 	struct msg_log_write msg_log;
+	struct mk_msg_desc desc[2];
+	unsigned int nr_desc = 0;
 	int result = 0;
 
 	/* Parse log level from format */
@@ -208,7 +240,12 @@ int printk(const char *fmt, ...)
 		msg_log.task_id = kernel_state->current_task;
 		msg_log.caps = current_capability;
 		
-		mk_msg_send(kernel_state->log_server, &msg_log, sizeof(msg_log));
+		if (printk_channel_send(&log_channel, kernel_state->log_server,
+		                        &msg_log) < 0) {
+			desc[nr_desc].port = kernel_state->log_server;
+			desc[nr_desc].msg = &msg_log;
+			nr_desc++;
+		}
 	}
 
 	/* Send to console server if level is high enough */
@@ -225,7 +262,13 @@ int printk(const char *fmt, ...)
 			msg_console.task_id = kernel_state->current_task;
 			msg_console.caps = current_capability;
 			
-			mk_msg_send(kernel_state->console_server, &msg_console, sizeof(msg_console));
+			if (printk_channel_send(&console_channel,
+			                        kernel_state->console_server,
+			                        &msg_console) < 0) {
+				desc[nr_desc].port = kernel_state->console_server;
+				desc[nr_desc].msg = &msg_console;
+				nr_desc++;
+			}
 		} else {
 			/* Emergency fallback - direct tty_write if no server */
 			__asm__ __volatile__(
@@ -243,6 +286,10 @@ int printk(const char *fmt, ...)
 		}
 	}
 
+	/* Whatever the rings refused goes out in one trap */
+	if (nr_desc)
+		mk_msg_send_batch(desc, nr_desc);
+
 	return i;
 }
 
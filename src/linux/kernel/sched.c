@@ -35,12 +35,12 @@
 #include <asm/io.h>
 #include <asm/segment.h>
 #include <signal.h>
+#include <errno.h>
 
 /*=============================================================================
  * MICROKERNEL IPC MESSAGE CODES (Additional)
  *============================================================================*/
 
-#define MSG_SCHED_ALARM		0x1700	/* Handle alarm */
 #define MSG_SCHED_PAUSE		0x1701	/* Sys_pause */
 #define MSG_SCHED_NICE		0x1702	/* Sys_nice */
 #define MSG_SCHED_GETPID		0x1703	/* Get PID */
@@ -51,11 +51,14 @@
 #define MSG_SCHED_GETEGID		0x1708	/* Get EGID */
 #define MSG_SCHED_SHOW_TASK	0x1709	/* Show task info */
 #define MSG_SCHED_SHOW_STAT	0x170A	/* Show statistics */
-#define MSG_SCHED_MATH_RESTORE	0x170B	/* Restore math state */
 #define MSG_SCHED_TIMER		0x170C	/* Timer interrupt */
 #define MSG_SCHED_FLOPPY_TIMER	0x170D	/* Floppy timer */
 #define MSG_SCHED_ADD_TIMER	0x170E	/* Add timer */
-#define MSG_SCHED_DO_TIMER	0x170F	/* Do timer work */
+
+/* Dynamic ticks, as in linux/config.h */
+#ifndef CONFIG_NO_HZ
+#define CONFIG_NO_HZ		1
+#endif
 
 /*=============================================================================
  * ORIGINAL GLOBAL VARIABLES (Now mostly managed by process server)
@@ -128,21 +131,21 @@ static inline long sched_request(unsigned int msg_id, unsigned long param,
 
 	msg.header.msg_id = msg_id;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = need_reply ? kernel_state->kernel_port : 0;
+	msg.header.reply_port = need_reply ? ipc_reply_port() : 0;
 	msg.header.size = sizeof(msg);
 	
 	msg.task_id = kernel_state->current_task;
 	msg.param = param;
 	msg.caps = current_capability;
 
-	result = mk_msg_send(kernel_state->process_server, &msg, sizeof(msg));
-	if (result < 0)
-		return -1;
-
-	if (!need_reply)
-		return 0;
+	if (!need_reply) {
+		result = mk_msg_send(kernel_state->process_server, &msg, sizeof(msg));
+		return (result < 0) ? -1 : 0;
+	}
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	/* Send and wait for the reply in a single trap */
+	result = mk_msg_call(kernel_state->process_server, &msg, sizeof(msg),
+	                     &reply, &reply_size);
 	if (result < 0)
 		return -1;
 
@@ -163,7 +166,7 @@ void show_task(int nr, struct task_struct * p)
 	/* Request task info from process server */
 	msg.header.msg_id = MSG_SCHED_SHOW_TASK;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	msg.task_id = nr;
 	msg.param = (unsigned long)p;
@@ -172,7 +175,7 @@ void show_task(int nr, struct task_struct * p)
 	if (mk_msg_send(kernel_state->process_server, &msg, sizeof(msg)) < 0)
 		return;
 
-	if (mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size) < 0)
+	if (mk_msg_receive(ipc_reply_port(), &reply, &reply_size) < 0)
 		return;
 
 	/* Print task information */
@@ -198,63 +201,506 @@ void show_stat(void)
 }
 
 /*=============================================================================
- * MATH STATE HANDLING (Now via IPC)
+ * MATH STATE HANDLING
  *============================================================================*/
 
+/*
+ * The FPU is switched lazily and without leaving the kernel. The TSS
+ * switch sets CR0.TS, so the first FPU instruction of a task that does
+ * not own the unit traps to math_state_restore(), which writes the
+ * owner's registers back to its save area and loads the new task's.
+ * Tasks that never touch the FPU never pay for it. On CPUs with FXSR
+ * the 512-byte FXSAVE image is used, which also covers the SSE state.
+ *
+ * The save areas are not part of the task page: 512 bytes there would
+ * be taken from the kernel stack. They are cut eight to a page and kept
+ * on a free list; like the IPC caches, pages are never given back.
+ */
+static int has_fxsr = 0;		/* FXSAVE/FXRSTOR usable */
+static int has_xmm = 0;			/* SSE, so MXCSR needs a sane value */
+int has_tsc = 0;			/* RDTSC usable, for IPC statistics */
+static union i387_union *math_free_areas = NULL;
+
+#define X86_FEATURE_TSC		(1 << 4)
+#define X86_FEATURE_FXSR	(1 << 24)
+#define X86_FEATURE_XMM		(1 << 25)
+#define X86_CR4_OSFXSR		0x0200
+#define X86_CR4_OSXMMEXCPT	0x0400
+#define MXCSR_DEFAULT		0x1f80	/* All exceptions masked */
+
+#define clts() __asm__ __volatile__("clts")
+#define stts() __asm__ __volatile__("movl %%cr0,%%eax\n\t" \
+	"orl $8,%%eax\n\t" \
+	"movl %%eax,%%cr0" : : : "ax")
+
+/**
+ * math_init - Find out how FPU state is saved on this CPU
+ *
+ * CPUID exists if the ID flag in EFLAGS can be toggled; a 386 or an
+ * early 486 keeps the plain FSAVE image. The same probe tells whether
+ * there is a time stamp counter, which RDTSC needs not to fault.
+ */
+static void math_init(void)
+{
+	unsigned long flags, toggled, edx;
+
+	__asm__ __volatile__("pushfl\n\t"
+		"popl %0\n\t"
+		"movl %0,%1\n\t"
+		"xorl $0x200000,%1\n\t"
+		"pushl %1\n\t"
+		"popfl\n\t"
+		"pushfl\n\t"
+		"popl %1\n\t"
+		"pushl %0\n\t"
+		"popfl"
+		: "=&r" (flags), "=&r" (toggled));
+	if (!((flags ^ toggled) & 0x200000))
+		return;
+
+	__asm__ __volatile__("cpuid"
+		: "=d" (edx) : "a" (1) : "bx", "cx");
+	has_tsc = (edx & X86_FEATURE_TSC) != 0;
+	if (!(edx & X86_FEATURE_FXSR))
+		return;
+
+	/* Tell the CPU we save SSE state, or SSE instructions fault */
+	__asm__ __volatile__("movl %%cr4,%%eax\n\t"
+		"orl %0,%%eax\n\t"
+		"movl %%eax,%%cr4"
+		: : "i" (X86_CR4_OSFXSR | X86_CR4_OSXMMEXCPT) : "ax");
+	has_fxsr = 1;
+	has_xmm = (edx & X86_FEATURE_XMM) != 0;
+}
+
+/**
+ * math_alloc - Get a save area, 16-aligned as FXSAVE wants
+ *
+ * May sleep in get_free_page() when the free list is empty.
+ * Returns NULL when out of memory.
+ */
+static union i387_union *math_alloc(void)
+{
+	union i387_union *area;
+	unsigned long page, flags;
+	int i;
+
+	if (!math_free_areas) {
+		page = get_free_page();
+		if (!page)
+			return NULL;
+		save_flags(flags);
+		cli();
+		for (i = 0; i < PAGE_SIZE / sizeof(union i387_union); i++) {
+			area = (union i387_union *) page + i;
+			*(union i387_union **) area = math_free_areas;
+			math_free_areas = area;
+		}
+		restore_flags(flags);
+	}
+
+	save_flags(flags);
+	cli();
+	area = math_free_areas;
+	math_free_areas = *(union i387_union **) area;
+	restore_flags(flags);
+	return area;
+}
+
+/**
+ * math_release - Give a task's save area back
+ * @p: Task being released, no longer the FPU owner
+ */
+void math_release(struct task_struct *p)
+{
+	unsigned long flags;
+
+	if (!p->i387)
+		return;
+	save_flags(flags);
+	cli();
+	*(union i387_union **) p->i387 = math_free_areas;
+	math_free_areas = p->i387;
+	restore_flags(flags);
+	p->i387 = NULL;
+	p->used_math = 0;
+}
+
+/**
+ * math_fork - Give a new child its own copy of the FPU state
+ * @p: Child, a copy of current whose i387 pointer is not yet its own
+ *
+ * Returns 0, or -EAGAIN if no save area could be had.
+ */
+int math_fork(struct task_struct *p)
+{
+	p->i387 = NULL;
+	p->used_math = 0;
+	if (!current->used_math)
+		return 0;
+
+	p->i387 = math_alloc();
+	if (!p->i387)
+		return -EAGAIN;
+	if (last_task_used_math == current)
+		math_save(current);	/* The child gets the live FPU state */
+	*p->i387 = *current->i387;
+	p->used_math = 1;
+	return 0;
+}
+
+/**
+ * math_save - Write the FPU state back to its task
+ * @p: Task owning the unit, last_task_used_math
+ *
+ * Leaves the unit free with TS set, so the next FPU instruction of any
+ * task traps and reloads. FNSAVE would have reset the unit anyway.
+ */
+void math_save(struct task_struct *p)
+{
+	clts();
+	if (has_fxsr)
+		__asm__ __volatile__("fxsave %0" : "=m" (p->i387->fxsave));
+	else
+		__asm__ __volatile__("fnsave %0" : "=m" (p->i387->fsave));
+	__asm__ __volatile__("fwait");
+	last_task_used_math = NULL;
+	stts();
+}
+
+/**
+ * math_state_restore - Give the FPU to the current task
+ *
+ * Device-not-available trap, entered with TS already cleared. A task
+ * using the FPU for the first time gets its save area here and starts
+ * from FNINIT state; without one it is sent SIGSEGV.
+ */
 void math_state_restore(void)
 {
-	struct msg_sched_task msg;
-	
-	msg.header.msg_id = MSG_SCHED_MATH_RESTORE;
-	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = 0;
-	msg.header.size = sizeof(msg);
-	msg.task_id = kernel_state->current_task;
-	msg.caps = current_capability;
+	if (last_task_used_math == current)
+		return;
+
+	/* Allocated before the switch, get_free_page() may sleep */
+	if (!current->i387 && !(current->i387 = math_alloc())) {
+		stts();
+		current->signal |= 1 << (SIGSEGV - 1);
+		return;
+	}
+
+	if (last_task_used_math)
+		math_save(last_task_used_math);
+	clts();
+
+	if (current->used_math) {
+		if (has_fxsr)
+			__asm__ __volatile__("fxrstor %0" : : "m" (current->i387->fxsave));
+		else
+			__asm__ __volatile__("frstor %0" : : "m" (current->i387->fsave));
+	} else {
+		__asm__ __volatile__("fninit");
+		if (has_xmm) {
+			unsigned long mxcsr = MXCSR_DEFAULT;
+			__asm__ __volatile__("ldmxcsr %0" : : "m" (mxcsr));
+		}
+		current->used_math = 1;
+	}
 
-	mk_msg_send(kernel_state->process_server, &msg, sizeof(msg));
-	
-	/* Update local cache */
 	last_task_used_math = current;
 }
 
+/*=============================================================================
+ * RUN QUEUE
+ *============================================================================*/
+
+/*
+ * One FIFO list per priority level and a bitmap of the non-empty ones, so
+ * picking the next task is a single bsrl however many tasks are runnable.
+ * Only the mechanism lives here: which level and timeslice a task gets is
+ * decided by the process server and handed down with MK_SCHED_CONTROL.
+ *
+ * Task 0 is the idle task and is never queued; it runs when the bitmap is
+ * empty. Everything below runs with interrupts off (uniprocessor).
+ */
+static struct {
+	unsigned long bitmap;
+	struct task_struct *head[SCHED_NR_PRIO];
+	struct task_struct *tail[SCHED_NR_PRIO];
+} runqueue;
+
+/* Set when a wakeup outranks the running task; checked on syscall return */
+int need_resched = 0;
+
+/**
+ * sched_level - Run queue level of a task
+ * @p: Task
+ */
+static inline int sched_level(struct task_struct *p)
+{
+	if (p->policy == MK_SCHED_IDLE || p->priority < 0)
+		return 0;
+	if (p->priority >= SCHED_NR_PRIO)
+		return SCHED_NR_PRIO - 1;
+	return p->priority;
+}
+
+/**
+ * rq_add - Queue a task at the tail of its level
+ * @p: Task, not queued
+ */
+static void rq_add(struct task_struct *p)
+{
+	int level = sched_level(p);
+
+	p->run_level = level;
+	p->run_next = NULL;
+	p->run_prev = runqueue.tail[level];
+	if (runqueue.tail[level])
+		runqueue.tail[level]->run_next = p;
+	else
+		runqueue.head[level] = p;
+	runqueue.tail[level] = p;
+	runqueue.bitmap |= 1UL << level;
+}
+
+/**
+ * rq_del - Take a task off its level
+ * @p: Task, queued
+ */
+static void rq_del(struct task_struct *p)
+{
+	int level = p->run_level;
+
+	if (p->run_prev)
+		p->run_prev->run_next = p->run_next;
+	else
+		runqueue.head[level] = p->run_next;
+	if (p->run_next)
+		p->run_next->run_prev = p->run_prev;
+	else
+		runqueue.tail[level] = p->run_prev;
+	if (!runqueue.head[level])
+		runqueue.bitmap &= ~(1UL << level);
+	p->run_next = p->run_prev = NULL;
+	p->run_level = -1;
+}
+
+/**
+ * rq_pick - Highest priority runnable task
+ *
+ * Returns the head of the highest non-empty level, or the idle task.
+ */
+static inline struct task_struct *rq_pick(void)
+{
+	unsigned long level;
+
+	if (!runqueue.bitmap)
+		return task[0];
+	__asm__("bsrl %1,%0" : "=r" (level) : "rm" (runqueue.bitmap));
+	return runqueue.head[level];
+}
+
+/**
+ * wake_up_process - Make a task runnable
+ * @p: Task to wake
+ *
+ * Queues @p and asks for a reschedule if it outranks the running task.
+ * Safe from interrupt handlers.
+ */
+void wake_up_process(struct task_struct *p)
+{
+	unsigned long flags;
+
+	if (!p)
+		return;
+
+	save_flags(flags);
+	cli();
+	p->state = TASK_RUNNING;
+	if (p->run_level < 0 && p != task[0]) {
+		rq_add(p);
+		if (current && p->run_level > current->run_level)
+			need_resched = 1;
+	}
+	restore_flags(flags);
+}
+
+/**
+ * signal_wake_up - Wake a task for a newly posted signal
+ * @p: Task the signal was posted to
+ *
+ * Only interruptible sleepers are woken, and only for unblocked signals.
+ */
+void signal_wake_up(struct task_struct *p)
+{
+	if (p && p->state == TASK_INTERRUPTIBLE && (p->signal & ~p->blocked))
+		wake_up_process(p);
+}
+
+/**
+ * sched_set_priority - Change the priority of a task
+ * @p: Task
+ * @priority: New priority
+ *
+ * Moves @p to its new level if it is queued. Used by MK_SCHED_CONTROL and
+ * by IPC priority inheritance.
+ */
+void sched_set_priority(struct task_struct *p, long priority)
+{
+	unsigned long flags;
+
+	save_flags(flags);
+	cli();
+	p->priority = priority;
+	if (p->run_level >= 0 && p->run_level != sched_level(p)) {
+		rq_del(p);
+		rq_add(p);
+	}
+	if (p != current && p->state == TASK_RUNNING && current &&
+	    sched_level(p) > current->run_level)
+		need_resched = 1;
+	restore_flags(flags);
+}
+
+/**
+ * sched_fork - Set up scheduling state for a new task
+ * @p: New task, not yet runnable
+ * @nr: Its slot in task[]
+ *
+ * The child inherits the parent's policy and timeslice, and its own
+ * priority rather than one it is inheriting over IPC.
+ */
+void sched_fork(struct task_struct *p, int nr)
+{
+	p->sched_nr = nr;
+	p->run_next = p->run_prev = NULL;
+	p->run_level = -1;
+	p->policy = current->policy;
+	p->timeslice = current->timeslice;
+	if (current->ipc_base_priority)
+		p->priority = current->ipc_base_priority;
+	else
+		p->priority = current->priority;
+	p->ipc_base_priority = 0;
+	p->counter = p->timeslice;
+	p->donor = NULL;
+	p->donated = 0;
+}
+
 /*=============================================================================
  * SCHEDULER
  *============================================================================*/
 
+#if CONFIG_NO_HZ
+static void tick_update(struct task_struct *next);
+static void tick_timer_added(unsigned long expires);
+#else
+#define tick_update(next)	do { } while (0)
+#define tick_timer_added(expires)	do { } while (0)
+#endif
+
+/**
+ * schedule - Switch to the highest priority runnable task
+ *
+ * A task that is no longer running leaves the run queue; one that used up
+ * its timeslice gets a fresh one and goes to the back of its level.
+ */
 void schedule(void)
 {
-	struct msg_sched_task msg;
-	struct msg_sched_reply reply;
-	unsigned int reply_size = sizeof(reply);
-	int next_task;
+	struct task_struct *next;
+	unsigned long flags;
+
+	save_flags(flags);
+	cli();
+	need_resched = 0;
+
+	if (current->state != TASK_RUNNING) {
+		if (current->run_level >= 0)
+			rq_del(current);
+	} else if (current->counter <= 0 && current->run_level >= 0) {
+		current->counter = current->timeslice;
+		rq_del(current);
+		rq_add(current);
+	}
 
-	/* Send schedule request to process server */
-	msg.header.msg_id = MSG_SCHED_SCHEDULE;
-	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
-	msg.header.size = sizeof(msg);
-	msg.task_id = kernel_state->current_task;
-	msg.caps = current_capability;
+	next = rq_pick();
+	if (next != current) {
+		tick_update(next);
+		kernel_state->current_task = next->sched_nr;
+		switch_to(next->sched_nr);
+	}
+	restore_flags(flags);
+}
 
-	if (mk_msg_send(kernel_state->process_server, &msg, sizeof(msg)) < 0)
-		return;
+/**
+ * sched_return_loan - Give a caller back what is left of its timeslice
+ * @p: Caller the current task has just replied to
+ *
+ * Does nothing unless @p lent its timeslice to the current task. Every
+ * reply path calls it, whether or not it then switches back to @p.
+ */
+void sched_return_loan(struct task_struct *p)
+{
+	unsigned long flags;
+
+	save_flags(flags);
+	cli();
+	if (p && current->donor == p) {
+		p->counter += current->donated;
+		current->donated = 0;
+		current->donor = NULL;
+	}
+	restore_flags(flags);
+}
 
-	if (mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size) < 0)
-		return;
+/**
+ * schedule_to - Block and switch straight to a given task
+ * @p: Task the current one just woke and is now waiting on
+ * @how: SCHED_TO_CALL or SCHED_TO_REPLY
+ *
+ * Used for synchronous IPC: a caller switches to the server it handed its
+ * request to, and the server back to the caller it replied to, without a
+ * trip through rq_pick(). On a call the caller lends the rest of its
+ * timeslice; ticks spent by @p come out of the loan first, so the work
+ * done for the caller is charged to it. A reply returns what is left.
+ * Only a call lends: a server switching to a caller never gives the
+ * caller its own slice.
+ *
+ * Falls back to schedule() when @p is not runnable, or when a task of
+ * higher priority is waiting, which must not be skipped.
+ */
+void schedule_to(struct task_struct *p, int how)
+{
+	unsigned long flags;
 
-	next_task = reply.result;
+	save_flags(flags);
+	cli();
 
-	/* If we need to switch tasks, do it */
-	if (next_task >= 0 && next_task != kernel_state->current_task) {
-		/* Update current task pointer */
-		current = task[next_task];
-		kernel_state->current_task = next_task;
-		
-		/* Perform context switch (would be handled by server) */
-		/* In a real microkernel, the server would have already
-		 * switched the task context before replying */
+	if (current->state == TASK_RUNNING || p == current ||
+	    p->state != TASK_RUNNING || p->run_level < 0 ||
+	    rq_pick()->run_level > p->run_level) {
+		restore_flags(flags);
+		schedule();
+		return;
+	}
+
+	need_resched = 0;
+	if (current->run_level >= 0)
+		rq_del(current);
+
+	if (how == SCHED_TO_REPLY) {
+		/* Normally returned already, when the reply was delivered */
+		sched_return_loan(p);
+	} else if (current->counter > 0) {
+		/* Call: a new loan replaces any the server did not return */
+		p->donor = current;
+		p->donated = current->counter;
+		current->counter = 0;
 	}
+
+	tick_update(p);
+	kernel_state->current_task = p->sched_nr;
+	switch_to(p->sched_nr);
+	restore_flags(flags);
 }
 
 /*=============================================================================
@@ -266,70 +712,301 @@ int sys_pause(void)
 	return sched_request(MSG_SCHED_PAUSE, 0, 1);
 }
 
-void sleep_on(struct task_struct **p)
+/*=============================================================================
+ * WAIT QUEUES
+ *============================================================================*/
+
+/*
+ * Sleepers are kept in a hash table keyed by the address they wait on,
+ * like futexes, so nothing has to be set up per queue and a wake costs a
+ * walk of one short bucket. Kernel keys are plain addresses (such as the
+ * task_struct ** of sleep_on); words waited on through MK_WAIT are keyed
+ * by linear address with bit 0 set, so the two never meet.
+ * Each bucket is FIFO, so wake-one goes to the longest sleeper.
+ */
+#define WAIT_HASH_BITS	6
+#define WAIT_HASH_SIZE	(1 << WAIT_HASH_BITS)
+
+#define wait_hashfn(key) \
+	((unsigned int) (((key) >> 2) * 0x9e3779b1UL) >> (32 - WAIT_HASH_BITS))
+
+struct wait_entry {
+	unsigned long key;		/* Address slept on */
+	struct task_struct *task;	/* Sleeper */
+	struct wait_entry *next;	/* Next in the bucket */
+	struct wait_entry **pprev;	/* Link to us, NULL once off the bucket */
+	int woken;			/* Taken off by a wake */
+	int timed_out;			/* Set by the MK_WAIT timeout */
+};
+
+static struct wait_bucket {
+	struct wait_entry *head;
+	struct wait_entry **tail;
+} wait_hash[WAIT_HASH_SIZE];
+
+/**
+ * wait_enqueue - Put the current task on the bucket of @key
+ * @w: Entry on the caller's stack
+ * @key: Address to sleep on
+ *
+ * Must be called with interrupts disabled.
+ */
+static void wait_enqueue(struct wait_entry *w, unsigned long key)
 {
-	struct msg_sched_task msg;
-	
-	if (!p)
-		return;
-	
-	/* Task 0 (idle) shouldn't sleep */
-	if (current == &init_task.task) {
-		printk("task[0] trying to sleep - ignored\n");
-		return;
+	struct wait_bucket *b = &wait_hash[wait_hashfn(key)];
+
+	if (!b->tail)
+		b->tail = &b->head;
+
+	w->key = key;
+	w->task = current;
+	w->woken = 0;
+	w->timed_out = 0;
+	w->next = NULL;
+	w->pprev = b->tail;
+	*b->tail = w;
+	b->tail = &w->next;
+}
+
+/**
+ * wait_dequeue - Take an entry off its bucket
+ * @w: Queued entry
+ */
+static void wait_dequeue(struct wait_entry *w)
+{
+	struct wait_bucket *b = &wait_hash[wait_hashfn(w->key)];
+
+	if (w->next)
+		w->next->pprev = w->pprev;
+	else
+		b->tail = w->pprev;
+	*w->pprev = w->next;
+	w->pprev = NULL;
+}
+
+/**
+ * wait_block - Sleep until woken through the entry
+ * @w: Queued entry of the current task
+ * @state: TASK_INTERRUPTIBLE or TASK_UNINTERRUPTIBLE
+ *
+ * Wakeups that did not come through @w (a signal, a stray
+ * wake_up_process) put an uninterruptible sleeper back to sleep.
+ * Must be called with interrupts disabled; returns with them disabled.
+ * Returns 0 when woken, -EINTR on a signal, -EAGAIN on timeout.
+ */
+static int wait_block(struct wait_entry *w, int state)
+{
+	for (;;) {
+		if (w->woken)
+			return 0;
+		if (w->timed_out) {
+			wait_dequeue(w);
+			return -EAGAIN;
+		}
+		if (state == TASK_INTERRUPTIBLE &&
+		    (current->signal & ~current->blocked)) {
+			wait_dequeue(w);
+			return -EINTR;
+		}
+		current->state = state;
+		schedule();
 	}
+}
 
-	msg.header.msg_id = MSG_SCHED_SLEEP_ON;
-	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
-	msg.header.size = sizeof(msg);
-	msg.p = p;
-	msg.task_id = kernel_state->current_task;
-	msg.caps = current_capability;
+/**
+ * sleep_on_key - Sleep on an address until it is woken
+ * @key: Address, any the waker agrees on
+ * @state: TASK_INTERRUPTIBLE or TASK_UNINTERRUPTIBLE
+ *
+ * Check the condition and call this without enabling interrupts in
+ * between, and no wakeup can slip in before the task is queued.
+ * Returns 0 when woken, -EINTR if a signal came first.
+ */
+int sleep_on_key(unsigned long key, int state)
+{
+	struct wait_entry w;
+	unsigned long flags;
+	int result;
 
-	mk_msg_send(kernel_state->process_server, &msg, sizeof(msg));
-	/* Will block until woken */
+	save_flags(flags);
+	cli();
+	wait_enqueue(&w, key);
+	result = wait_block(&w, state);
+	restore_flags(flags);
+	return result;
 }
 
-void interruptible_sleep_on(struct task_struct **p)
+/**
+ * wake_up_key - Wake tasks sleeping on an address
+ * @key: Address
+ * @nr: Most tasks to wake, in the order they went to sleep
+ *
+ * Safe from interrupt handlers. Returns the number of tasks woken.
+ */
+int wake_up_key(unsigned long key, int nr)
 {
-	struct msg_sched_task msg;
-	
+	struct wait_entry *w, *next;
+	unsigned long flags;
+	int woken = 0;
+
+	save_flags(flags);
+	cli();
+	for (w = wait_hash[wait_hashfn(key)].head; w && woken < nr; w = next) {
+		next = w->next;
+		if (w->key != key)
+			continue;
+		wait_dequeue(w);
+		w->woken = 1;
+		wake_up_process(w->task);
+		woken++;
+	}
+	restore_flags(flags);
+	return woken;
+}
+
+/**
+ * wait_first - First task still sleeping on an address
+ * @key: Address
+ */
+static struct task_struct *wait_first(unsigned long key)
+{
+	struct wait_entry *w;
+
+	for (w = wait_hash[wait_hashfn(key)].head; w; w = w->next)
+		if (w->key == key)
+			return w->task;
+	return NULL;
+}
+
+/*
+ * The old interface. *p still names a sleeper while there is one, for
+ * the drivers that test it, but the queue itself is the hash bucket.
+ */
+static void __sleep_on(struct task_struct **p, int state)
+{
+	unsigned long flags;
+
 	if (!p)
 		return;
-	
-	if (current == &init_task.task) {
+
+	/* Task 0 (idle) shouldn't sleep */
+	if (current == task[0]) {
 		printk("task[0] trying to sleep - ignored\n");
 		return;
 	}
 
-	msg.header.msg_id = MSG_SCHED_INTR_SLEEP;
-	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
-	msg.header.size = sizeof(msg);
-	msg.p = p;
-	msg.task_id = kernel_state->current_task;
-	msg.caps = current_capability;
+	save_flags(flags);
+	cli();
+	*p = current;
+	if (sleep_on_key((unsigned long) p, state) < 0 && *p == current)
+		*p = wait_first((unsigned long) p);
+	restore_flags(flags);
+}
 
-	mk_msg_send(kernel_state->process_server, &msg, sizeof(msg));
+void sleep_on(struct task_struct **p)
+{
+	__sleep_on(p, TASK_UNINTERRUPTIBLE);
+}
+
+void interruptible_sleep_on(struct task_struct **p)
+{
+	__sleep_on(p, TASK_INTERRUPTIBLE);
 }
 
 void wake_up(struct task_struct **p)
 {
-	struct msg_sched_task msg;
-	
 	if (!p || !*p)
 		return;
 
-	msg.header.msg_id = MSG_SCHED_WAKE_UP;
-	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = 0;
-	msg.header.size = sizeof(msg);
-	msg.p = p;
-	msg.task_id = kernel_state->current_task;
-	msg.caps = current_capability;
+	*p = NULL;
+	wake_up_key((unsigned long) p, MK_WAKE_ALL);
+}
+
+/**
+ * wait_user_key - Key of a word in the caller's data segment
+ * @addr: Word, 4-byte aligned
+ *
+ * Linear, so tasks sharing the page agree on it; bit 0 marks it a user key.
+ */
+static inline unsigned long wait_user_key(unsigned long *addr)
+{
+	struct desc_struct *d = &current->ldt[2];
+	unsigned long base;
+
+	base = (d->a >> 16) | ((d->b & 0xff) << 16) | (d->b & 0xff000000);
+	return (base + (unsigned long) addr) | 1;
+}
+
+/**
+ * wait_timeout - Timer handler bounding an MK_WAIT
+ * @data: The wait entry
+ */
+static void wait_timeout(unsigned long data)
+{
+	struct wait_entry *w = (struct wait_entry *) data;
+
+	w->timed_out = 1;
+	wake_up_process(w->task);
+}
+
+/**
+ * sys_wait - Sleep on a word while it holds a given value
+ * @addr: Word in user space, 4-byte aligned
+ * @val: Value it is expected to hold
+ * @timeout: Most jiffies to sleep, 0 for no limit
+ *
+ * The word is compared and the task queued with interrupts off, so a
+ * server that changes the word and then calls MK_WAKE is never missed.
+ * Returns 0 when woken, -EAGAIN if the word differs or the time ran
+ * out, -EINTR on a signal.
+ */
+int sys_wait(unsigned long *addr, unsigned long val, long timeout)
+{
+	struct wait_entry w;
+	struct timer_list timer;
+	unsigned long flags;
+	int result;
+
+	if (((unsigned long) addr & 3) || timeout < 0)
+		return -EINVAL;
+
+	/* Fault the word in now, the read below must not sleep */
+	get_fs_long(addr);
+
+	save_flags(flags);
+	cli();
+	if (get_fs_long(addr) != val) {
+		restore_flags(flags);
+		return -EAGAIN;
+	}
+
+	wait_enqueue(&w, wait_user_key(addr));
+	if (timeout) {
+		init_timer(&timer, wait_timeout, (unsigned long) &w);
+		mod_timer(&timer, jiffies + timeout);
+	}
+	result = wait_block(&w, TASK_INTERRUPTIBLE);
+	if (timeout)
+		del_timer(&timer);
+	restore_flags(flags);
+	return result;
+}
+
+/**
+ * sys_wake - Wake tasks sleeping on a word
+ * @addr: Word in user space
+ * @nr: Most tasks to wake, MK_WAKE_ALL for all
+ *
+ * Returns the number of tasks woken.
+ */
+int sys_wake(unsigned long *addr, int nr)
+{
+	if ((unsigned long) addr & 3)
+		return -EINVAL;
+	if (nr <= 0)
+		return 0;
 
-	mk_msg_send(kernel_state->process_server, &msg, sizeof(msg));
+	return wake_up_key(wait_user_key(addr), nr);
 }
 
 /*=============================================================================
@@ -349,7 +1026,7 @@ int ticks_to_floppy_on(unsigned int nr)
 	
 	msg.header.msg_id = MSG_FLOPPY_TICKS_ON;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	msg.drive = nr;
 	msg.task_id = kernel_state->current_task;
@@ -358,7 +1035,7 @@ int ticks_to_floppy_on(unsigned int nr)
 	if (mk_msg_send(kernel_state->device_server, &msg, sizeof(msg)) < 0)
 		return 0;
 
-	if (mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size) < 0)
+	if (mk_msg_receive(ipc_reply_port(), &reply, &reply_size) < 0)
 		return 0;
 
 	return reply.result;
@@ -366,133 +1043,651 @@ int ticks_to_floppy_on(unsigned int nr)
 
 void floppy_on(unsigned int nr)
 {
-	struct msg_floppy_on msg;
-	
-	msg.header.msg_id = MSG_FLOPPY_ON;
-	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = 0;
-	msg.header.size = sizeof(msg);
-	msg.drive = nr;
-	msg.task_id = kernel_state->current_task;
-	msg.caps = current_capability;
-
-	mk_msg_send(kernel_state->device_server, &msg, sizeof(msg));
+	ipc_notify(kernel_state->device_server, FLOPPY_NOTIFY_ON(nr));
 }
 
 void floppy_off(unsigned int nr)
 {
-	struct msg_floppy_off msg;
-	
-	msg.header.msg_id = MSG_FLOPPY_OFF;
-	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = 0;
-	msg.header.size = sizeof(msg);
-	msg.drive = nr;
-	msg.task_id = kernel_state->current_task;
-	msg.caps = current_capability;
-
-	mk_msg_send(kernel_state->device_server, &msg, sizeof(msg));
+	ipc_notify(kernel_state->device_server, FLOPPY_NOTIFY_OFF(nr));
 }
 
 void do_floppy_timer(void)
 {
-	struct msg_floppy_timer msg;
-	
-	msg.header.msg_id = MSG_FLOPPY_TIMER;
-	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = 0;
-	msg.header.size = sizeof(msg);
-	msg.task_id = kernel_state->current_task;
-	msg.caps = current_capability;
-
-	mk_msg_send(kernel_state->device_server, &msg, sizeof(msg));
+	ipc_notify(kernel_state->device_server, FLOPPY_NOTIFY_TIMER);
 }
 
 /*=============================================================================
  * TIMER FUNCTIONS
  *============================================================================*/
 
+/*
+ * Timers hang off a hierarchical timing wheel: tv1 holds the next
+ * TVR_SIZE jiffies one slot per tick, each further level covers TVN_SIZE
+ * slots of the level below. Insert and cancel are O(1); a timer is
+ * cascaded down at most once per level, so expiry is amortized O(1) and
+ * a tick costs only the timers that actually fire.
+ */
+#define TVN_BITS	6
+#define TVR_BITS	8
+#define TVN_SIZE	(1 << TVN_BITS)
+#define TVR_SIZE	(1 << TVR_BITS)
+#define TVN_MASK	(TVN_SIZE - 1)
+#define TVR_MASK	(TVR_SIZE - 1)
+
+#define TV_SHIFT(n)	(TVR_BITS + (n) * TVN_BITS)
+#define TV_INDEX(n)	((timer_jiffies >> TV_SHIFT(n)) & TVN_MASK)
+
+static struct timer_list *tv1[TVR_SIZE];
+static struct timer_list *tv2[TVN_SIZE];
+static struct timer_list *tv3[TVN_SIZE];
+static struct timer_list *tv4[TVN_SIZE];
+static struct timer_list *tv5[TVN_SIZE];
+
+/* Next tick the wheel has to process */
+static unsigned long timer_jiffies = 0;
+static unsigned int nr_timers = 0;
+
+/*
+ * add_timer() entries; the old interface has no handle to cancel with,
+ * so they come from a fixed pool like the original timer_list array.
+ */
 #define TIME_REQUESTS 64
 
-static struct timer_list {
-	long jiffies;
-	void (*fn)();
-	struct timer_list * next;
-} timer_list[TIME_REQUESTS], * next_timer = NULL;
+static struct fn_timer {
+	struct timer_list timer;
+	void (*fn)(void);
+} fn_timers[TIME_REQUESTS];
+
+static struct timer_list *free_fn_timers = NULL;
+static int fn_timers_ready = 0;
+
+/* alarm() timers, one per task slot */
+static struct timer_list alarm_timers[NR_TASKS];
 
-void add_timer(long jiffies, void (*fn)(void))
+/**
+ * internal_add_timer - Link a timer into the wheel
+ * @timer: Timer with expires set
+ * 
+ * Must be called with interrupts disabled.
+ */
+static void internal_add_timer(struct timer_list *timer)
 {
-	struct msg_sched_timer msg;
-	
-	if (!fn)
-		return;
+	unsigned long expires = timer->expires;
+	unsigned long idx = expires - timer_jiffies;
+	struct timer_list **vec;
+
+	if ((long) idx < 0)
+		vec = tv1 + (timer_jiffies & TVR_MASK);	/* Already due */
+	else if (idx < TVR_SIZE)
+		vec = tv1 + (expires & TVR_MASK);
+	else if (idx < 1UL << TV_SHIFT(1))
+		vec = tv2 + ((expires >> TV_SHIFT(0)) & TVN_MASK);
+	else if (idx < 1UL << TV_SHIFT(2))
+		vec = tv3 + ((expires >> TV_SHIFT(1)) & TVN_MASK);
+	else if (idx < 1UL << TV_SHIFT(3))
+		vec = tv4 + ((expires >> TV_SHIFT(2)) & TVN_MASK);
+	else
+		vec = tv5 + ((expires >> TV_SHIFT(3)) & TVN_MASK);
+
+	timer->next = *vec;
+	if (timer->next)
+		timer->next->pprev = &timer->next;
+	timer->pprev = vec;
+	*vec = timer;
+}
 
-	msg.header.msg_id = MSG_SCHED_ADD_TIMER;
-	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = 0;
-	msg.header.size = sizeof(msg);
-	msg.jiffies = jiffies;
-	msg.fn = fn;
-	msg.task_id = kernel_state->current_task;
-	msg.caps = current_capability;
+/**
+ * detach_timer - Unlink a pending timer
+ * @timer: Timer on the wheel
+ */
+static inline void detach_timer(struct timer_list *timer)
+{
+	if (timer->next)
+		timer->next->pprev = timer->pprev;
+	*timer->pprev = timer->next;
+	timer->pprev = NULL;
+}
+
+/**
+ * cascade - Redistribute one slot of an outer level
+ * @tv: Level
+ * @index: Slot whose time has come
+ * 
+ * Returns @index, so the caller moves on to the next level only when
+ * this one wrapped.
+ */
+static int cascade(struct timer_list **tv, int index)
+{
+	struct timer_list *timer, *next;
 
-	mk_msg_send(kernel_state->process_server, &msg, sizeof(msg));
+	timer = tv[index];
+	tv[index] = NULL;
+
+	while (timer) {
+		next = timer->next;
+		internal_add_timer(timer);
+		timer = next;
+	}
+
+	return index;
 }
 
-void do_timer(long cpl)
+/**
+ * init_timer - Prepare a timer for use
+ * @timer: Timer
+ * @function: Called with @data on expiry, interrupts disabled
+ * @data: Argument to @function
+ */
+void init_timer(struct timer_list *timer,
+                void (*function)(unsigned long), unsigned long data)
 {
-	struct msg_sched_timer msg;
-	
-	msg.header.msg_id = MSG_SCHED_DO_TIMER;
-	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = 0;
-	msg.header.size = sizeof(msg);
-	msg.jiffies = cpl;
-	msg.task_id = kernel_state->current_task;
-	msg.caps = current_capability;
+	timer->next = NULL;
+	timer->pprev = NULL;
+	timer->expires = 0;
+	timer->function = function;
+	timer->data = data;
+}
+
+/**
+ * mod_timer - Start or restart a timer
+ * @timer: Initialized timer
+ * @expires: Absolute expiry time in jiffies
+ */
+void mod_timer(struct timer_list *timer, unsigned long expires)
+{
+	unsigned long flags;
+
+	save_flags(flags);
+	cli();
 
-	mk_msg_send(kernel_state->process_server, &msg, sizeof(msg));
+	if (timer->pprev)
+		detach_timer(timer);
+	else
+		nr_timers++;
 
-	/* Update local jiffies count */
-	jiffies++;
+	timer->expires = expires;
+	internal_add_timer(timer);
+	tick_timer_added(expires);
+
+	restore_flags(flags);
+}
 
-	/* Check if we need to reschedule */
-	if (current) {
-		current->counter--;
-		if (current->counter <= 0 && cpl) {
-			schedule();
+/**
+ * del_timer - Cancel a timer
+ * @timer: Timer
+ * 
+ * Returns 1 if the timer was pending, 0 if it had fired or never ran.
+ */
+int del_timer(struct timer_list *timer)
+{
+	unsigned long flags;
+	int pending = 0;
+
+	save_flags(flags);
+	cli();
+
+	if (timer->pprev) {
+		detach_timer(timer);
+		nr_timers--;
+		pending = 1;
+	}
+
+	restore_flags(flags);
+	return pending;
+}
+
+/**
+ * run_timers - Expire due timers
+ * 
+ * Called from do_timer() with interrupts disabled. Catches up tick by
+ * tick, so a late call still fires everything in order.
+ */
+static void run_timers(void)
+{
+	struct timer_list *timer;
+	int index;
+
+	while ((long) (jiffies - timer_jiffies) >= 0) {
+		/* Nothing pending: the wheel is empty, just keep up */
+		if (!nr_timers) {
+			timer_jiffies = jiffies + 1;
+			break;
+		}
+
+		index = timer_jiffies & TVR_MASK;
+		if (!index &&
+		    !cascade(tv2, TV_INDEX(0)) &&
+		    !cascade(tv3, TV_INDEX(1)) &&
+		    !cascade(tv4, TV_INDEX(2)))
+			cascade(tv5, TV_INDEX(3));
+		timer_jiffies++;
+
+		while ((timer = tv1[index]) != NULL) {
+			detach_timer(timer);
+			nr_timers--;
+			timer->function(timer->data);
 		}
 	}
 }
 
+/**
+ * fn_timer_expired - Run an add_timer() function and recycle its entry
+ * @data: The fn_timer
+ */
+static void fn_timer_expired(unsigned long data)
+{
+	struct fn_timer *t = (struct fn_timer *) data;
+	void (*fn)(void) = t->fn;
+
+	t->fn = NULL;
+	t->timer.next = free_fn_timers;
+	free_fn_timers = &t->timer;
+
+	fn();
+}
+
+/**
+ * add_timer - Call a function after a delay
+ * @delay: Jiffies to wait
+ * @fn: Function to call, from the timer interrupt
+ */
+void add_timer(long delay, void (*fn)(void))
+{
+	struct timer_list *timer;
+	struct fn_timer *t;
+	unsigned long flags;
+	int i;
+
+	if (!fn)
+		return;
+
+	save_flags(flags);
+	cli();
+
+	if (delay <= 0) {
+		(fn)();
+		restore_flags(flags);
+		return;
+	}
+
+	if (!fn_timers_ready) {
+		for (i = TIME_REQUESTS - 1; i >= 0; i--) {
+			fn_timers[i].timer.next = free_fn_timers;
+			free_fn_timers = &fn_timers[i].timer;
+		}
+		fn_timers_ready = 1;
+	}
+
+	timer = free_fn_timers;
+	if (!timer)
+		panic("No more time requests free");
+	free_fn_timers = timer->next;
+
+	t = (struct fn_timer *) timer;
+	t->fn = fn;
+	init_timer(timer, fn_timer_expired, (unsigned long) t);
+	mod_timer(timer, jiffies + delay);
+
+	restore_flags(flags);
+}
+
 /*=============================================================================
- * SYSTEM CALLS
+ * TICK SOURCE
  *============================================================================*/
 
-int sys_alarm(long seconds)
+/*
+ * With CONFIG_NO_HZ the PIT runs one-shot (mode 0), armed for the next
+ * thing that needs the CPU: the first pending timer, or the end of the
+ * running task's turn when it has to share its level. Each interrupt
+ * accounts for every jiffy since the last one in one go, so a busy task
+ * takes one interrupt per timeslice and an idle system only the longest
+ * shot the PIT allows (about 55 ms, which keeps jiffies going). Without
+ * it the PIT ticks at HZ as before.
+ *
+ * The PIT belongs to the kernel and is driven from the interrupt, so it
+ * is programmed with direct port I/O rather than the device server's outb.
+ */
+#define PIT_HZ		1193180			/* PIT input clock */
+#define LATCH		((PIT_HZ + HZ/2) / HZ)	/* PIT clocks per jiffy */
+#define PIT_MAX_SHOT	0xffff			/* Longest one-shot count */
+#define PIT_MIN_SHOT	64			/* Shortest worth arming */
+#define TICK_MAX	(PIT_MAX_SHOT / LATCH)	/* Whole jiffies in a shot */
+
+/* How often CPU times are pushed to the process server, in jiffies */
+#define ACCT_INTERVAL	HZ
+
+static unsigned long acct_next = ACCT_INTERVAL;
+
+static inline void pit_out(unsigned char value, unsigned short port)
 {
-	struct msg_sched_task msg;
-	struct msg_sched_reply reply;
-	unsigned int reply_size = sizeof(reply);
-	int result;
+	__asm__ __volatile__("outb %%al,%%dx" : : "a" (value), "d" (port));
+}
 
-	msg.header.msg_id = MSG_SCHED_ALARM;
-	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
-	msg.header.size = sizeof(msg);
-	msg.task_id = kernel_state->current_task;
-	msg.param = seconds;
-	msg.caps = current_capability;
+static inline unsigned char pit_in(unsigned short port)
+{
+	unsigned char value;
 
-	result = mk_msg_send(kernel_state->process_server, &msg, sizeof(msg));
-	if (result < 0)
-		return -1;
+	__asm__ __volatile__("inb %%dx,%%al" : "=a" (value) : "d" (port));
+	return value;
+}
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
-	if (result < 0)
+#if CONFIG_NO_HZ
+
+static unsigned long tick_shot;		/* PIT clocks in the armed shot */
+static unsigned long tick_seen;		/* Clocks of it already in tick_rest */
+static unsigned long tick_rest;		/* Clocks since the last whole jiffy */
+static unsigned long tick_end;		/* Jiffy the armed shot was aimed at */
+static unsigned long tick_owed;		/* Jiffies counted but not yet charged */
+static int tick_armed;			/* Shot running and not yet expired */
+
+/**
+ * pit_elapsed - PIT clocks since the armed shot started
+ *
+ * In mode 0 the counter keeps going after it hits zero and OUT stays
+ * high, so a late read still gives the exact time.
+ */
+static unsigned long pit_elapsed(void)
+{
+	unsigned char status;
+	unsigned int count;
+
+	pit_out(0xc2, 0x43);		/* Read back status and count, ch 0 */
+	status = pit_in(0x40);
+	count = pit_in(0x40);
+	count |= pit_in(0x40) << 8;
+
+	if (status & 0x40)		/* Count not loaded yet */
+		return 0;
+	if (status & 0x80)		/* OUT high: expired, counter wrapped */
+		return tick_shot + ((0x10000 - count) & 0xffff);
+	return tick_shot - count;
+}
+
+/**
+ * tick_next_event - Jiffies until something needs the CPU
+ * @p: Task that will be running
+ *
+ * Anything past the longest shot counts as TICK_MAX + 1.
+ */
+static unsigned long tick_next_event(struct task_struct *p)
+{
+	unsigned long ticks = TICK_MAX + 1;
+	unsigned long t, j;
+
+	/* End of the turn; a FIFO or idle task has none */
+	if (p != task[0] && p->policy == MK_SCHED_NORMAL) {
+		t = p->donated + (p->counter > 0 ? p->counter : 0);
+		if (t < ticks)
+			ticks = t;
+	}
+
+	/*
+	 * First busy slot of tv1 not yet run; slot 0 cascades the outer
+	 * levels, which may bring a timer due there too. After tick_sync()
+	 * the wheel can lag jiffies, and anything it lags by is due now.
+	 */
+	if (nr_timers) {
+		for (j = timer_jiffies; (long) (j - jiffies) < (long) ticks; j++) {
+			if (tv1[j & TVR_MASK] || !(j & TVR_MASK)) {
+				ticks = (long) (j - jiffies) > 0 ? j - jiffies : 1;
+				break;
+			}
+		}
+	}
+
+	return ticks ? ticks : 1;
+}
+
+/**
+ * tick_program - Arm the PIT for a number of jiffies from now
+ * @ticks: Jiffies past the last accounted one
+ *
+ * The shot ends on a jiffy boundary. Must be called with interrupts
+ * disabled.
+ */
+static void tick_program(unsigned long ticks)
+{
+	long shot;
+
+	if (ticks > TICK_MAX)
+		ticks = TICK_MAX;
+	shot = ticks * LATCH - tick_rest;
+	if (shot < PIT_MIN_SHOT)
+		shot = PIT_MIN_SHOT;
+
+	pit_out(0x30, 0x43);		/* ch 0, LSB/MSB, mode 0 */
+	pit_out(shot & 0xff, 0x40);
+	pit_out(shot >> 8, 0x40);
+
+	tick_shot = shot;
+	tick_seen = 0;
+	tick_end = jiffies + ticks;
+	tick_armed = 1;
+}
+
+/**
+ * tick_sync - Bring jiffies up to date between interrupts
+ *
+ * Folds the part of the armed shot that has run into jiffies, so a new
+ * shot is measured from now rather than from the last interrupt, up to
+ * TICK_MAX jiffies ago. The running task is charged for those jiffies
+ * at the next interrupt. Must be called with interrupts disabled.
+ * Returns the number of jiffies folded in.
+ */
+static unsigned long tick_sync(void)
+{
+	unsigned long now = pit_elapsed();
+	unsigned long ticks;
+
+	tick_rest += now - tick_seen;
+	tick_seen = now;
+	ticks = tick_rest / LATCH;
+	tick_rest %= LATCH;
+	jiffies += ticks;
+	tick_owed += ticks;
+	return ticks;
+}
+
+/**
+ * tick_update - Bring the shot forward if @next needs the CPU sooner
+ * @next: Task about to run
+ *
+ * Called on a context switch and from the interrupt. The PIT is only
+ * read once the shot is known to come too late; the new one is only
+ * worked out again if that moved jiffies, since the scan of tv1 is
+ * relative to it. A shot that has already run out is left alone; its
+ * interrupt re-arms.
+ */
+static void tick_update(struct task_struct *next)
+{
+	unsigned long flags;
+	unsigned long ticks;
+
+	save_flags(flags);
+	cli();
+	if (tick_armed) {
+		ticks = tick_next_event(next);
+		if ((long) (jiffies + ticks - tick_end) < 0) {
+			if (tick_sync())
+				ticks = tick_next_event(next);
+			tick_program(ticks);
+		}
+	}
+	restore_flags(flags);
+}
+
+/**
+ * tick_timer_added - Re-arm for a timer that is due before the shot
+ * @expires: Jiffy the timer is due
+ *
+ * Most timers, IPC timeouts among them, are due well after the armed
+ * shot and cost nothing here. Must be called with interrupts disabled.
+ */
+static void tick_timer_added(unsigned long expires)
+{
+	if (tick_armed && (long) (expires - tick_end) < 0)
+		tick_update(current);
+}
+
+/**
+ * tick_elapsed - Whole jiffies since the last timer interrupt
+ *
+ * Any fraction carries over to the next interrupt.
+ */
+static unsigned long tick_elapsed(void)
+{
+	unsigned long ticks;
+
+	tick_rest += pit_elapsed() - tick_seen;
+	tick_armed = 0;
+	ticks = tick_rest / LATCH;
+	tick_rest %= LATCH;
+	return ticks;
+}
+
+/**
+ * tick_owed_take - Jiffies tick_sync() counted since the last interrupt
+ */
+static unsigned long tick_owed_take(void)
+{
+	unsigned long ticks = tick_owed;
+
+	tick_owed = 0;
+	return ticks;
+}
+
+static void tick_init(void)
+{
+	tick_rest = 0;
+	tick_owed = 0;
+	tick_program(1);
+}
+
+#else /* !CONFIG_NO_HZ */
+
+#define tick_elapsed()		1UL
+#define tick_owed_take()	0UL
+
+static void tick_init(void)
+{
+	pit_out(0x34, 0x43);		/* ch 0, LSB/MSB, mode 2 */
+	pit_out(LATCH & 0xff, 0x40);
+	pit_out(LATCH >> 8, 0x40);
+}
+
+#endif /* CONFIG_NO_HZ */
+
+/**
+ * do_timer - Timer interrupt
+ * @cpl: Privilege level the interrupt came from
+ *
+ * Runs expired timers and charges the running task for all the jiffies
+ * that passed at once. CPU times reach the process server every
+ * ACCT_INTERVAL through a notification, never once per tick.
+ */
+void do_timer(long cpl)
+{
+	unsigned long ticks = tick_elapsed();
+	long spent, lent;
+
+	jiffies += ticks;
+	ticks += tick_owed_take();
+
+	/*
+	 * Time lent over IPC is spent first. FIFO tasks run until they
+	 * block or something outranks them.
+	 */
+	if (current && ticks) {
+		if (cpl)
+			current->utime += ticks;
+		else
+			current->stime += ticks;
+
+		spent = ticks;
+		if (current->donated > 0) {
+			lent = current->donated < spent ? current->donated : spent;
+			current->donated -= lent;
+			spent -= lent;
+		}
+		if (current->policy != MK_SCHED_FIFO)
+			current->counter -= spent;
+	}
+
+#if CONFIG_NO_HZ
+	tick_program(current ? tick_next_event(current) : TICK_MAX);
+#endif
+
+	/* Timers cascaded or re-added in there may want an earlier shot */
+	run_timers();
+	tick_update(current);
+
+	if ((long) (jiffies - acct_next) >= 0) {
+		acct_next = jiffies + ACCT_INTERVAL;
+		ipc_notify(kernel_state->process_server, SCHED_NOTIFY_ACCT);
+	}
+
+	if (current && (current->counter <= 0 || need_resched) && cpl)
+		schedule();
+}
+
+/**
+ * alarm_expired - Deliver SIGALRM for an alarm() timer
+ * @nr: Task slot
+ */
+static void alarm_expired(unsigned long nr)
+{
+	struct task_struct *p = task[nr];
+
+	/* The slot may have been reused since the alarm was set */
+	if (p && p->alarm == (long) alarm_timers[nr].expires) {
+		p->signal |= (1 << (SIGALRM-1));
+		p->alarm = 0;
+		signal_wake_up(p);
+	}
+}
+
+/**
+ * set_alarm - Arm or cancel the alarm of a task
+ * @nr: Task slot
+ * @seconds: Seconds until SIGALRM, 0 to cancel
+ * 
+ * Returns the seconds left on the previous alarm.
+ */
+long set_alarm(unsigned int nr, long seconds)
+{
+	struct timer_list *timer;
+	unsigned long flags;
+	long old = 0;
+
+	if (nr >= NR_TASKS || !task[nr])
 		return -1;
 
-	return reply.result;
+	timer = &alarm_timers[nr];
+
+	save_flags(flags);
+	cli();
+
+	if (del_timer(timer) && task[nr]->alarm)
+		old = (task[nr]->alarm - jiffies + HZ - 1) / HZ;
+	task[nr]->alarm = 0;
+
+	if (seconds > 0) {
+		init_timer(timer, alarm_expired, nr);
+		mod_timer(timer, jiffies + seconds * HZ);
+		task[nr]->alarm = timer->expires;
+	}
+
+	restore_flags(flags);
+	return old;
+}
+
+/*=============================================================================
+ * SYSTEM CALLS
+ *============================================================================*/
+
+int sys_alarm(long seconds)
+{
+	return set_alarm(kernel_state->current_task, seconds);
 }
 
 int sys_getpid(void)
@@ -553,7 +1748,7 @@ int sys_nice(long increment)
 
 	msg.header.msg_id = MSG_SCHED_NICE;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	msg.task_id = kernel_state->current_task;
 	msg.param = increment;
@@ -563,13 +1758,55 @@ int sys_nice(long increment)
 	if (result < 0)
 		return -1;
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0)
 		return -1;
 
 	return reply.result;
 }
 
+/**
+ * sys_sched_control - Set the scheduling policy of a task
+ * @param: Task slot, policy, priority and timeslice, in user space
+ *
+ * Called by the process server, which owns scheduling policy. Takes effect
+ * at the next scheduling decision. A task inheriting a priority over IPC
+ * keeps the higher of the two until it replies.
+ */
+int sys_sched_control(struct mk_sched_param *param)
+{
+	struct mk_sched_param sp;
+	struct task_struct *p;
+	unsigned long flags;
+
+	if (!(current_capability & CAP_SCHED_ADMIN))
+		return -EPERM;
+	if (!param)
+		return -EFAULT;
+
+	copy_from_fs(&sp, param, sizeof(sp));
+	if (sp.task >= NR_TASKS || !(p = task[sp.task]))
+		return -ESRCH;
+	if (sp.policy > MK_SCHED_IDLE || sp.priority < 0 ||
+	    sp.priority >= SCHED_NR_PRIO || sp.timeslice <= 0)
+		return -EINVAL;
+
+	save_flags(flags);
+	cli();
+	p->policy = sp.policy;
+	p->timeslice = sp.timeslice;
+	if (p->counter > sp.timeslice)
+		p->counter = sp.timeslice;
+	if (p->ipc_base_priority && sp.priority && p->priority > sp.priority) {
+		p->ipc_base_priority = sp.priority;
+		sp.priority = p->priority;
+	} else
+		p->ipc_base_priority = 0;
+	sched_set_priority(p, sp.priority);
+	restore_flags(flags);
+	return 0;
+}
+
 /*=============================================================================
  * INITIALIZATION
  *============================================================================*/
@@ -599,19 +1836,20 @@ void sched_init(void)
 	/* Send initialization message to process server */
 	msg.header.msg_id = MSG_SCHED_INIT;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	msg.task_id = 0;
 	msg.caps = current_capability;
 
 	if (mk_msg_send(kernel_state->process_server, &msg, sizeof(msg)) == 0) {
-		mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+		mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	}
 
-	/* Set up timer interrupt (now handled by system server) */
-	outb_p(0x36, 0x43);		/* binary, mode 3, LSB/MSB, ch 0 */
-	outb_p(LATCH & 0xff, 0x40);	/* LSB */
-	outb(LATCH >> 8, 0x40);		/* MSB */
+	/* Start the tick: one-shot with CONFIG_NO_HZ, HZ otherwise */
+	tick_init();
+
+	/* FXSAVE or FNSAVE for the lazily switched FPU state */
+	math_init();
 
 	/* Enable timer interrupt in PIC */
 	outb(inb_p(0x21) & ~0x01, 0x21);
@@ -61,6 +61,12 @@
 #define PORT_CONSOLE		0x000B
 #define PORT_LOG		0x000C
 
+/* System server requests not issued by sys.c */
+#define MSG_SYS_IPC_STATS	0x1D0E	/* Dump IPC port statistics */
+
+/* Process server requests issued by sched.c */
+#define MSG_SCHED_NICE		0x1702	/* Sys_nice */
+
 /* Maximum message size */
 #define MAX_MSG_SIZE		4096
 
@@ -73,6 +79,41 @@ struct server_state {
 	unsigned long start_time;
 };
 
+/* Reply layout: header, result code, then the handler's data */
+struct server_reply {
+	struct mk_msg_header header;
+	int result;
+	char data[MAX_MSG_SIZE - sizeof(struct mk_msg_header) - sizeof(int)];
+};
+
+/*
+ * Reply staged by the current request's handler. Each server runs in its
+ * own process, so every server has its own copy. The reply is delivered
+ * by server_receive() together with the wait for the next request, or
+ * by server_flush_reply() where no receive follows.
+ */
+static struct {
+	unsigned int port;
+	struct server_reply msg;
+} pending_reply;
+
+/**
+ * server_flush_reply - Send the staged reply now
+ * 
+ * For handlers not followed by a receive, and for a handler that
+ * replies twice: only one reply can be staged.
+ */
+static void server_flush_reply(void)
+{
+	unsigned int reply_port = pending_reply.port;
+	
+	if (!reply_port)
+		return;
+	pending_reply.port = 0;
+	mk_msg_send(reply_port, &pending_reply.msg,
+	            pending_reply.msg.header.size);
+}
+
 /**
  * send_reply - Send reply to client
  * @reply_port: Port to send reply to
@@ -81,22 +122,74 @@ struct server_state {
  * @data: Optional data
  * @size: Size of data
  * 
+ * The reply is only staged here; it goes out on the server's next
+ * server_receive() call, in the same trap that waits for more work.
+ * 
  * Returns 0 on success, -1 on error.
  */
 static int send_reply(unsigned int reply_port, unsigned int msg_id,
                        int result, void *data, unsigned int size)
 {
-	struct mk_msg_header reply;
+	struct server_reply *reply = &pending_reply.msg;
+	
+	if (!reply_port)
+		return 0;
+	if (size > sizeof(reply->data))
+		return -1;
 	
-	reply.msg_id = msg_id;
-	reply.sender_port = 0;  /* Will be filled by kernel */
-	reply.reply_port = 0;
-	reply.size = sizeof(reply) + size;
+	server_flush_reply();
 	
-	/* Would need to assemble full message with data */
-	/* For now, simplified */
+	reply->header.msg_id = msg_id;
+	reply->header.sender_port = 0;  /* Will be filled by kernel */
+	reply->header.reply_port = 0;
+	reply->result = result;
+	if (size)
+		memcpy(reply->data, data, size);
+	reply->header.size = sizeof(reply->header) + sizeof(reply->result) + size;
+	
+	pending_reply.port = reply_port;
+	return 0;
+}
+
+/**
+ * server_receive - Deliver staged reply and wait for next request
+ * @port: Server port
+ * @header: Buffer for next request
+ * @size: Buffer size (input/output)
+ * 
+ * Returns number of bytes received, or negative error code.
+ */
+static int server_receive(unsigned int port, struct mk_msg_header *header,
+                          unsigned int *size)
+{
+	unsigned int reply_port = pending_reply.port;
 	
-	return mk_msg_send(reply_port, &reply, sizeof(reply));
+	pending_reply.port = 0;
+	return mk_msg_reply_wait(reply_port, &pending_reply.msg,
+	                         port, header, size);
+}
+
+/**
+ * server_drain - Handle every message waiting in a channel ring
+ * @kick: MK_MSG_CHANNEL_KICK from the kernel
+ * @dispatch: Handler for one message
+ * 
+ * Returns only once the ring is empty and marked sleeping, so the next
+ * message put on it makes the client kick again. No receive follows a
+ * ring message, so a reply its handler staged is sent at once.
+ */
+static void server_drain(struct mk_channel_kick *kick,
+                         void (*dispatch)(struct mk_msg_header *))
+{
+	struct mk_ring *ring = kick->ring;
+	char buffer[MK_RING_MAX_MSG];
+	
+	do {
+		while (mk_ring_get(ring, buffer, sizeof(buffer)) > 0) {
+			dispatch((struct mk_msg_header *)buffer);
+			server_flush_reply();
+		}
+	} while (!mk_ring_sleep(ring));
 }
 
 /**
@@ -171,69 +264,130 @@ static int mem_handle_copy_tables(struct msg_mem_page *msg, unsigned int reply_p
 static int mem_handle_free_tables(struct msg_mem_page *msg, unsigned int reply_port);
 static int mem_handle_wp_page(struct msg_mem_page *msg, unsigned int reply_port);
 static int mem_handle_no_page(struct msg_mem_page *msg, unsigned int reply_port);
+static int mem_handle_remap(struct msg_mem_remap *msg, unsigned int reply_port);
+
+/**
+ * mem_dispatch - Handle one memory server request
+ * @header: Request, from the port or from a channel ring
+ */
+static void mem_dispatch(struct mk_msg_header *header)
+{
+	switch (header->msg_id) {
+		case MSG_MEM_GET_FREE_PAGE:
+			mem_handle_get_free_page((struct msg_mem_page *)header,
+			                         header->reply_port);
+			break;
+			
+		case MSG_MEM_PUT_PAGE:
+			mem_handle_put_page((struct msg_mem_page *)header,
+			                    header->reply_port);
+			break;
+			
+		case MSG_MEM_FREE_PAGE:
+			mem_handle_free_page((struct msg_mem_page *)header,
+			                     header->reply_port);
+			break;
+			
+		case MSG_MEM_COPY_PAGE_TABLES:
+			mem_handle_copy_tables((struct msg_mem_page *)header,
+			                       header->reply_port);
+			break;
+			
+		case MSG_MEM_FREE_PAGE_TABLES:
+			mem_handle_free_tables((struct msg_mem_page *)header,
+			                       header->reply_port);
+			break;
+			
+		case MSG_MEM_DO_WP_PAGE:
+			mem_handle_wp_page((struct msg_mem_page *)header,
+			                   header->reply_port);
+			break;
+			
+		case MSG_MEM_DO_NO_PAGE:
+			mem_handle_no_page((struct msg_mem_page *)header,
+			                   header->reply_port);
+			break;
+			
+		case MSG_MEM_REMAP:
+			mem_handle_remap((struct msg_mem_remap *)header,
+			                 header->reply_port);
+			break;
+			
+		default:
+			/* Unknown message */
+			send_reply(header->reply_port, header->msg_id, -EINVAL, NULL, 0);
+			break;
+	}
+}
 
 /**
  * memory_server_main - Main loop for memory server
  */
 void memory_server_main(void)
 {
-	struct mk_msg_header header;
-	char buffer[MAX_MSG_SIZE];
+	union {
+		struct mk_msg_header header;
+		struct mk_channel_kick kick;	/* Kicks are longer than a header */
+		char buffer[MAX_MSG_SIZE];
+	} msg;
 	unsigned int size;
 	int result;
 	
 	printk("Memory server started on port %d\n", PORT_MEMORY);
 	
 	while (1) {
-		/* Receive request */
+		/* Reply to previous request and receive the next */
 		size = MAX_MSG_SIZE;
-		result = mk_msg_receive(PORT_MEMORY, &header, &size);
+		result = server_receive(PORT_MEMORY, &msg.header, &size);
 		if (result < 0)
 			continue;
 		
-		/* Handle based on message ID */
-		switch (header.msg_id) {
-			case MSG_MEM_GET_FREE_PAGE:
-				result = mem_handle_get_free_page((struct msg_mem_page *)&header,
-				                                   header.reply_port);
-				break;
-				
-			case MSG_MEM_PUT_PAGE:
-				result = mem_handle_put_page((struct msg_mem_page *)&header,
-				                                  header.reply_port);
-				break;
-				
-			case MSG_MEM_FREE_PAGE:
-				result = mem_handle_free_page((struct msg_mem_page *)&header,
-				                                   header.reply_port);
-				break;
-				
-			case MSG_MEM_COPY_PAGE_TABLES:
-				result = mem_handle_copy_tables((struct msg_mem_page *)&header,
-				                                     header.reply_port);
-				break;
-				
-			case MSG_MEM_FREE_PAGE_TABLES:
-				result = mem_handle_free_tables((struct msg_mem_page *)&header,
-				                                     header.reply_port);
-				break;
-				
-			case MSG_MEM_DO_WP_PAGE:
-				result = mem_handle_wp_page((struct msg_mem_page *)&header,
-				                              header.reply_port);
-				break;
-				
-			case MSG_MEM_DO_NO_PAGE:
-				result = mem_handle_no_page((struct msg_mem_page *)&header,
-				                              header.reply_port);
-				break;
-				
-			default:
-				/* Unknown message */
-				send_reply(header.reply_port, header.msg_id, -EINVAL, NULL, 0);
+		/* Requests streamed through a channel ring */
+		if (msg.header.msg_id == MK_MSG_CHANNEL_KICK) {
+			server_drain(&msg.kick, mem_dispatch);
+			continue;
+		}
+		
+		mem_dispatch(&msg.header);
+	}
+}
+
+/**
+ * mem_pte - Find the page table entry for an address
+ * @address: Linear address
+ * @owner: Task charged for a new page table
+ * @create: Allocate the page table if missing
+ * 
+ * Returns pointer to the entry, or NULL.
+ */
+static unsigned long *mem_pte(unsigned long address, unsigned int owner, int create)
+{
+	unsigned long *dir_entry;
+	unsigned long new_table;
+	int i;
+	
+	dir_entry = &page_dir[address >> 22];
+	if (!(*dir_entry & 1)) {
+		if (!create)
+			return NULL;
+		
+		/* Find free page for page table */
+		for (i = 0; i < PAGING_PAGES; i++) {
+			if (physical_pages[i].ref_count == 0) {
+				new_table = LOW_MEM + (i << 12);
+				physical_pages[i].ref_count = 1;
+				physical_pages[i].owner = owner;
+				memset((void *)new_table, 0, 4096);
 				break;
+			}
 		}
+		if (i == PAGING_PAGES)
+			return NULL;
+		
+		*dir_entry = new_table | 7;  /* Present, R/W, User */
 	}
+	
+	return (unsigned long *)(*dir_entry & 0xfffff000) + ((address >> 12) & 0x3ff);
 }
 
 /* Memory server handlers */
@@ -267,10 +421,7 @@ static int mem_handle_get_free_page(struct msg_mem_page *msg, unsigned int reply
 static int mem_handle_put_page(struct msg_mem_page *msg, unsigned int reply_port)
 {
 	unsigned long page = msg->page;
-	unsigned long address = msg->address;
-	unsigned long *page_table;
-	unsigned long *dir_entry;
-	int idx;
+	unsigned long *pte;
 	
 	/* Validate capability */
 	if (!validate_capability(msg->task_id, CAP_MEM_PAGE))
@@ -281,33 +432,12 @@ static int mem_handle_put_page(struct msg_mem_page *msg, unsigned int reply_port
 		return send_reply(reply_port, msg->header.msg_id, -EINVAL, NULL, 0);
 	
 	/* Find or create page table */
-	dir_entry = &page_dir[address >> 22];
-	if (!(*dir_entry & 1)) {
-		/* Need new page table */
-		unsigned long new_table;
-		int i;
-		
-		/* Find free page for page table */
-		for (i = 0; i < PAGING_PAGES; i++) {
-			if (physical_pages[i].ref_count == 0) {
-				new_table = LOW_MEM + (i << 12);
-				physical_pages[i].ref_count = 1;
-				physical_pages[i].owner = msg->task_id;
-				memset((void *)new_table, 0, 4096);
-				break;
-			}
-		}
-		if (i == PAGING_PAGES)
-			return send_reply(reply_port, msg->header.msg_id, -ENOMEM, NULL, 0);
-		
-		*dir_entry = new_table | 7;  /* Present, R/W, User */
-	}
-	
-	page_table = (unsigned long *)(*dir_entry & 0xfffff000);
-	idx = (address >> 12) & 0x3ff;
+	pte = mem_pte(msg->address, msg->task_id, 1);
+	if (!pte)
+		return send_reply(reply_port, msg->header.msg_id, -ENOMEM, NULL, 0);
 	
 	/* Map the page */
-	page_table[idx] = page | 7;  /* Present, R/W, User */
+	*pte = page | 7;  /* Present, R/W, User */
 	
 	/* Update page reference */
 	physical_pages[(page - LOW_MEM) >> 12].ref_count++;
@@ -343,8 +473,39 @@ static int mem_handle_free_tables(struct msg_mem_page *msg, unsigned int reply_p
 
 static int mem_handle_wp_page(struct msg_mem_page *msg, unsigned int reply_port)
 {
-	/* Would handle write-protect page fault */
-	return send_reply(reply_port, msg->header.msg_id, -ENOSYS, NULL, 0);
+	unsigned long *pte;
+	unsigned long old_page, new_page;
+	int i, idx;
+	
+	pte = mem_pte(msg->address, msg->task_id, 0);
+	if (!pte || !(*pte & 1))
+		return send_reply(reply_port, msg->header.msg_id, -EFAULT, NULL, 0);
+	
+	old_page = *pte & 0xfffff000;
+	idx = (old_page - LOW_MEM) >> 12;
+	
+	/* Last reference to a copy-on-write page: just make it writable */
+	if (old_page >= LOW_MEM && physical_pages[idx].ref_count == 1) {
+		*pte |= 2;
+		return send_reply(reply_port, msg->header.msg_id, 0, NULL, 0);
+	}
+	
+	for (i = 0; i < PAGING_PAGES; i++)
+		if (physical_pages[i].ref_count == 0)
+			break;
+	if (i == PAGING_PAGES)
+		return send_reply(reply_port, msg->header.msg_id, -ENOMEM, NULL, 0);
+	
+	new_page = LOW_MEM + (i << 12);
+	physical_pages[i].ref_count = 1;
+	physical_pages[i].owner = msg->task_id;
+	memcpy((void *)new_page, (void *)old_page, 4096);
+	
+	if (old_page >= LOW_MEM)
+		physical_pages[idx].ref_count--;
+	*pte = new_page | 7;
+	
+	return send_reply(reply_port, msg->header.msg_id, 0, NULL, 0);
 }
 
 static int mem_handle_no_page(struct msg_mem_page *msg, unsigned int reply_port)
@@ -353,6 +514,55 @@ static int mem_handle_no_page(struct msg_mem_page *msg, unsigned int reply_port)
 	return send_reply(reply_port, msg->header.msg_id, -ENOSYS, NULL, 0);
 }
 
+/*
+ * Move or share the pages of an out-of-line IPC payload. Shared pages
+ * are write-protected on both sides and copied by mem_handle_wp_page.
+ */
+static int mem_handle_remap(struct msg_mem_remap *msg, unsigned int reply_port)
+{
+	unsigned long from = msg->from;
+	unsigned long to = msg->to;
+	unsigned long *from_pte, *to_pte;
+	unsigned long page, old;
+	unsigned int n;
+	
+	if (!validate_capability(msg->task_id, CAP_MEM_PAGE))
+		return send_reply(reply_port, msg->header.msg_id, -EPERM, NULL, 0);
+	
+	if ((from | to) & 0xfff)
+		return send_reply(reply_port, msg->header.msg_id, -EINVAL, NULL, 0);
+	
+	for (n = PAGE_COUNT(msg->size); n > 0; n--, from += 4096, to += 4096) {
+		from_pte = mem_pte(from, msg->task_id, 0);
+		if (!from_pte || !(*from_pte & 1))
+			return send_reply(reply_port, msg->header.msg_id, -EFAULT, NULL, 0);
+		
+		to_pte = mem_pte(to, msg->task_id, 1);
+		if (!to_pte)
+			return send_reply(reply_port, msg->header.msg_id, -ENOMEM, NULL, 0);
+		
+		/* Release whatever the window held from the last transfer */
+		if (*to_pte & 1) {
+			old = *to_pte & 0xfffff000;
+			if (old >= LOW_MEM && physical_pages[(old - LOW_MEM) >> 12].ref_count)
+				physical_pages[(old - LOW_MEM) >> 12].ref_count--;
+		}
+		
+		page = *from_pte;
+		if (msg->copy == MEM_COPY_ON_WRITE) {
+			page &= ~2;
+			*from_pte = page;
+			if ((page & 0xfffff000) >= LOW_MEM)
+				physical_pages[((page & 0xfffff000) - LOW_MEM) >> 12].ref_count++;
+		} else {
+			*from_pte = 0;
+		}
+		*to_pte = page;
+	}
+	
+	return send_reply(reply_port, msg->header.msg_id, 0, NULL, 0);
+}
+
 /*=============================================================================
  * PROCESS SERVER
  *============================================================================*/
@@ -387,7 +597,6 @@ struct server_task {
 
 static struct server_task tasks[MAX_TASKS];
 static unsigned int next_pid = 1;
-static unsigned int current_task = 0;
 
 /* Forward declarations */
 static int proc_handle_fork(struct msg_sched_task *msg, unsigned int reply_port);
@@ -397,9 +606,10 @@ static int proc_handle_waitpid(struct msg_exit_waitpid *msg, unsigned int reply_
 static int proc_handle_kill(struct msg_exit_kill *msg, unsigned int reply_port);
 static int proc_handle_signal(struct msg_signal_signal *msg, unsigned int reply_port);
 static int proc_handle_sigaction(struct msg_signal_sigaction *msg, unsigned int reply_port);
-static int proc_handle_schedule(struct msg_sched_task *msg, unsigned int reply_port);
+static int proc_handle_nice(struct msg_sched_task *msg, unsigned int reply_port);
 static int proc_handle_getpid(struct msg_sched_task *msg, unsigned int reply_port);
 static int proc_handle_getppid(struct msg_sched_task *msg, unsigned int reply_port);
+static void proc_handle_notify(struct mk_msg_notify *msg);
 
 /**
  * process_server_main - Main loop for process server
@@ -423,7 +633,7 @@ void process_server_main(void)
 	
 	while (1) {
 		size = MAX_MSG_SIZE;
-		result = mk_msg_receive(PORT_PROCESS, &header, &size);
+		result = server_receive(PORT_PROCESS, &header, &size);
 		if (result < 0)
 			continue;
 		
@@ -457,8 +667,8 @@ void process_server_main(void)
 				proc_handle_sigaction((struct msg_signal_sigaction *)&header, header.reply_port);
 				break;
 				
-			case MSG_SCHED_SCHEDULE:
-				proc_handle_schedule((struct msg_sched_task *)&header, header.reply_port);
+			case MSG_SCHED_NICE:
+				proc_handle_nice((struct msg_sched_task *)&header, header.reply_port);
 				break;
 				
 			case MSG_SCHED_GETPID:
@@ -469,6 +679,10 @@ void process_server_main(void)
 				proc_handle_getppid((struct msg_sched_task *)&header, header.reply_port);
 				break;
 				
+			case MK_MSG_NOTIFY:
+				proc_handle_notify((struct mk_msg_notify *)&header);
+				break;
+				
 			default:
 				send_reply(header.reply_port, header.msg_id, -EINVAL, NULL, 0);
 				break;
@@ -490,7 +704,7 @@ static int proc_handle_fork(struct msg_sched_task *msg, unsigned int reply_port)
 	if (i == MAX_TASKS)
 		return send_reply(reply_port, msg->header.msg_id, -EAGAIN, NULL, 0);
 	
-	parent = &tasks[current_task];
+	parent = &tasks[msg->task_id];
 	child = &tasks[i];
 	
 	/* Copy parent task */
@@ -517,9 +731,26 @@ static int proc_handle_execve(struct msg_sched_task *msg, unsigned int reply_por
 	return send_reply(reply_port, msg->header.msg_id, -ENOSYS, NULL, 0);
 }
 
+/**
+ * proc_wake_waiter - Tell a task one of its children has exited
+ * @slot: Task slot of the parent
+ * 
+ * sys_waitpid sleeps on child_events when we answer -EAGAIN, so the
+ * count is bumped before the wake and an exit in between is not lost.
+ */
+static void proc_wake_waiter(int slot)
+{
+	struct task_struct *p = slot < NR_TASKS ? task[slot] : NULL;
+	
+	if (!p)
+		return;
+	p->child_events++;
+	wake_up_key((unsigned long) &p->child_events, MK_WAKE_ALL);
+}
+
 static int proc_handle_exit(struct msg_exit_do_exit *msg, unsigned int reply_port)
 {
-	struct server_task *task = &tasks[current_task];
+	struct server_task *task = &tasks[msg->task_id];
 	int i;
 	
 	task->state = TASK_ZOMBIE;
@@ -536,8 +767,13 @@ static int proc_handle_exit(struct msg_exit_do_exit *msg, unsigned int reply_por
 		}
 	}
 	
-	/* Wake up father */
-	/* Would need to wake up waiting task */
+	/* Wake up father if it sits in waitpid */
+	for (i = 0; i < MAX_TASKS; i++) {
+		if (tasks[i].pid == task->father) {
+			proc_wake_waiter(i);
+			break;
+		}
+	}
 	
 	return send_reply(reply_port, msg->header.msg_id, 0, NULL, 0);
 }
@@ -550,7 +786,7 @@ static int proc_handle_waitpid(struct msg_exit_waitpid *msg, unsigned int reply_
 	
 	for (i = 0; i < MAX_TASKS; i++) {
 		child = &tasks[i];
-		if (child->pid == 0 || child->father != tasks[current_task].pid)
+		if (child->pid == 0 || child->father != tasks[msg->task_id].pid)
 			continue;
 		
 		if (msg->pid > 0 && child->pid != msg->pid)
@@ -610,7 +846,7 @@ static int proc_handle_kill(struct msg_exit_kill *msg, unsigned int reply_port)
 
 static int proc_handle_signal(struct msg_signal_signal *msg, unsigned int reply_port)
 {
-	struct server_task *task = &tasks[current_task];
+	struct server_task *task = &tasks[msg->task_id];
 	unsigned long old_handler;
 	
 	if (msg->signum < 1 || msg->signum > 32 || msg->signum == SIGKILL)
@@ -632,42 +868,73 @@ static int proc_handle_sigaction(struct msg_signal_sigaction *msg, unsigned int
 	return send_reply(reply_port, msg->header.msg_id, -ENOSYS, NULL, 0);
 }
 
-static int proc_handle_schedule(struct msg_sched_task *msg, unsigned int reply_port)
+/*
+ * The kernel keeps the run queue and switches tasks on its own; this
+ * server only decides policy and hands it down with MK_SCHED_CONTROL.
+ * Requests name their caller by task slot, which is also its slot here.
+ */
+static int proc_handle_nice(struct msg_sched_task *msg, unsigned int reply_port)
 {
-	int i, next = -1;
-	int max_counter = -1;
+	struct server_task *task = &tasks[msg->task_id];
+	struct mk_sched_param param;
+	long priority = task->priority - (long) msg->param;
+	int result;
 	
-	/* Simple round-robin scheduler */
-	for (i = 0; i < MAX_TASKS; i++) {
-		if (tasks[i].state == TASK_RUNNING) {
-			if (tasks[i].counter > max_counter) {
-				max_counter = tasks[i].counter;
-				next = i;
-			}
-		}
-	}
+	/* Only privileged callers may raise their priority */
+	if ((long) msg->param < 0 && !(msg->caps & CAP_SCHED_SETPRIO))
+		return send_reply(reply_port, msg->header.msg_id, -EPERM, NULL, 0);
 	
-	if (next >= 0) {
-		/* Give timeslice to next task */
-		current_task = next;
-		tasks[next].counter--;
-	}
+	if (priority < 0)
+		priority = 0;
+	if (priority >= SCHED_NR_PRIO)
+		priority = SCHED_NR_PRIO - 1;
+	
+	param.task = msg->task_id;
+	param.policy = MK_SCHED_NORMAL;
+	param.priority = priority;
+	param.timeslice = priority ? priority : 1;
+	
+	result = mk_sched_control(&param);
+	if (result == 0)
+		task->priority = priority;
 	
-	return send_reply(reply_port, msg->header.msg_id, next, NULL, 0);
+	return send_reply(reply_port, msg->header.msg_id, result, NULL, 0);
 }
 
 static int proc_handle_getpid(struct msg_sched_task *msg, unsigned int reply_port)
 {
-	int pid = tasks[current_task].pid;
+	int pid = tasks[msg->task_id].pid;
 	return send_reply(reply_port, msg->header.msg_id, 0, &pid, sizeof(pid));
 }
 
 static int proc_handle_getppid(struct msg_sched_task *msg, unsigned int reply_port)
 {
-	int ppid = tasks[current_task].father;
+	int ppid = tasks[msg->task_id].father;
 	return send_reply(reply_port, msg->header.msg_id, 0, &ppid, sizeof(ppid));
 }
 
+/**
+ * proc_handle_notify - Act on process server notification bits
+ * @msg: Bits collected since the last notification
+ * 
+ * The kernel charges CPU time in batches at timer interrupts and only
+ * posts SCHED_NOTIFY_ACCT now and then; the times are picked up here.
+ */
+static void proc_handle_notify(struct mk_msg_notify *msg)
+{
+	int i;
+	
+	if (!(msg->bits & SCHED_NOTIFY_ACCT))
+		return;
+	
+	for (i = 0; i < MAX_TASKS && i < NR_TASKS; i++) {
+		if (!task[i] || tasks[i].state == TASK_ZOMBIE)
+			continue;
+		tasks[i].utime = task[i]->utime;
+		tasks[i].stime = task[i]->stime;
+	}
+}
+
 /*=============================================================================
  * DEVICE SERVER
  *============================================================================*/
@@ -712,6 +979,7 @@ static int dev_handle_floppy_on(struct msg_floppy_request *msg, unsigned int rep
 static int dev_handle_floppy_off(struct msg_floppy_request *msg, unsigned int reply_port);
 static int dev_handle_floppy_read(struct msg_floppy_request *msg, unsigned int reply_port);
 static int dev_handle_floppy_write(struct msg_floppy_request *msg, unsigned int reply_port);
+static void dev_handle_notify(struct mk_msg_notify *msg);
 
 /**
  * device_server_main - Main loop for device server
@@ -725,14 +993,11 @@ void device_server_main(void)
 	
 	printk("Device server started on port %d\n", PORT_DEVICE);
 	
-	/* Initialize hardware */
-	outb_p(0x36, 0x43);		/* Timer */
-	outb_p(LATCH & 0xff, 0x40);
-	outb(LATCH >> 8, 0x40);
+	/* The PIT is the kernel's; sched.c arms it for each tick */
 	
 	while (1) {
 		size = MAX_MSG_SIZE;
-		result = mk_msg_receive(PORT_DEVICE, &header, &size);
+		result = server_receive(PORT_DEVICE, &header, &size);
 		if (result < 0)
 			continue;
 		
@@ -761,6 +1026,10 @@ void device_server_main(void)
 				dev_handle_floppy_write((struct msg_floppy_request *)&header, header.reply_port);
 				break;
 				
+			case MK_MSG_NOTIFY:
+				dev_handle_notify((struct mk_msg_notify *)&header);
+				break;
+				
 			default:
 				send_reply(header.reply_port, header.msg_id, -EINVAL, NULL, 0);
 				break;
@@ -808,6 +1077,33 @@ static int dev_handle_floppy_write(struct msg_floppy_request *msg, unsigned int
 	return send_reply(reply_port, msg->header.msg_id, 0, &msg->params.rw.count, sizeof(msg->params.rw.count));
 }
 
+/**
+ * dev_handle_notify - Act on device notification bits
+ * @msg: Bits collected since the last notification
+ * 
+ * Bits coalesce, so a motor on and off for one drive can arrive
+ * together; the motor is then left on, which only costs a spin-down
+ * later, where leaving it off would fail the next transfer.
+ * Disk interrupts are still serviced by do_hd/do_floppy in the stubs.
+ */
+static void dev_handle_notify(struct mk_msg_notify *msg)
+{
+	unsigned int nr;
+	
+	for (nr = 0; nr < 4; nr++) {
+		if (msg->bits & FLOPPY_NOTIFY_ON(nr)) {
+			floppy_drives[nr].motor_on = 1;
+			outb(0x1C, FD_DOR);  /* Example */
+		} else if (msg->bits & FLOPPY_NOTIFY_OFF(nr)) {
+			floppy_drives[nr].motor_on = 0;
+			outb(0x0C, FD_DOR);  /* Example */
+		}
+	}
+	
+	if (msg->bits & FLOPPY_NOTIFY_TIMER)
+		timer_ticks++;
+}
+
 /*=============================================================================
  * TIME SERVER
  *============================================================================*/
@@ -819,19 +1115,31 @@ static int dev_handle_floppy_write(struct msg_floppy_request *msg, unsigned int
  * - gettimeofday()
  * - alarm timers
  * - interval timers
+ * 
+ * Alarms are armed on the kernel timing wheel, which delivers SIGALRM
+ * from the timer interrupt, so the server keeps no timer list of its own.
  */
 
 static unsigned long system_time = 0;
 static unsigned long boot_time = 0;
 
-struct timer {
-	unsigned long expires;
-	unsigned int task_id;
-	int signal;
-	struct timer *next;
-};
-
-static struct timer *timers = NULL;
+/**
+ * time_handle_alarm - Arm or cancel a task's alarm
+ * @msg: Request; param holds the seconds, 0 to cancel
+ * @reply_port: Port to send reply to
+ * 
+ * Replies with the seconds left on the previous alarm.
+ */
+static int time_handle_alarm(struct msg_sched_task *msg, unsigned int reply_port)
+{
+	long left;
+	
+	left = set_alarm(msg->task_id, msg->param);
+	if (left < 0)
+		return send_reply(reply_port, msg->header.msg_id, -EINVAL, NULL, 0);
+	
+	return send_reply(reply_port, msg->header.msg_id, (int)left, NULL, 0);
+}
 
 /**
  * time_server_main - Main loop for time server
@@ -851,7 +1159,7 @@ void time_server_main(void)
 	
 	while (1) {
 		size = MAX_MSG_SIZE;
-		result = mk_msg_receive(PORT_TIME, &header, &size);
+		result = server_receive(PORT_TIME, &header, &size);
 		if (result < 0)
 			continue;
 		
@@ -869,18 +1177,13 @@ void time_server_main(void)
 				break;
 				
 			case MSG_SCHED_ALARM:
-				/* Set alarm for task */
-				/* Would add timer */
-				send_reply(header.reply_port, header.msg_id, 0, NULL, 0);
+				time_handle_alarm((struct msg_sched_task *)&header, header.reply_port);
 				break;
 				
 			default:
 				send_reply(header.reply_port, header.msg_id, -EINVAL, NULL, 0);
 				break;
 		}
-		
-		/* Check timers */
-		/* ... */
 	}
 }
 
@@ -907,7 +1210,7 @@ void signal_server_main(void)
 	
 	while (1) {
 		size = MAX_MSG_SIZE;
-		result = mk_msg_receive(PORT_SIGNAL, &header, &size);
+		result = server_receive(PORT_SIGNAL, &header, &size);
 		if (result < 0)
 			continue;
 		
@@ -936,13 +1239,47 @@ void signal_server_main(void)
 static int console_buffer_pos = 0;
 static char console_buffer[4096];
 
+/**
+ * console_dispatch - Handle one console server request
+ * @header: Request, from the port or from a channel ring
+ */
+static void console_dispatch(struct mk_msg_header *header)
+{
+	if (header->msg_id == MSG_CONSOLE_WRITE) {
+		struct msg_console_write *msg = (struct msg_console_write *)header;
+		
+		/* Write to console */
+		__asm__ __volatile__(
+			"push %%fs\n\t"
+			"push %%ds\n\t"
+			"pop %%fs\n\t"
+			"pushl %0\n\t"
+			"pushl $msg->data\n\t"
+			"pushl $0\n\t"
+			"call tty_write\n\t"
+			"addl $8,%%esp\n\t"
+			"popl %0\n\t"
+			"pop %%fs"
+			: : "r" (msg->len) : "ax", "cx", "dx");
+		
+		/* Also add to log buffer */
+		memcpy(console_buffer + console_buffer_pos, msg->data, msg->len);
+		console_buffer_pos += msg->len;
+		if (console_buffer_pos > 3000)
+			console_buffer_pos = 0;
+	}
+}
+
 /**
  * console_server_main - Main loop for console server
  */
 void console_server_main(void)
 {
-	struct mk_msg_header header;
-	char buffer[MAX_MSG_SIZE];
+	union {
+		struct mk_msg_header header;
+		struct mk_channel_kick kick;	/* Kicks are longer than a header */
+		char buffer[MAX_MSG_SIZE];
+	} msg;
 	unsigned int size;
 	int result;
 	
@@ -950,33 +1287,14 @@ void console_server_main(void)
 	
 	while (1) {
 		size = MAX_MSG_SIZE;
-		result = mk_msg_receive(PORT_CONSOLE, &header, &size);
+		result = server_receive(PORT_CONSOLE, &msg.header, &size);
 		if (result < 0)
 			continue;
 		
-		if (header.msg_id == MSG_CONSOLE_WRITE) {
-			struct msg_console_write *msg = (struct msg_console_write *)&header;
-			
-			/* Write to console */
-			__asm__ __volatile__(
-				"push %%fs\n\t"
-				"push %%ds\n\t"
-				"pop %%fs\n\t"
-				"pushl %0\n\t"
-				"pushl $msg->data\n\t"
-				"pushl $0\n\t"
-				"call tty_write\n\t"
-				"addl $8,%%esp\n\t"
-				"popl %0\n\t"
-				"pop %%fs"
-				: : "r" (msg->len) : "ax", "cx", "dx");
-			
-			/* Also add to log buffer */
-			memcpy(console_buffer + console_buffer_pos, msg->data, msg->len);
-			console_buffer_pos += msg->len;
-			if (console_buffer_pos > 3000)
-				console_buffer_pos = 0;
-		}
+		if (msg.header.msg_id == MK_MSG_CHANNEL_KICK)
+			server_drain(&msg.kick, console_dispatch);
+		else
+			console_dispatch(&msg.header);
 	}
 }
 
@@ -993,13 +1311,36 @@ static char log_buffer[LOG_BUFFER_SIZE];
 static unsigned int log_head = 0;
 static unsigned int log_tail = 0;
 
+/**
+ * log_dispatch - Handle one log server request
+ * @header: Request, from the port or from a channel ring
+ */
+static void log_dispatch(struct mk_msg_header *header)
+{
+	if (header->msg_id == MSG_LOG_WRITE) {
+		struct msg_log_write *msg = (struct msg_log_write *)header;
+		int i;
+		
+		/* Add to circular buffer */
+		for (i = 0; i < msg->len; i++) {
+			log_buffer[log_head] = msg->data[i];
+			log_head = (log_head + 1) & (LOG_BUFFER_SIZE - 1);
+			if (log_head == log_tail)
+				log_tail = (log_tail + 1) & (LOG_BUFFER_SIZE - 1);
+		}
+	}
+}
+
 /**
  * log_server_main - Main loop for log server
  */
 void log_server_main(void)
 {
-	struct mk_msg_header header;
-	char buffer[MAX_MSG_SIZE];
+	union {
+		struct mk_msg_header header;
+		struct mk_channel_kick kick;	/* Kicks are longer than a header */
+		char buffer[MAX_MSG_SIZE];
+	} msg;
 	unsigned int size;
 	int result;
 	
@@ -1007,22 +1348,14 @@ void log_server_main(void)
 	
 	while (1) {
 		size = MAX_MSG_SIZE;
-		result = mk_msg_receive(PORT_LOG, &header, &size);
+		result = server_receive(PORT_LOG, &msg.header, &size);
 		if (result < 0)
 			continue;
 		
-		if (header.msg_id == MSG_LOG_WRITE) {
-			struct msg_log_write *msg = (struct msg_log_write *)&header;
-			int i;
-			
-			/* Add to circular buffer */
-			for (i = 0; i < msg->len; i++) {
-				log_buffer[log_head] = msg->data[i];
-				log_head = (log_head + 1) & (LOG_BUFFER_SIZE - 1);
-				if (log_head == log_tail)
-					log_tail = (log_tail + 1) & (LOG_BUFFER_SIZE - 1);
-			}
-		}
+		if (msg.header.msg_id == MK_MSG_CHANNEL_KICK)
+			server_drain(&msg.kick, log_dispatch);
+		else
+			log_dispatch(&msg.header);
 	}
 }
 
@@ -1060,7 +1393,7 @@ void system_server_main(void)
 	
 	while (1) {
 		size = MAX_MSG_SIZE;
-		result = mk_msg_receive(PORT_SYSTEM, &header, &size);
+		result = server_receive(PORT_SYSTEM, &header, &size);
 		if (result < 0)
 			continue;
 		
@@ -1072,6 +1405,12 @@ void system_server_main(void)
 				          buffer, sizeof(struct utsname));
 				break;
 				
+			case MSG_SYS_IPC_STATS:
+				/* Per-port IPC counters, to the console */
+				ipc_show_port_stats();
+				send_reply(header.reply_port, header.msg_id, 0, NULL, 0);
+				break;
+				
 			case MSG_CONFIG_GET:
 				/* Get configuration parameter */
 				/* ... */
@@ -1084,6 +1423,10 @@ void system_server_main(void)
 				send_reply(header.reply_port, header.msg_id, 0, NULL, 0);
 				break;
 				
+			case MK_MSG_NOTIFY:
+				/* Nothing is posted here; the tick stays in the kernel */
+				break;
+				
 			default:
 				send_reply(header.reply_port, header.msg_id, -EINVAL, NULL, 0);
 				break;
@@ -125,14 +125,14 @@ static inline int signal_request(unsigned int msg_id, void *msg_data,
 	unsigned int reply_size = sizeof(reply);
 	int result;
 
-	result = mk_msg_send(kernel_state->signal_server, msg_data, msg_size);
-	if (result < 0)
-		return -1;
-
-	if (!need_reply)
-		return 0;
+	if (!need_reply) {
+		result = mk_msg_send(kernel_state->signal_server, msg_data, msg_size);
+		return (result < 0) ? -1 : 0;
+	}
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	/* Send and wait for the reply in a single trap */
+	result = mk_msg_call(kernel_state->signal_server, msg_data, msg_size,
+	                     &reply, &reply_size);
 	if (result < 0)
 		return -1;
 
@@ -163,7 +163,7 @@ int sys_sgetmask(void)
 
 	msg.header.msg_id = MSG_SIGNAL_SGETMASK;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.task_id = kernel_state->current_task;
@@ -196,7 +196,7 @@ int sys_ssetmask(int newmask)
 
 	msg.header.msg_id = MSG_SIGNAL_SSETMASK;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.newmask = newmask;
@@ -236,7 +236,7 @@ int sys_signal(int signum, long handler, long restorer)
 
 	msg.header.msg_id = MSG_SIGNAL_SIGNAL;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.signum = signum;
@@ -298,7 +298,7 @@ int sys_sigaction(int signum, const struct sigaction * action,
 
 	msg.header.msg_id = MSG_SIGNAL_SIGACTION;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.signum = signum;
@@ -381,7 +381,7 @@ void do_signal(long signr, long eax, long ebx, long ecx, long edx,
 	/* Ask signal server to handle delivery */
 	msg.header.msg_id = MSG_SIGNAL_DO_SIGNAL;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.signr = signr;
@@ -409,7 +409,7 @@ void do_signal(long signr, long eax, long ebx, long ecx, long edx,
 	}
 
 	/* Wait for server to set up handler context */
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0) {
 		/* Server failed - exit */
 		do_exit(1 << (signr - 1));
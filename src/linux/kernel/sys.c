@@ -149,14 +149,14 @@ static inline int sys_request(unsigned int msg_id, unsigned int server_port,
 	unsigned int reply_size = sizeof(reply);
 	int result;
 
-	result = mk_msg_send(server_port, msg_data, msg_size);
-	if (result < 0)
-		return -1;
-
-	if (!need_reply)
-		return 0;
+	if (!need_reply) {
+		result = mk_msg_send(server_port, msg_data, msg_size);
+		return (result < 0) ? -1 : 0;
+	}
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	/* Send and wait for the reply in a single trap */
+	result = mk_msg_call(server_port, msg_data, msg_size,
+	                     &reply, &reply_size);
 	if (result < 0)
 		return -1;
 
@@ -206,7 +206,7 @@ int sys_time(long * tloc)
 
 	msg.header.msg_id = MSG_SYS_TIME;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.tloc = tloc;
@@ -258,7 +258,7 @@ int sys_stime(long * tptr)
 
 	msg.header.msg_id = MSG_SYS_STIME;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.tptr = tptr;
@@ -290,7 +290,7 @@ int sys_times(struct tms * tbuf)
 
 	msg.header.msg_id = MSG_SYS_TIMES;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.tbuf = tbuf;
@@ -339,7 +339,7 @@ int sys_setreuid(int ruid, int euid)
 
 	msg.header.msg_id = MSG_SYS_SETREUID;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.id1 = ruid;
@@ -395,7 +395,7 @@ int sys_setregid(int rgid, int egid)
 
 	msg.header.msg_id = MSG_SYS_SETREGID;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.id1 = rgid;
@@ -452,7 +452,7 @@ int sys_setpgid(int pid, int pgid)
 
 	msg.header.msg_id = MSG_SYS_SETPGID;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.id1 = pid;
@@ -498,7 +498,7 @@ int sys_getpgrp(void)
 
 	msg.header.msg_id = MSG_SYS_GETPGRP;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.task_id = kernel_state->current_task;
@@ -523,7 +523,7 @@ int sys_setsid(void)
 
 	msg.header.msg_id = MSG_SYS_SETSID;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.task_id = kernel_state->current_task;
@@ -560,7 +560,7 @@ int sys_brk(unsigned long end_data_seg)
 
 	msg.header.msg_id = MSG_SYS_BRK;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.end_data_seg = end_data_seg;
@@ -600,7 +600,7 @@ int sys_uname(struct utsname * name)
 
 	msg.header.msg_id = MSG_SYS_UNAME;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.name = name;
@@ -640,7 +640,7 @@ int sys_umask(int mask)
 
 	msg.header.msg_id = MSG_SYS_UMASK;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.mask = mask;
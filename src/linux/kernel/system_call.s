@@ -64,8 +64,20 @@ sa_restorer = 12
 /* System call count */
 nr_system_calls = 74
 
-/* Microkernel IPC system call number */
+/* Microkernel IPC system call numbers (match kernel.h) */
 MK_IPC_SEND	= 0x1000	/* Special syscall number for IPC */
+MK_IPC_RECEIVE	= 0x1001
+MK_IPC_REPLY	= 0x1002
+MK_IPC_CALL	= 0x1003
+MK_IPC_REPLY_WAIT = 0x1004
+MK_IPC_SEND_SHORT = 0x1005
+MK_IPC_RECV_SHORT = 0x1006
+MK_IPC_SEND_OOL	= 0x1007
+MK_IPC_SEND_BATCH = 0x1008
+MK_IPC_CHANNEL_OPEN = 0x1009
+MK_IPC_CHANNEL_KICK = 0x100A
+MK_IPC_RECEIVE_MATCH = 0x100B
+nr_ipc_calls	= 22
 
 /* Server ports (from kernel_state) */
 PROCESS_SERVER_PORT	= 0x0004
@@ -109,6 +121,31 @@ syscall_to_server:
 	# 70-73
 	.long 0x06, 0x06, 0x06, 0x06
 
+/* IPC primitives, indexed by (eax - MK_IPC_SEND) */
+ipc_call_table:
+	.long sys_ipc_send	# MK_IPC_SEND
+	.long sys_ipc_receive	# MK_IPC_RECEIVE
+	.long sys_ipc_reply	# MK_IPC_REPLY
+	.long sys_ipc_call	# MK_IPC_CALL
+	.long sys_ipc_reply_wait	# MK_IPC_REPLY_WAIT
+	.long sys_ipc_send_short	# MK_IPC_SEND_SHORT
+	.long sys_ipc_recv_short	# MK_IPC_RECV_SHORT (see ipc_recv_short)
+	.long sys_ipc_send_ool	# MK_IPC_SEND_OOL
+	.long sys_ipc_send_batch	# MK_IPC_SEND_BATCH
+	.long sys_ipc_channel_open	# MK_IPC_CHANNEL_OPEN
+	.long sys_ipc_channel_kick	# MK_IPC_CHANNEL_KICK
+	.long sys_ipc_receive_match	# MK_IPC_RECEIVE_MATCH
+	.long sys_ipc_notify	# MK_IPC_NOTIFY
+	.long sys_ipc_port_stats	# MK_IPC_PORT_STATS
+	.long sys_ipc_sendv	# MK_IPC_SENDV
+	.long sys_ipc_receivev	# MK_IPC_RECEIVEV
+	.long sys_sched_control	# MK_SCHED_CONTROL
+	.long sys_wait		# MK_WAIT
+	.long sys_wake		# MK_WAKE
+	.long sys_ipc_portset_allocate	# MK_IPC_PORTSET_ALLOCATE
+	.long sys_ipc_portset_move	# MK_IPC_PORTSET_MOVE
+	.long sys_ipc_portset_deallocate	# MK_IPC_PORTSET_DEALLOCATE
+
 /* Server port lookup table */
 server_ports:
 	.long 0x0000		# 0: unused
@@ -150,6 +187,10 @@ reschedule:
  *============================================================================*/
 .align 2
 system_call:
+	# IPC primitives are handled in the kernel itself
+	cmpl $MK_IPC_SEND, %eax
+	jae ipc_system_call
+	
 	# Check syscall number range
 	cmpl $nr_system_calls-1, %eax
 	ja bad_sys_call
@@ -198,7 +239,9 @@ do_ipc_syscall:
 	movl $0x????, (%esp)	# msg_id = syscall number? (TODO)
 	movl kernel_state+4, %eax	# kernel_port
 	movl %eax, 4(%esp)	# sender_port
-	movl kernel_state+4, %eax	# kernel_port (reply port)
+	pushl %edx
+	call ipc_reply_port	# task's private reply port
+	popl %edx
 	movl %eax, 8(%esp)	# reply_port
 	movl $32, 12(%esp)	# msg size
 	
@@ -234,9 +277,15 @@ syscall_error:
 	movl $-1, %eax
 	jmp syscall_return
 
+/*
+ * Every path in here arrives with the entry frame on top of the stack,
+ * EAX slot included, so the return value goes into that slot. Pushing
+ * it again would shift the frame by a word: the CS/OLDSS checks below
+ * and the pops at 3: would all be off by one.
+ */
 syscall_return:
 	# Save return value
-	pushl %eax
+	movl %eax, EAX(%esp)
 	
 	# Check if we need to reschedule
 	movl current, %eax
@@ -244,6 +293,8 @@ syscall_return:
 	jne reschedule
 	cmpl $0, counter(%eax)
 	je reschedule
+	cmpl $0, need_resched	# A wakeup outranked us
+	jne reschedule
 
 ret_from_sys_call:
 	# Check for signals (delegated to signal server)
@@ -281,6 +332,75 @@ ret_from_sys_call:
 	pop %ds
 	iret
 
+/*=============================================================================
+ * IPC SYSTEM CALL HANDLER
+ *============================================================================*/
+/*
+ * Arguments arrive in ebx, ecx, edx, esi, edi. The IPC primitives are the
+ * only calls serviced in the kernel, so they never go through a server.
+ */
+.align 2
+ipc_system_call:
+	cmpl $MK_IPC_SEND+nr_ipc_calls-1, %eax
+	ja bad_sys_call
+	
+	push %ds
+	push %es
+	push %fs
+	pushl %edx
+	pushl %ecx
+	pushl %ebx
+	pushl %eax
+	
+	movl $0x10, %ebx
+	mov %bx, %ds
+	mov %bx, %es
+	movl $0x17, %ebx
+	mov %bx, %fs
+	
+	# Reload args clobbered above and push them for the C handler
+	movl EBX(%esp), %ebx
+	cmpl $MK_IPC_RECV_SHORT, %eax
+	je ipc_recv_short
+	pushl %edi
+	pushl %esi
+	pushl %edx
+	pushl %ecx
+	pushl %ebx
+	subl $MK_IPC_SEND, %eax
+	call *ipc_call_table(,%eax,4)
+	addl $20, %esp
+	jmp syscall_return
+
+/*
+ * Short receive: the C handler fills five message registers on the kernel
+ * stack (tag, sender, w0-w2), which are handed back in ebx, ecx, edx, esi
+ * and edi. ebx-edx are patched into the saved frame; esi and edi are not
+ * saved by the entry code and are preserved by the C return path. The
+ * message registers are popped before syscall_return, which expects the
+ * bare entry frame.
+ */
+.align 2
+ipc_recv_short:
+	subl $20, %esp		# Message registers
+	movl %esp, %eax
+	pushl %eax
+	pushl %ebx		# port
+	call sys_ipc_recv_short
+	addl $8, %esp
+	testl %eax, %eax
+	js 1f
+	movl 0(%esp), %ebx
+	movl %ebx, EBX+20(%esp)
+	movl 4(%esp), %ebx
+	movl %ebx, ECX+20(%esp)
+	movl 8(%esp), %ebx
+	movl %ebx, EDX+20(%esp)
+	movl 12(%esp), %esi
+	movl 16(%esp), %edi
+1:	addl $20, %esp
+	jmp syscall_return
+
 /*=============================================================================
  * COPROCESSOR ERROR HANDLER
  *============================================================================*/
@@ -333,7 +453,7 @@ device_not_available:
 	ret
 
 /*=============================================================================
- * TIMER INTERRUPT HANDLER (Forward to system server)
+ * TIMER INTERRUPT HANDLER
  *============================================================================*/
 .align 2
 timer_interrupt:
@@ -352,36 +472,11 @@ timer_interrupt:
 	movl $0x17, %eax
 	mov %ax, %fs
 	
-	# Send timer tick to system server
-	pushl %eax
-	pushl %ecx
-	pushl %edx
-	
-	# Prepare IPC message for timer tick
-	subl $16, %esp		# Allocate message header
-	movl $0x170C, (%esp)	# MSG_SCHED_TIMER
-	movl kernel_state+4, %eax
-	movl %eax, 4(%esp)	# sender_port
-	movl $0, 8(%esp)	# reply_port (none)
-	movl $16, 12(%esp)	# msg size
-	
-	# Send to system server
-	movl kernel_state+20, %ebx	# system_server port
-	leal (%esp), %ecx
-	movl $16, %edx
-	movl $MK_IPC_SEND, %eax
-	int $0x80
-	
-	addl $16, %esp		# Clean up message
-	popl %edx
-	popl %ecx
-	popl %eax
-	
 	# EOI to interrupt controller
 	movb $0x20, %al
 	outb %al, $0x20
 	
-	# Call do_timer locally (still needed for local accounting)
+	# Account the jiffies since the last interrupt and re-arm the PIT
 	movl CS(%esp), %eax
 	andl $3, %eax
 	pushl %eax
@@ -432,21 +527,11 @@ hd_interrupt:
 	movl $0x17, %eax
 	mov %ax, %fs
 	
-	# Send interrupt notification to device server
-	subl $16, %esp
-	movl $0x140?, (%esp)	# MSG_HD_INTERRUPT
-	movl kernel_state+4, %eax
-	movl %eax, 4(%esp)	# sender_port
-	movl $0, 8(%esp)	# reply_port
-	movl $16, 12(%esp)	# msg size
-	
-	movl kernel_state+16, %ebx	# device_server port
-	leal (%esp), %ecx
-	movl $16, %edx
-	movl $MK_IPC_SEND, %eax
-	int $0x80
-	
-	addl $16, %esp
+	# Post the interrupt to the device server, no message allocated
+	pushl $0x4000		# MK_NOTIFY_IRQ(14)
+	pushl kernel_state+16	# device_server port
+	call ipc_notify
+	addl $8, %esp
 	
 	# EOI
 	movb $0x20, %al
@@ -489,21 +574,11 @@ floppy_interrupt:
 	movl $0x17, %eax
 	mov %ax, %fs
 	
-	# Send interrupt notification to device server
-	subl $16, %esp
-	movl $0x1A??, (%esp)	# MSG_FLOPPY_INTERRUPT
-	movl kernel_state+4, %eax
-	movl %eax, 4(%esp)	# sender_port
-	movl $0, 8(%esp)	# reply_port
-	movl $16, 12(%esp)	# msg size
-	
-	movl kernel_state+16, %ebx	# device_server port
-	leal (%esp), %ecx
-	movl $16, %edx
-	movl $MK_IPC_SEND, %eax
-	int $0x80
-	
-	addl $16, %esp
+	# Post the interrupt to the device server, no message allocated
+	pushl $0x0040		# MK_NOTIFY_IRQ(6)
+	pushl kernel_state+16	# device_server port
+	call ipc_notify
+	addl $8, %esp
 	
 	# EOI
 	movb $0x20, %al
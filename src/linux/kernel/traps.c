@@ -84,6 +84,7 @@ __res;})
 #define MSG_TRAP_PARALLEL	0x1912	/* Parallel interrupt */
 #define MSG_TRAP_DIE		0x1913	/* Die handler */
 #define MSG_TRAP_REPLY		0x1914	/* Reply from process server */
+#define MSG_TRAP_SIMD_ERROR	0x1915	/* SIMD floating-point exception */
 
 /*=============================================================================
  * IPC MESSAGE STRUCTURES
@@ -170,6 +171,7 @@ void stack_segment(void);
 void general_protection(void);
 void page_fault(void);
 void coprocessor_error(void);
+void simd_coprocessor_error(void);
 void reserved(void);
 void parallel_interrupt(void);
 void irq13(void);
@@ -198,7 +200,7 @@ static int send_trap_message(unsigned int msg_id, long esp, long error_code,
 	/* Fill trap message */
 	msg.header.msg_id = msg_id;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	/* Get current register state */
@@ -248,7 +250,7 @@ static int send_trap_message(unsigned int msg_id, long esp, long error_code,
 	}
 
 	/* Wait for reply */
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0) {
 		printk("Trap: no reply from process server\n");
 		return -1;
@@ -497,6 +499,22 @@ void do_coprocessor_error(long esp, long error_code)
 	current->signal |= (1 << (signal - 1));
 }
 
+void do_simd_coprocessor_error(long esp, long error_code)
+{
+	int signal = SIGFPE;
+	
+	/*
+	 * An unmasked SSE exception. Its flag stays set in MXCSR and the
+	 * instruction faults again, so the task is signalled even when the
+	 * process server cannot be asked.
+	 */
+	if (send_trap_message(MSG_TRAP_SIMD_ERROR, esp, error_code, &signal) < 0 ||
+	    !signal)
+		signal = SIGFPE;
+	
+	current->signal |= (1 << (signal - 1));
+}
+
 void do_reserved(long esp, long error_code)
 {
 	int signal = SIGSEGV;
@@ -573,6 +591,7 @@ void trap_init(void)
 	/* Fill reserved vectors */
 	for (i = 17; i < 48; i++)
 		set_trap_gate(i, &reserved);
+	set_trap_gate(19, &simd_coprocessor_error);	/* #XM, CR4.OSXMMEXCPT */
 	
 	/* Set up hardware interrupt gates */
 	set_trap_gate(45, &irq13);
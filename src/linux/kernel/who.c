@@ -116,7 +116,7 @@ static inline int user_request(unsigned int msg_id, void *msg_data,
 	if (!need_reply)
 		return 0;
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	result = mk_msg_receive(ipc_reply_port(), &reply, &reply_size);
 	if (result < 0)
 		return -EAGAIN;
 
@@ -174,7 +174,7 @@ int sys_iam(const char* name)
 	/* Prepare IPC message */
 	msg.header.msg_id = MSG_USER_IAM;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	/* Copy name to message */
@@ -239,7 +239,7 @@ int sys_whoami(char* name, unsigned int size)
 	/* Prepare IPC message */
 	msg.header.msg_id = MSG_USER_WHOAMI;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 
 	msg.name = name;
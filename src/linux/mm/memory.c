@@ -152,14 +152,14 @@ static inline int mem_request(unsigned int msg_id, void *msg_data,
 	if (!(current_capability & CAP_MEM_PAGE))
 		return -EPERM;
 
-	result = mk_msg_send(kernel_state->memory_server, msg_data, msg_size);
-	if (result < 0)
-		return -EAGAIN;
-
-	if (!need_reply)
-		return 0;
+	if (!need_reply) {
+		result = mk_msg_send(kernel_state->memory_server, msg_data, msg_size);
+		return (result < 0) ? -EAGAIN : 0;
+	}
 
-	result = mk_msg_receive(kernel_state->kernel_port, &reply, &reply_size);
+	/* Send and wait for the reply in a single trap */
+	result = mk_msg_call(kernel_state->memory_server, msg_data, msg_size,
+	                     &reply, &reply_size);
 	if (result < 0)
 		return -EAGAIN;
 
@@ -203,7 +203,7 @@ unsigned long get_free_page(void)
 
 	msg.header.msg_id = MSG_MEM_GET_FREE_PAGE;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.page = 0;
@@ -217,9 +217,60 @@ unsigned long get_free_page(void)
 	return reply.data.page;
 }
 
-void free_page(unsigned long addr)
+/*
+ * free_page_tables() can release a thousand pages at once. Their
+ * MSG_MEM_FREE_PAGE messages are collected here and sent MK_BATCH_MAX
+ * at a time with mk_msg_send_batch instead of one trap per page.
+ */
+static struct msg_mem_page free_batch[MK_BATCH_MAX];
+static struct mk_msg_desc free_batch_desc[MK_BATCH_MAX];
+static unsigned int free_batch_count = 0;
+
+/*
+ * Before batching, a free is offered to the ring channel to the memory
+ * server; the batch only fills up while that ring is full.
+ */
+static struct mk_channel free_channel;
+
+/**
+ * free_page_ring - Pass a MSG_MEM_FREE_PAGE through the ring channel
+ * @msg: Message to send
+ * 
+ * Returns 0 if the ring took it, -1 if it must be batched.
+ */
+static int free_page_ring(struct msg_mem_page *msg)
 {
-	struct msg_mem_page msg;
+	if (!free_channel.req) {
+		if (free_channel.id)
+			return -1;	/* Open failed before, don't retry */
+		if (mk_channel_open(kernel_state->memory_server, 0,
+		                    &free_channel, MK_CHANNEL_KERNEL) < 0) {
+			free_channel.id = -1;
+			return -1;
+		}
+	}
+	return mk_channel_send(&free_channel, msg);
+}
+
+/**
+ * free_page_flush - Send the collected MSG_MEM_FREE_PAGE messages
+ */
+static void free_page_flush(void)
+{
+	if (free_batch_count)
+		mk_msg_send_batch(free_batch_desc, free_batch_count);
+	free_batch_count = 0;
+}
+
+/**
+ * free_page_batched - free_page() with the server message deferred
+ * @addr: Physical page address
+ * 
+ * The caller must free_page_flush() when done.
+ */
+static void free_page_batched(unsigned long addr)
+{
+	struct msg_mem_page *msg;
 
 	if (addr < LOW_MEM) return;
 	if (addr >= HIGH_MEMORY) {
@@ -234,19 +285,33 @@ void free_page(unsigned long addr)
 		mem_map[addr]--;
 	}
 
-	/* Send to memory server if we have capability */
-	if (current_capability & CAP_MEM_PAGE) {
-		msg.header.msg_id = MSG_MEM_FREE_PAGE;
-		msg.header.sender_port = kernel_state->kernel_port;
-		msg.header.reply_port = 0;
-		msg.header.size = sizeof(msg);
-		
-		msg.page = addr << 12;
-		msg.task_id = kernel_state->current_task;
-		msg.caps = current_capability;
-
-		mem_request(MSG_MEM_FREE_PAGE, &msg, sizeof(msg), 0, NULL);
-	}
+	if (!(current_capability & CAP_MEM_PAGE))
+		return;
+
+	msg = &free_batch[free_batch_count];
+	msg->header.msg_id = MSG_MEM_FREE_PAGE;
+	msg->header.sender_port = kernel_state->kernel_port;
+	msg->header.reply_port = 0;
+	msg->header.size = sizeof(*msg);
+	
+	msg->page = addr << 12;
+	msg->task_id = kernel_state->current_task;
+	msg->caps = current_capability;
+
+	if (!free_page_ring(msg))
+		return;
+
+	free_batch_desc[free_batch_count].port = kernel_state->memory_server;
+	free_batch_desc[free_batch_count].msg = msg;
+
+	if (++free_batch_count == MK_BATCH_MAX)
+		free_page_flush();
+}
+
+void free_page(unsigned long addr)
+{
+	free_page_batched(addr);
+	free_page_flush();
 }
 
 /*=============================================================================
@@ -266,7 +331,7 @@ int free_page_tables(unsigned long from, unsigned long size)
 
 	msg.header.msg_id = MSG_MEM_FREE_PAGE_TABLES;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.from = from;
@@ -288,13 +353,14 @@ int free_page_tables(unsigned long from, unsigned long size)
 			pg_table = (unsigned long *) (0xfffff000 & *dir);
 			for (nr=0 ; nr<1024 ; nr++) {
 				if (1 & *pg_table)
-					free_page(0xfffff000 & *pg_table);
+					free_page_batched(0xfffff000 & *pg_table);
 				*pg_table = 0;
 				pg_table++;
 			}
-			free_page(0xfffff000 & *dir);
+			free_page_batched(0xfffff000 & *dir);
 			*dir = 0;
 		}
+		free_page_flush();
 		invalidate();
 		return 0;
 	}
@@ -313,7 +379,7 @@ int copy_page_tables(unsigned long from, unsigned long to, long size)
 
 	msg.header.msg_id = MSG_MEM_COPY_PAGE_TABLES;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.from = from;
@@ -383,7 +449,7 @@ unsigned long put_page(unsigned long page, unsigned long address)
 
 	msg.header.msg_id = MSG_MEM_PUT_PAGE;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.page = page;
@@ -427,7 +493,7 @@ void un_wp_page(unsigned long * table_entry)
 
 	msg.header.msg_id = MSG_MEM_UN_WP_PAGE;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.page = old_page;
@@ -501,7 +567,7 @@ void get_empty_page(unsigned long address)
 
 	msg.header.msg_id = MSG_MEM_GET_EMPTY_PAGE;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.address = address;
@@ -530,7 +596,7 @@ static int try_to_share(unsigned long address, struct task_struct * p)
 
 	msg.header.msg_id = MSG_MEM_TRY_TO_SHARE;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.address = address;
@@ -558,7 +624,7 @@ static int share_page(unsigned long address)
 
 	msg.header.msg_id = MSG_MEM_SHARE_PAGE;
 	msg.header.sender_port = kernel_state->kernel_port;
-	msg.header.reply_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
 	msg.header.size = sizeof(msg);
 	
 	msg.address = address;
@@ -572,6 +638,93 @@ static int share_page(unsigned long address)
 	return result;
 }
 
+/*=============================================================================
+ * PAGE REMAPPING (IPC stub)
+ *============================================================================*/
+
+/*
+ * Returns the page table entry for a linear address, allocating the page
+ * table when @create is set. NULL if there is none (or no memory).
+ */
+static unsigned long *page_entry(unsigned long address, int create)
+{
+	unsigned long *dir = (unsigned long *) ((address>>20) & 0xffc);
+	unsigned long tmp;
+
+	if (!(1 & *dir)) {
+		if (!create || !(tmp = get_free_page()))
+			return NULL;
+		*dir = tmp | 7;
+	}
+	return (unsigned long *) (0xfffff000 & *dir) + ((address>>12) & 0x3ff);
+}
+
+/**
+ * remap_pages - Move or share whole pages between linear addresses
+ * @from: Source linear address (page aligned)
+ * @to: Destination linear address (page aligned)
+ * @size: Size in bytes
+ * @copy: MEM_COPY_NONE to move, MEM_COPY_ON_WRITE to share
+ * 
+ * Used by IPC to hand out-of-line payloads to the receiver without
+ * copying them. Pages already mapped at @to are released first. Shared
+ * pages are write-protected on both sides and broken by un_wp_page.
+ * 
+ * Returns 0 on success, negative error code.
+ */
+int remap_pages(unsigned long from, unsigned long to, unsigned long size,
+                unsigned int copy)
+{
+	struct msg_mem_remap msg;
+	int result;
+
+	if ((from & 0xfff) || (to & 0xfff))
+		return -EINVAL;
+
+	msg.header.msg_id = MSG_MEM_REMAP;
+	msg.header.sender_port = kernel_state->kernel_port;
+	msg.header.reply_port = ipc_reply_port();
+	msg.header.size = sizeof(msg);
+	
+	msg.from = from;
+	msg.to = to;
+	msg.size = size;
+	msg.copy = copy;
+	msg.task_id = kernel_state->current_task;
+	msg.caps = current_capability;
+
+	result = mem_request(MSG_MEM_REMAP, &msg, sizeof(msg), 1, NULL);
+	if (result < 0) {
+		/* Fallback to local implementation */
+		unsigned long *from_pte, *to_pte;
+		unsigned long this_page;
+
+		for ( ; size > 0 ; from += PAGE_SIZE, to += PAGE_SIZE) {
+			from_pte = page_entry(from, 0);
+			if (!from_pte || !(1 & *from_pte))
+				return -EFAULT;
+			if (!(to_pte = page_entry(to, 1)))
+				return -ENOMEM;
+			if (1 & *to_pte)
+				free_page(0xfffff000 & *to_pte);
+			this_page = *from_pte;
+			if (copy == MEM_COPY_ON_WRITE) {
+				this_page &= ~2;
+				*from_pte = this_page;
+				if (this_page >= LOW_MEM)
+					mem_map[MAP_NR(this_page)]++;
+			} else
+				*from_pte = 0;
+			*to_pte = this_page;
+			size = (size > PAGE_SIZE) ? size - PAGE_SIZE : 0;
+		}
+		invalidate();
+		return 0;
+	}
+
+	return result;
+}
+
 /*=============================================================================
  * PAGE FAULT HANDLING (IPC stub)
  *============================================================================*/